@@ -4,6 +4,7 @@
 #define IP_VERSION boost::asio::ip::udp::v4()
 #define DEFAULT_PORT 23232
 #define DEFAULT_PORT_STR "23232"
+#define DEFAULT_RECEIVE_BATCH 32
 #define NONCE_NON_ENCODED_LENGTH 36
 #define MAX_HISTORY_LINES 100
 
@@ -26,5 +27,6 @@
 #define PUBKEY_PATH (MOKACCINO_ROOT+"public.pem")
 #define DEFAULT_TIME_FORMAT (TAG "[" RESET "%H:%M:%S" TAG "]" RESET " ")
 #define KNOWN_USERS_FILE (MOKACCINO_ROOT+"known_users.toml")
+#define KNOWN_USERS_INDEX_FILE (MOKACCINO_ROOT+"known_users.idx")
 
 extern bool DEBUG;
\ No newline at end of file
@@ -15,11 +15,18 @@ namespace logging::supervisor
     {
         while(true)
         {
+            std::string queues;
+            for(auto& queue: network::udp::queue_stats())
+                queues += " " + queue.name + ":" HIGHLIGHT + std::to_string(queue.depth) + "/" + std::to_string(queue.capacity) + RESET " (dropped:" HIGHLIGHT + std::to_string(queue.dropped) + RESET ")";
+            auto playout = network::audio::playout_statistics();
             log("DBG", 
                 "connections:" HIGHLIGHT + std::to_string(network::udp::connection_map.size()) + RESET " "
                 "services:" HIGHLIGHT + std::to_string(multithreading::get_count()) + RESET " "
                 "audio_dropped_frames: (I:" HIGHLIGHT + std::to_string(network::audio::input_dropped_frames) + RESET ", O:" HIGHLIGHT + std::to_string(network::audio::output_dropped_frames) + RESET ") "
-                "file_transfers: " HIGHLIGHT + std::to_string(network::file::ongoing_transfers_count()) + RESET);
+                "audio_xruns: (I:" HIGHLIGHT + std::to_string(network::audio::input_xruns) + RESET ", O:" HIGHLIGHT + std::to_string(network::audio::output_xruns) + RESET ") "
+                "audio_playout: (delay:" HIGHLIGHT + std::to_string((int)playout.delay_ms) + "ms" RESET ", jitter:" HIGHLIGHT + std::to_string((int)playout.jitter_ms) + "ms" RESET ", concealed:" HIGHLIGHT + std::to_string(playout.concealed) + RESET ") "
+                "file_transfers: " HIGHLIGHT + std::to_string(network::file::ongoing_transfers_count()) + RESET " "
+                "queues:" + queues);
             boost::this_thread::sleep_for(boost::chrono::seconds(sleep_time));
         }
     }
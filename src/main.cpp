@@ -1,5 +1,6 @@
 #include "defines.hpp"
 #include "ansi_escape.hpp"
+#include <map>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
@@ -163,10 +164,44 @@ int main(int argc, char* argv[])
             }
         }
 
+        std::map<std::string,network::udp::QueueOptions> queue_options;
+        auto queues_config = config["network"]["queues"].as_table();
+        if(queues_config != nullptr)
+        {
+            for(auto&& [name, queue_config] : *queues_config)
+            {
+                auto queue_table = queue_config.as_table();
+                if(queue_table == nullptr)
+                    continue;
+                auto capacity = (*queue_table)["capacity"].value<int64_t>();
+                auto policy_name = (*queue_table)["policy"].value<std::string>();
+                std::map<std::string,network::OverflowPolicy> policies = {
+                    {"drop_newest",network::OverflowPolicy::drop_newest},
+                    {"drop_oldest",network::OverflowPolicy::drop_oldest},
+                    {"block",network::OverflowPolicy::block}};
+                if(not capacity.has_value() or *capacity <= 0 or not policy_name.has_value() or policies.find(*policy_name) == policies.end())
+                {
+                    logging::log("ERR","Error in configuration file at network.queues." + std::string(name.str()) + ": capacity must be a positive integer and policy must be one of \"drop_newest\", \"drop_oldest\" or \"block\", the default was selected");
+                    continue;
+                }
+                queue_options[std::string(name.str())] = {(size_t)*capacity,policies[*policy_name]};
+            }
+        }
+
+        auto known_users_store = config["network"]["connection"]["known_users_store"].value_or(std::string("toml"));
+        auto known_users_format = network::authentication::KnownUsers::Format::TOML;
+        if(known_users_store == "index")
+            known_users_format = network::authentication::KnownUsers::Format::INDEX;
+        else if(known_users_store != "toml")
+            logging::log("ERR","Error in configuration file at network.connection.known_users_store: it must be \"toml\" or \"index\", the default was selected");
+
         //INITIALIZATIONS
         logging::supervisor::init(60);
-        network::authentication::init();
-        network::udp::init(config["network"]["port"].value_or(args["port"].as<uint16_t>()));
+        network::authentication::init(known_users_format);
+        network::udp::init(
+            config["network"]["port"].value_or(args["port"].as<uint16_t>()),
+            config["network"]["receive_batch"].value_or<unsigned int>(DEFAULT_RECEIVE_BATCH),
+            queue_options);
         auto encryption = config["network"]["connection"]["encrypt_by_default"].value_or(true);
         if(not encryption)
             logging::log("MSG","Encryption " HIGHLIGHT "disabled" RESET);
@@ -179,7 +214,13 @@ int main(int argc, char* argv[])
             encryption);
         network::messages::init();
         network::timecheck::init();
-        network::audio::init(audio_whitelist,config["network"]["audio"]["default_action"].value_or(std::string("prompt")),config["network"]["audio"]["threshold"].value_or<int16_t>(40));
+        network::audio::CodecOptions codec_options;
+        codec_options.frame_duration_ms = config["network"]["audio"]["frame_duration"].value_or(codec_options.frame_duration_ms);
+        codec_options.bitrate = config["network"]["audio"]["bitrate"].value_or(codec_options.bitrate);
+        codec_options.complexity = config["network"]["audio"]["complexity"].value_or(codec_options.complexity);
+        codec_options.dtx = config["network"]["audio"]["dtx"].value_or(codec_options.dtx);
+        codec_options.fec = config["network"]["audio"]["fec"].value_or(codec_options.fec);
+        network::audio::init(audio_whitelist,config["network"]["audio"]["default_action"].value_or(std::string("prompt")),config["network"]["audio"]["threshold"].value_or<int16_t>(40),codec_options);
         network::file::init();
 
         //autoconnection
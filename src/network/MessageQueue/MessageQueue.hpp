@@ -1,13 +1,19 @@
 #pragma once
+#include <atomic>
+#include <memory>
 #include <string>
+#include <utility>
 #include <boost/asio/ip/udp.hpp>
-#include <boost/thread/sync_queue.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "../udp/DataMap/DataMap.hpp"
 
 namespace network
 {
     /**
      * @brief this struct contains source username ("" if not logged),
-     * source endpoint and message content
+     * source endpoint, message content and the handle to the sender (nullptr if not logged),
+     * so handlers don't need to search it again inside connection_map
      * 
      */
     struct MessageQueueItem
@@ -15,6 +21,288 @@ namespace network
         std::string src;
         boost::asio::ip::udp::endpoint src_endpoint;
         std::string msg;
+        DataMap::Peer peer;
     };
-    typedef boost::sync_queue<MessageQueueItem> MessageQueue;
+    /**
+     * @brief what RingQueue::push_with does when the queue is full
+     * 
+     */
+    enum class OverflowPolicy
+    {
+        // the new item is discarded
+        drop_newest,
+        // the oldest items are discarded to make room for the new one
+        drop_oldest,
+        // the producer waits for a free slot
+        block
+    };
+    /**
+     * @brief bounded multi producer, multi consumer queue on a ring of preallocated slots
+     * push and pull only use atomics while the queue is neither empty nor full, otherwise the thread
+     * sleeps on a condition variable (an interruption point, so services can still be stopped).
+     * pull swaps the slot with the item passed by the consumer, so the buffers of an item already
+     * handled go back in the ring and are reused by the next push_with instead of being reallocated
+     * 
+     * @tparam T the type of the items, it must be default constructible and swappable
+     */
+    template<typename T>
+    class RingQueue
+    {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 1024;
+        /**
+         * @brief create an empty queue
+         * 
+         * @param capacity maximum number of items, rounded up to a power of 2
+         * @param policy what push_with does when the queue is full
+         */
+        explicit RingQueue(size_t capacity = DEFAULT_CAPACITY, OverflowPolicy policy = OverflowPolicy::block)
+        {
+            configure(capacity,policy);
+        }
+        RingQueue(const RingQueue&) = delete;
+        RingQueue& operator=(const RingQueue&) = delete;
+        /**
+         * @brief change capacity and policy, the queue is emptied.
+         * this is not thread safe, it must be called before the queue is shared with other threads
+         * 
+         * @param capacity maximum number of items, rounded up to a power of 2
+         * @param policy what push_with does when the queue is full
+         */
+        void configure(size_t capacity, OverflowPolicy policy)
+        {
+            size_t size = 2;
+            while(size < capacity)
+                size *= 2;
+            mask = size - 1;
+            cells = std::make_unique<Cell[]>(size);
+            for(size_t i = 0; i < size; i++)
+                cells[i].sequence.store(i,std::memory_order_relaxed);
+            enqueue_position.store(0,std::memory_order_relaxed);
+            dequeue_position.store(0,std::memory_order_relaxed);
+            overflow_policy = policy;
+        }
+        /**
+         * @brief add an item writing it directly inside a free slot, if the queue is full the overflow policy is applied
+         * 
+         * @param fill called with the slot, which still contains the buffers of an item already pulled
+         * @return true if the item was added
+         * @return false if the item was discarded because the queue is full (drop_newest)
+         */
+        template<typename F>
+        bool push_with(F&& fill)
+        {
+            if(try_push_with(fill))
+                return true;
+            if(overflow_policy == OverflowPolicy::drop_newest)
+            {
+                dropped_items.fetch_add(1,std::memory_order_relaxed);
+                return false;
+            }
+            if(overflow_policy == OverflowPolicy::drop_oldest)
+            {
+                T oldest;
+                do
+                {
+                    if(_try_pull(oldest))
+                        dropped_items.fetch_add(1,std::memory_order_relaxed);
+                }while(not _try_push_with(fill));
+                _wake(waiting_consumers,not_empty);
+                return true;
+            }
+            {
+                Waiting waiting{waiting_producers};
+                boost::unique_lock lock(wait_mutex);
+                while(not _try_push_with(fill))
+                    not_full.wait(lock);
+            }
+            _wake(waiting_consumers,not_empty);
+            return true;
+        }
+        /**
+         * @brief add an item, if the queue is full the overflow policy is applied
+         * 
+         * @param item the item to add
+         * @return false if the item was discarded
+         */
+        bool push(T item)
+        {
+            return push_with([&](T& slot){ std::swap(slot,item); });
+        }
+        /**
+         * @brief add an item writing it directly inside a free slot
+         * 
+         * @param fill called with the slot, only if the queue is not full
+         * @return true if the item was added
+         * @return false if the queue is full
+         */
+        template<typename F>
+        bool try_push_with(F&& fill)
+        {
+            if(not _try_push_with(fill))
+                return false;
+            _wake(waiting_consumers,not_empty);
+            return true;
+        }
+        /**
+         * @brief take the oldest item, waits if the queue is empty
+         * 
+         * @param item receives the item, its previous content is left in the ring to be reused
+         */
+        void pull(T& item)
+        {
+            if(try_pull(item))
+                return;
+            {
+                Waiting waiting{waiting_consumers};
+                boost::unique_lock lock(wait_mutex);
+                while(not _try_pull(item))
+                    not_empty.wait(lock);
+            }
+            _wake(waiting_producers,not_full);
+        }
+        /**
+         * @brief take the oldest item, waits if the queue is empty
+         * 
+         * @return the item
+         */
+        T pull()
+        {
+            T item;
+            pull(item);
+            return item;
+        }
+        /**
+         * @brief take the oldest item if there is one
+         * 
+         * @param item receives the item, its previous content is left in the ring to be reused
+         * @return true if an item was taken
+         * @return false if the queue is empty
+         */
+        bool try_pull(T& item)
+        {
+            if(not _try_pull(item))
+                return false;
+            _wake(waiting_producers,not_full);
+            return true;
+        }
+        /**
+         * @brief get how many items are waiting, it can be already changed when it returns
+         * 
+         * @return number of items inside the queue
+         */
+        size_t size() const
+        {
+            auto dequeued = dequeue_position.load(std::memory_order_relaxed);
+            auto enqueued = enqueue_position.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+        bool empty() const
+        {
+            return size() == 0;
+        }
+        size_t capacity() const
+        {
+            return mask + 1;
+        }
+        /**
+         * @brief get how many items were discarded because the queue was full
+         * 
+         * @return number of discarded items
+         */
+        size_t dropped() const
+        {
+            return dropped_items.load(std::memory_order_relaxed);
+        }
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+        template<typename F>
+        bool _try_push_with(F& fill)
+        {
+            auto position = enqueue_position.load(std::memory_order_relaxed);
+            Cell* cell;
+            while(true)
+            {
+                cell = &cells[position & mask];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+                if(difference == 0)
+                {
+                    if(enqueue_position.compare_exchange_weak(position,position+1,std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                    return false;
+                else
+                    position = enqueue_position.load(std::memory_order_relaxed);
+            }
+            fill(cell->data);
+            cell->sequence.store(position+1,std::memory_order_release);
+            return true;
+        }
+        bool _try_pull(T& item)
+        {
+            auto position = dequeue_position.load(std::memory_order_relaxed);
+            Cell* cell;
+            while(true)
+            {
+                cell = &cells[position & mask];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(position+1);
+                if(difference == 0)
+                {
+                    if(dequeue_position.compare_exchange_weak(position,position+1,std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                    return false;
+                else
+                    position = dequeue_position.load(std::memory_order_relaxed);
+            }
+            std::swap(item,cell->data);
+            cell->sequence.store(position+mask+1,std::memory_order_release);
+            return true;
+        }
+        // the waiter registers itself and then checks the queue again under wait_mutex, while the
+        // other side publishes the item and then checks for waiters, the fences make sure at least
+        // one of the two sees the other, so a wake up can't be lost
+        struct Waiting
+        {
+            std::atomic<unsigned int>& count;
+            explicit Waiting(std::atomic<unsigned int>& count): count(count)
+            {
+                count++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            ~Waiting()
+            {
+                count--;
+            }
+        };
+        void _wake(std::atomic<unsigned int>& waiting, boost::condition_variable& condition)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(waiting.load(std::memory_order_relaxed) != 0)
+            {
+                boost::unique_lock lock(wait_mutex);
+                condition.notify_all();
+            }
+        }
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> enqueue_position = 0;
+        alignas(64) std::atomic<size_t> dequeue_position = 0;
+        alignas(64) std::atomic<unsigned int> waiting_producers = 0;
+        std::atomic<unsigned int> waiting_consumers = 0;
+        std::atomic<size_t> dropped_items = 0;
+        OverflowPolicy overflow_policy = OverflowPolicy::block;
+        boost::mutex wait_mutex;
+        boost::condition_variable not_empty;
+        boost::condition_variable not_full;
+    };
+    typedef RingQueue<MessageQueueItem> MessageQueue;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "Forwarder.hpp"
+namespace network::audio
+{
+    bool Forwarder::add(const std::string& name, const boost::asio::ip::udp::endpoint& endpoint)
+    {
+        if(participants.size() >= MAX_PARTICIPANTS or participants.find(name) != participants.end())
+            return false;
+        participants[name].endpoint = endpoint;
+        return true;
+    }
+    bool Forwarder::remove(const std::string& name)
+    {
+        return participants.erase(name) > 0;
+    }
+    std::vector<std::string> Forwarder::remove_if(const std::function<bool(const std::string& name)>& remove)
+    {
+        std::vector<std::string> removed;
+        for(auto it = participants.begin(); it != participants.end();)
+        {
+            if(remove(it->first))
+            {
+                removed.push_back(it->first);
+                it = participants.erase(it);
+            }else
+                it++;
+        }
+        return removed;
+    }
+    bool Forwarder::contains(const std::string& name) const
+    {
+        return participants.find(name) != participants.end();
+    }
+    size_t Forwarder::size() const
+    {
+        return participants.size();
+    }
+    std::vector<boost::asio::ip::udp::endpoint> Forwarder::endpoints() const
+    {
+        std::vector<boost::asio::ip::udp::endpoint> ret;
+        for(auto& [name, participant]: participants)
+            ret.push_back(participant.endpoint);
+        return ret;
+    }
+    void Forwarder::route(const std::string& name, uint16_t level, const boost::posix_time::ptime& arrival, std::vector<boost::asio::ip::udp::endpoint>& targets, uint16_t& sequence)
+    {
+        targets.clear();
+        auto it = participants.find(name);
+        if(it == participants.end())
+            return;
+        auto& sender = it->second;
+        // a new talkspurt starts from its own level
+        bool was_active = not sender.last_frame.is_not_a_date_time() and arrival - sender.last_frame < boost::posix_time::milliseconds(ACTIVE_MS);
+        sender.level = was_active ? sender.level + (level - sender.level) * LEVEL_SMOOTHING : level;
+        sender.last_frame = arrival;
+        auto priority = [](const Participant& participant){
+            return participant.level * (participant.forwarded ? FORWARDED_BONUS : 1);
+        };
+        size_t louder = 0;
+        for(auto& [other_name, other]: participants)
+        {
+            if(&other == &sender or other.last_frame.is_not_a_date_time() or arrival - other.last_frame >= boost::posix_time::milliseconds(ACTIVE_MS))
+            {
+                if(&other != &sender)
+                    other.forwarded = false;// it stopped talking
+                continue;
+            }
+            if(priority(other) > priority(sender) or (priority(other) == priority(sender) and other_name < name))
+                louder++;
+        }
+        sender.forwarded = louder < MAX_SPEAKERS;
+        if(not sender.forwarded)
+            return;
+        sequence = sender.forwarded_sequence++;
+        for(auto& [other_name, other]: participants)
+            if(&other != &sender)
+                targets.push_back(other.endpoint);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace network::audio
+{
+    /**
+     * @brief chooses which voice frames a selective forwarding unit sends to whom.
+     * Every participant sends a single stream to the forwarding peer, which forwards it to every other participant
+     * without decoding it, but only for the loudest recent speakers, using the level each frame carries.
+     * A speaker already forwarded needs to be clearly quieter to be replaced, so the speakers don't flap
+     * 
+     */
+    class Forwarder
+    {
+    public:
+        static constexpr size_t MAX_PARTICIPANTS = 20;
+        // speakers forwarded at the same time
+        static constexpr size_t MAX_SPEAKERS = 3;
+        // a participant is speaking if it sent a frame this recently
+        static constexpr unsigned int ACTIVE_MS = 200;
+        // level advantage of a speaker that is already forwarded
+        static constexpr double FORWARDED_BONUS = 1.5;
+        // weight of the level of a new frame in the level of a participant
+        static constexpr double LEVEL_SMOOTHING = 0.2;
+        /**
+         * @brief add a participant
+         * 
+         * @return false if the conference is full or the participant is already in it
+         */
+        bool add(const std::string& name, const boost::asio::ip::udp::endpoint& endpoint);
+        /**
+         * @brief remove a participant
+         * 
+         * @return false if it was not in the conference
+         */
+        bool remove(const std::string& name);
+        /**
+         * @brief remove every participant for which remove returns true
+         * 
+         * @return the names of the participants removed
+         */
+        std::vector<std::string> remove_if(const std::function<bool(const std::string& name)>& remove);
+        bool contains(const std::string& name) const;
+        size_t size() const;
+        /**
+         * @brief endpoints of every participant
+         * 
+         */
+        std::vector<boost::asio::ip::udp::endpoint> endpoints() const;
+        /**
+         * @brief decide where a frame received from a participant must be forwarded
+         * 
+         * @param name the sender
+         * @param level voice level of the frame (mean absolute sample)
+         * @param arrival when the frame was received
+         * @param targets receives the endpoints to forward the frame to, empty if the sender is not among the loudest speakers
+         * @param sequence receives the sequence number of the forwarded frame, the frames forwarded from a speaker are numbered
+         * without gaps, so the frames not forwarded don't look lost to the receivers
+         */
+        void route(const std::string& name, uint16_t level, const boost::posix_time::ptime& arrival, std::vector<boost::asio::ip::udp::endpoint>& targets, uint16_t& sequence);
+    private:
+        struct Participant
+        {
+            boost::asio::ip::udp::endpoint endpoint;
+            double level = 0;
+            boost::posix_time::ptime last_frame;
+            bool forwarded = false;
+            // sequence number of the next frame forwarded
+            uint16_t forwarded_sequence = 0;
+        };
+        std::map<std::string,Participant> participants;
+    };
+}
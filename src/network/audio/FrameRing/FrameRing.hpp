@@ -0,0 +1,84 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <stddef.h>
+namespace network::audio
+{
+    /**
+     * @brief wait-free single producer single consumer ring of preallocated slots,
+     * made for the audio callbacks: they only copy samples in and out of a slot, they never allocate or lock.
+     * The producer fills the slot returned by write_slot() and publishes it with commit_write(),
+     * the consumer reads the slot returned by read_slot() and gives it back with commit_read()
+     * 
+     * @tparam T content of a slot
+     * @tparam SLOTS number of slots, a power of two
+     */
+    template<typename T, size_t SLOTS>
+    class FrameRing
+    {
+        static_assert(SLOTS > 0 and (SLOTS & (SLOTS - 1)) == 0, "the slots must be a power of two");
+    public:
+        /**
+         * @brief get the slot to fill, only from the producer
+         * 
+         * @return the slot or nullptr if the ring is full
+         */
+        T* write_slot()
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            if(head - _tail.load(std::memory_order_acquire) == SLOTS)
+                return nullptr;
+            return &slots[head % SLOTS];
+        }
+        /**
+         * @brief publish the slot returned by write_slot()
+         * 
+         */
+        void commit_write()
+        {
+            _head.store(_head.load(std::memory_order_relaxed) + 1,std::memory_order_release);
+        }
+        /**
+         * @brief get the oldest filled slot, only from the consumer
+         * 
+         * @return the slot or nullptr if the ring is empty
+         */
+        T* read_slot()
+        {
+            auto tail = _tail.load(std::memory_order_relaxed);
+            if(tail == _head.load(std::memory_order_acquire))
+                return nullptr;
+            return &slots[tail % SLOTS];
+        }
+        /**
+         * @brief give back the slot returned by read_slot()
+         * 
+         */
+        void commit_read()
+        {
+            _tail.store(_tail.load(std::memory_order_relaxed) + 1,std::memory_order_release);
+        }
+        /**
+         * @brief number of filled slots, exact only from the producer or the consumer
+         * 
+         */
+        size_t size() const
+        {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+        /**
+         * @brief empty the ring, neither the producer nor the consumer can be running
+         * 
+         */
+        void clear()
+        {
+            _head.store(0);
+            _tail.store(0);
+        }
+    private:
+        // on different cache lines so the two threads don't invalidate each other
+        alignas(64) std::atomic<size_t> _head{0};
+        alignas(64) std::atomic<size_t> _tail{0};
+        std::array<T,SLOTS> slots;
+    };
+}
@@ -0,0 +1,215 @@
+#include "JitterBuffer.hpp"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+namespace network::audio
+{
+    JitterBuffer::JitterBuffer(unsigned int frame_samples, unsigned int sample_rate):
+        frame_samples(frame_samples),
+        sample_rate(sample_rate)
+    {
+        reset();
+    }
+    void JitterBuffer::reset()
+    {
+        std::unique_lock lock(mutex);
+        for(auto& slot: slots)
+            slot.valid = false;
+        started = false;
+        scheduled = false;
+        buffered = 0;
+        concealed_run = 0;
+        epoch = {};
+        has_previous = false;
+        jitter = 0;
+        histogram = {};
+        window_min_transit = std::numeric_limits<double>::infinity();
+        previous_min_transit = std::numeric_limits<double>::infinity();
+        window_frames = 0;
+        counters = {};
+    }
+    void JitterBuffer::reset(unsigned int frame_samples)
+    {
+        {
+            std::unique_lock lock(mutex);
+            this->frame_samples = frame_samples;
+        }
+        reset();
+    }
+    uint32_t JitterBuffer::_target_delay() const
+    {
+        double total = 0;
+        for(auto weight: histogram)
+            total += weight;
+        // the smallest delay that would let DELAY_QUANTILE of the frames arrive in time
+        size_t bucket = 0;
+        for(double sum = histogram[0]; bucket + 1 < HISTOGRAM_BUCKETS and sum < total * DELAY_QUANTILE; sum += histogram[++bucket]);
+        auto max_frames = std::max(MAX_DELAY_MS * sample_rate / 1000 / frame_samples,1u);
+        return std::min((unsigned int)bucket + 1,max_frames) * frame_samples;
+    }
+    bool JitterBuffer::push(uint16_t sequence, uint32_t timestamp, std::string_view data, const boost::posix_time::ptime& arrival)
+    {
+        std::unique_lock lock(mutex);
+        if(epoch.is_not_a_date_time())
+            epoch = arrival;
+        // interarrival jitter, the difference between the arrival times compared to the difference between the timestamps
+        double arrival_samples = double((arrival - epoch).total_microseconds()) * sample_rate / 1e6;
+        if(has_previous)
+        {
+            double difference = (arrival_samples - previous_arrival) - double((int32_t)(timestamp - previous_timestamp));
+            jitter += (std::abs(difference) - jitter) / 16;
+        }
+        has_previous = true;
+        previous_arrival = arrival_samples;
+        previous_timestamp = timestamp;
+
+        // delay compared to the fastest recent frame, the clocks of the two peers don't need to agree
+        double transit = arrival_samples - timestamp;
+        window_min_transit = std::min(window_min_transit,transit);
+        double delay = transit - std::min(window_min_transit,previous_min_transit);
+        if(++window_frames == BASE_WINDOW)
+        {
+            previous_min_transit = window_min_transit;
+            window_min_transit = std::numeric_limits<double>::infinity();
+            window_frames = 0;
+        }
+        for(auto& weight: histogram)
+            weight *= HISTOGRAM_FORGET;
+        histogram[std::min((size_t)(delay / frame_samples),HISTOGRAM_BUCKETS - 1)] += 1 - HISTOGRAM_FORGET;
+
+        auto ahead = (int16_t)(uint16_t)(sequence - next_sequence);
+        if(started and ahead < 0 and not scheduled and buffered == 0 and -ahead <= (int)concealed_run)
+        {// the frames concealed at the end of the last talkspurt were never sent, this one starts the next talkspurt
+            next_sequence = sequence;
+            concealed_run = 0;
+            ahead = 0;
+        }
+        if(started and ahead < 0)
+        {// already played or concealed
+            counters.late++;
+            return false;
+        }
+        if(not started or ahead >= (int16_t)SLOTS)
+        {// first frame of the call or the sender restarted, everything buffered is discarded
+            for(auto& slot: slots)
+                slot.valid = false;
+            buffered = 0;
+            next_sequence = sequence;
+            started = true;
+            scheduled = false;
+        }
+        auto& slot = slots[sequence % SLOTS];
+        if(slot.valid and slot.sequence == sequence)
+            return false;
+        if(not slot.valid)
+            buffered++;
+        slot.valid = true;
+        slot.sequence = sequence;
+        slot.timestamp = timestamp;
+        slot.delay = (uint32_t)delay;
+        slot.data.assign(data);
+        if(buffered == 1 or (int32_t)(timestamp - newest_timestamp) > 0)
+            newest_timestamp = timestamp;
+        return true;
+    }
+    JitterBuffer::Action JitterBuffer::pop(std::string& data)
+    {
+        std::unique_lock lock(mutex);
+        if(not started)
+            return Action::silence;
+        auto frame = (int32_t)frame_samples;
+        while(true)
+        {
+            auto& slot = slots[next_sequence % SLOTS];
+            if(slot.valid and slot.sequence == next_sequence)
+            {
+                auto target = _target_delay();
+                if(not scheduled)
+                {// start of a talkspurt, the delay can change here without cutting any audio
+                    // this frame already waited its own delay in the network
+                    playout = slot.timestamp - (target > slot.delay ? (target - slot.delay) / frame_samples * frame_samples : 0);
+                    scheduled = true;
+                    scheduled_delay = target;
+                }
+                auto early = (int32_t)(slot.timestamp - playout);
+                if(early >= frame)
+                {// waiting for the playout time of this frame
+                    playout += frame_samples;
+                    return Action::silence;
+                }
+                if(early <= -frame)
+                {// the playout fell behind, the talkspurt starts again with the current delay
+                    scheduled = false;
+                    continue;
+                }
+                slot.valid = false;
+                buffered--;
+                next_sequence++;
+                playout += frame_samples;
+                if(buffered > 0 and (int32_t)(newest_timestamp - playout) > (int32_t)(target + MAX_EXTRA_FRAMES * frame_samples))
+                {// too much audio is waiting, this frame is skipped
+                    counters.discarded++;
+                    scheduled_delay -= std::min(scheduled_delay,frame_samples);
+                    continue;
+                }
+                data.assign(slot.data);
+                concealed_run = 0;
+                counters.played++;
+                return Action::play;
+            }
+            if(not scheduled)
+            {
+                if(buffered == 0)
+                    return Action::silence;
+                // the first frames of the talkspurt were lost, it starts from the oldest frame received
+                int16_t oldest = std::numeric_limits<int16_t>::max();
+                for(auto& candidate: slots)
+                {
+                    if(candidate.valid)
+                        oldest = std::min(oldest,(int16_t)(uint16_t)(candidate.sequence - next_sequence));
+                }
+                next_sequence += oldest;
+                concealed_run = 0;
+                continue;
+            }
+            if(buffered > 0)
+            {// a later frame is here, this one is lost
+                next_sequence++;
+                playout += frame_samples;
+                counters.concealed++;
+                auto& next = slots[next_sequence % SLOTS];
+                if(next.valid and next.sequence == next_sequence)
+                    data.assign(next.data);
+                else
+                    data.clear();
+                return Action::conceal;
+            }
+            if(_target_delay() > scheduled_delay)
+            {// the frames arrive later than planned, the talkspurt goes on with the new delay from the next frame received
+                scheduled = false;
+                counters.concealed++;
+                data.clear();
+                return Action::conceal;
+            }
+            if(concealed_run < MAX_CONCEALED_RUN)
+            {// the next frame could still arrive, if it does it will be late
+                concealed_run++;
+                next_sequence++;
+                playout += frame_samples;
+                counters.concealed++;
+                data.clear();
+                return Action::conceal;
+            }
+            scheduled = false;
+            return Action::silence;
+        }
+    }
+    JitterBuffer::Statistics JitterBuffer::statistics()
+    {
+        std::unique_lock lock(mutex);
+        auto ret = counters;
+        ret.jitter_ms = jitter * 1000 / sample_rate;
+        ret.delay_ms = double(_target_delay()) * 1000 / sample_rate;
+        return ret;
+    }
+}
\ No newline at end of file
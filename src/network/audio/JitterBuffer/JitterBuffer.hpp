@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace network::audio
+{
+    /**
+     * @brief reorders the voice frames received and decides what to play every frame period.
+     * Every frame is delayed by how late it arrived compared to the fastest recent frame, the playout delay
+     * is a quantile of a histogram of these delays that slowly forgets the old ones, so it stays at a frame on a LAN
+     * and grows with the jitter on a bad link. The delay is set again at the start of every talkspurt and when
+     * the playout falls behind, and it's reduced discarding a frame when too much audio is buffered.
+     * A missing frame is concealed, with the FEC data of the next frame if it's already here
+     * 
+     */
+    class JitterBuffer
+    {
+    public:
+        // frames that can be buffered, a frame further ahead restarts the buffer
+        static constexpr size_t SLOTS = 64;
+        // delays in the histogram are rounded to a frame, longer ones go in the last bucket
+        static constexpr size_t HISTOGRAM_BUCKETS = 64;
+        // fraction of the frames that must arrive before their playout time
+        static constexpr double DELAY_QUANTILE = 0.97;
+        // every frame received multiplies the old histogram by this
+        static constexpr double HISTOGRAM_FORGET = 0.998;
+        // the fastest frame is searched in the last one or two windows of this many frames, so the reference follows clock drift
+        static constexpr unsigned int BASE_WINDOW = 512;
+        // the playout delay is never above this
+        static constexpr unsigned int MAX_DELAY_MS = 200;
+        // frames buffered over the playout delay before one is discarded
+        static constexpr unsigned int MAX_EXTRA_FRAMES = 2;
+        // missing frames concealed when the buffer is empty before the talkspurt is considered ended
+        static constexpr unsigned int MAX_CONCEALED_RUN = 4;
+        /**
+         * @brief what the output must do for the current frame period
+         * 
+         */
+        enum class Action
+        {
+            // decode the frame returned
+            play,
+            // a frame is missing, decode the FEC data returned or use the packet loss concealment if there is none
+            conceal,
+            // nothing to play
+            silence
+        };
+        struct Statistics
+        {
+            // interarrival jitter as defined by RFC 3550
+            double jitter_ms;
+            double delay_ms;
+            unsigned long long played;
+            unsigned long long concealed;
+            // frames received after their playout time
+            unsigned long long late;
+            // frames discarded to reduce the delay
+            unsigned long long discarded;
+        };
+        /**
+         * @brief create an empty buffer
+         * 
+         * @param frame_samples samples in a frame, this is also how much the timestamp grows every frame
+         * @param sample_rate samples per second
+         */
+        JitterBuffer(unsigned int frame_samples, unsigned int sample_rate);
+        /**
+         * @brief forget every frame and the statistics, used when a new call starts
+         * 
+         */
+        void reset();
+        /**
+         * @brief reset the buffer for a call with a different frame size
+         * 
+         * @param frame_samples samples in a frame of the new call
+         */
+        void reset(unsigned int frame_samples);
+        /**
+         * @brief add a received frame
+         * 
+         * @param sequence sequence number of the frame, it grows by one for every frame sent
+         * @param timestamp capture time of the first sample of the frame, in samples
+         * @param data the encoded frame
+         * @param arrival when the frame was received
+         * @return true if the frame was buffered
+         * @return false if the frame was late or a duplicate
+         */
+        bool push(uint16_t sequence, uint32_t timestamp, std::string_view data, const boost::posix_time::ptime& arrival);
+        /**
+         * @brief get what to play in the next frame period, it must be called once every period
+         * 
+         * @param data receives the frame to decode (play) or its FEC data (conceal, empty if there is none)
+         * @return what to do with data
+         */
+        Action pop(std::string& data);
+        Statistics statistics();
+    private:
+        struct Slot
+        {
+            bool valid = false;
+            uint16_t sequence = 0;
+            uint32_t timestamp = 0;
+            // how late the frame arrived compared to the fastest recent frame, in samples
+            uint32_t delay = 0;
+            std::string data;
+        };
+        // playout delay in samples, a multiple of the frame
+        uint32_t _target_delay() const;
+        std::mutex mutex;
+        std::array<Slot,SLOTS> slots;
+        unsigned int frame_samples;
+        unsigned int sample_rate;
+        // a frame was received since the last reset
+        bool started = false;
+        // the playout time of the current talkspurt was chosen
+        bool scheduled = false;
+        uint16_t next_sequence = 0;
+        // timestamp that should be played in the next frame period
+        uint32_t playout = 0;
+        // playout delay of the current talkspurt, in samples
+        uint32_t scheduled_delay = 0;
+        uint32_t newest_timestamp = 0;
+        size_t buffered = 0;
+        unsigned int concealed_run = 0;
+        boost::posix_time::ptime epoch;
+        bool has_previous = false;
+        double previous_arrival = 0;
+        uint32_t previous_timestamp = 0;
+        // in samples
+        double jitter = 0;
+        std::array<double,HISTOGRAM_BUCKETS> histogram{};
+        // minimum transit time (arrival - timestamp) in the current and in the previous window
+        double window_min_transit = 0;
+        double previous_min_transit = 0;
+        unsigned int window_frames = 0;
+        Statistics counters{};
+    };
+}
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "Mixer.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <algorithm>
+#include "../kernels/kernels.hpp"
+namespace network::audio
+{
+    Mixer::Participant::Participant(unsigned int frame_samples, unsigned int sample_rate):
+        jitter_buffer(frame_samples,sample_rate),
+        decoded(frame_samples),
+        output(frame_samples),
+        packet(MAX_PACKET_SIZE)
+    {}
+    Mixer::Participant::~Participant()
+    {
+        if(decoder != nullptr)
+            opus_decoder_destroy(decoder);
+        if(encoder != nullptr)
+            opus_encoder_destroy(encoder);
+    }
+
+    Mixer::Mixer(unsigned int frame_samples, unsigned int sample_rate, unsigned int threads):
+        frame_samples(frame_samples),
+        sample_rate(sample_rate),
+        threads(threads),
+        total(frame_samples),
+        silence(frame_samples,0)
+    {
+        if(threads > 0)
+            pool = std::make_unique<boost::asio::thread_pool>(threads);
+    }
+    Mixer::~Mixer()
+    {
+        if(pool != nullptr)
+            pool->join();
+    }
+    bool Mixer::add(const std::string& name)
+    {
+        if(participants.size() >= MAX_PARTICIPANTS or participants.find(name) != participants.end())
+            return false;
+        auto participant = std::make_unique<Participant>(frame_samples,sample_rate);
+        int error = 0;
+        participant->decoder = opus_decoder_create(sample_rate,1,&error);
+        if(error != OPUS_OK)
+            return false;
+        order.push_back(participant.get());
+        participants[name] = std::move(participant);
+        return true;
+    }
+    bool Mixer::add(const std::string& name, const boost::asio::ip::udp::endpoint& endpoint, const EncoderSettings& settings)
+    {
+        if(participants.size() >= MAX_PARTICIPANTS or participants.find(name) != participants.end())
+            return false;
+        auto participant = std::make_unique<Participant>(frame_samples,sample_rate);
+        participant->endpoint = endpoint;
+        int error = 0;
+        participant->decoder = opus_decoder_create(sample_rate,1,&error);
+        if(error != OPUS_OK)
+            return false;
+        participant->encoder = opus_encoder_create(sample_rate,1,OPUS_APPLICATION_VOIP,&error);
+        if(error != OPUS_OK)
+            return false;
+        opus_encoder_ctl(participant->encoder,OPUS_SET_BITRATE(settings.bitrate));
+        opus_encoder_ctl(participant->encoder,OPUS_SET_COMPLEXITY(settings.complexity));
+        opus_encoder_ctl(participant->encoder,OPUS_SET_DTX(settings.dtx?1:0));
+        opus_encoder_ctl(participant->encoder,OPUS_SET_INBAND_FEC(settings.fec?1:0));
+        opus_encoder_ctl(participant->encoder,OPUS_SET_PACKET_LOSS_PERC(settings.fec?EXPECTED_LOSS_PERCENT:0));
+        order.push_back(participant.get());
+        participants[name] = std::move(participant);
+        return true;
+    }
+    bool Mixer::remove(const std::string& name)
+    {
+        return not remove_if([&](const std::string& participant){ return participant == name; }).empty();
+    }
+    std::vector<std::string> Mixer::remove_if(const std::function<bool(const std::string& name)>& remove)
+    {
+        std::vector<std::string> removed;
+        for(auto it = participants.begin(); it != participants.end();)
+        {
+            if(remove(it->first))
+            {
+                order.erase(std::find(order.begin(),order.end(),it->second.get()));
+                removed.push_back(it->first);
+                it = participants.erase(it);
+            }else
+                it++;
+        }
+        return removed;
+    }
+    bool Mixer::contains(const std::string& name) const
+    {
+        return participants.find(name) != participants.end();
+    }
+    size_t Mixer::size() const
+    {
+        return participants.size();
+    }
+    std::vector<boost::asio::ip::udp::endpoint> Mixer::endpoints() const
+    {
+        std::vector<boost::asio::ip::udp::endpoint> ret;
+        for(auto& [name, participant]: participants)
+            ret.push_back(participant->endpoint);
+        return ret;
+    }
+    bool Mixer::push(const std::string& name, uint16_t sequence, uint32_t timestamp, std::string_view data, const boost::posix_time::ptime& arrival)
+    {
+        auto it = participants.find(name);
+        if(it == participants.end())
+            return false;
+        return it->second->jitter_buffer.push(sequence,timestamp,data,arrival);
+    }
+    void Mixer::_parallel(size_t count, const std::function<void(size_t)>& job)
+    {
+        if(pool == nullptr or count < 2)
+        {
+            for(size_t i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+        // every worker takes the next index until there are none left, the calling thread works too
+        std::atomic<size_t> next = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t workers = std::min<size_t>(threads,count - 1);
+        size_t running = workers;
+        for(size_t w = 0; w < workers; w++)
+        {
+            boost::asio::post(*pool,[&](){
+                for(size_t i = next++; i < count; i = next++)
+                    job(i);
+                std::unique_lock lock(mutex);
+                if(--running == 0)
+                    finished.notify_one();
+            });
+        }
+        for(size_t i = next++; i < count; i = next++)
+            job(i);
+        std::unique_lock lock(mutex);
+        finished.wait(lock,[&](){ return running == 0; });
+    }
+    void Mixer::mix(const int16_t* capture, bool speech, int16_t* playback, const Sender& send)
+    {
+        _parallel(order.size(),[&](size_t i){
+            auto& participant = *order[i];
+            int decoded_size = -1;
+            switch(participant.jitter_buffer.pop(participant.received))
+            {
+            case JitterBuffer::Action::play:
+                decoded_size = opus_decode(participant.decoder,(const unsigned char*)participant.received.data(),(opus_int32)participant.received.length(),participant.decoded.data(),frame_samples,0);
+                break;
+            case JitterBuffer::Action::conceal:
+                if(participant.received.empty())
+                    decoded_size = opus_decode(participant.decoder,nullptr,0,participant.decoded.data(),frame_samples,0);
+                else
+                    decoded_size = opus_decode(participant.decoder,(const unsigned char*)participant.received.data(),(opus_int32)participant.received.length(),participant.decoded.data(),frame_samples,1);
+                break;
+            case JitterBuffer::Action::silence:
+                break;
+            }
+            participant.active = decoded_size > 0;
+        });
+
+        std::fill(total.begin(),total.end(),0);
+        size_t active = 0;
+        if(speech)
+        {
+            kernels::accumulate(total.data(),capture,frame_samples);
+            active++;
+        }
+        for(auto participant: order)
+        {
+            if(participant->active)
+            {
+                kernels::accumulate(total.data(),participant->decoded.data(),frame_samples);
+                active++;
+            }
+        }
+        kernels::mix_minus(playback,total.data(),speech ? capture : silence.data(),frame_samples);
+
+        if(not send)
+            return;
+        _parallel(order.size(),[&](size_t i){
+            auto& participant = *order[i];
+            auto timestamp = participant.timestamp;
+            participant.timestamp += frame_samples;
+            if(participant.encoder == nullptr or active - participant.active == 0)
+                return;// only heard, or nobody else is talking and the participant plays comfort noise
+            kernels::mix_minus(participant.output.data(),total.data(),participant.active ? participant.decoded.data() : silence.data(),frame_samples);
+            auto encoded_size = opus_encode(participant.encoder,participant.output.data(),frame_samples,participant.packet.data(),(opus_int32)participant.packet.size());
+            if(encoded_size > DTX_PACKET_SIZE)
+                send(participant.endpoint,{"AUDIO",std::to_string(participant.sequence++),std::to_string(timestamp),std::string((char*)participant.packet.data(),encoded_size)});
+        });
+    }
+    void Mixer::play(int16_t* playback)
+    {
+        mix(silence.data(),false,playback,nullptr);
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <stdint.h>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opus/opus.h>
+#include "../JitterBuffer/JitterBuffer.hpp"
+namespace network::audio
+{
+    // the largest packet Opus can produce (3 frames of 1275 bytes)
+    constexpr opus_int32 MAX_PACKET_SIZE = 3*1275;
+    // Opus packets this small don't need to be sent (DTX)
+    constexpr opus_int32 DTX_PACKET_SIZE = 2;
+    // expected loss used by the encoders to decide how much FEC data to add
+    constexpr opus_int32 EXPECTED_LOSS_PERCENT = 10;
+    /**
+     * @brief mixes a conference hosted by this peer.
+     * Every participant sends its voice to the host, the host decodes every stream with a decoder for each participant,
+     * sums them with its own voice and sends to every participant the mix without its own voice (mix-minus),
+     * encoded once for each participant. Decoding and encoding are split between a pool of threads.
+     * The calls to the methods must not overlap
+     * 
+     */
+    class Mixer
+    {
+    public:
+        static constexpr size_t MAX_PARTICIPANTS = 20;
+        /**
+         * @brief encoder settings of a participant
+         * 
+         */
+        struct EncoderSettings
+        {
+            opus_int32 bitrate;
+            int complexity;
+            bool dtx;
+            bool fec;
+        };
+        /**
+         * @brief sends the fields of a message to a participant, it can be called from many threads at once
+         * 
+         */
+        typedef std::function<void(const boost::asio::ip::udp::endpoint& endpoint, const std::vector<std::string>& fields)> Sender;
+        /**
+         * @brief create a mixer without participants
+         * 
+         * @param frame_samples samples in a frame, every participant must use the same
+         * @param sample_rate samples per second
+         * @param threads threads used to decode and encode, 0 to do everything on the calling thread
+         */
+        Mixer(unsigned int frame_samples, unsigned int sample_rate, unsigned int threads);
+        ~Mixer();
+        /**
+         * @brief add a participant
+         * 
+         * @return false if the conference is full, the participant is already in it or its codecs could not be created
+         */
+        bool add(const std::string& name, const boost::asio::ip::udp::endpoint& endpoint, const EncoderSettings& settings);
+        /**
+         * @brief add a participant that is only heard, nothing is sent to it (a speaker forwarded by another peer)
+         * 
+         * @return false if the conference is full, the participant is already in it or its decoder could not be created
+         */
+        bool add(const std::string& name);
+        /**
+         * @brief remove a participant
+         * 
+         * @return false if it was not in the conference
+         */
+        bool remove(const std::string& name);
+        /**
+         * @brief remove every participant for which remove returns true
+         * 
+         * @return the names of the participants removed
+         */
+        std::vector<std::string> remove_if(const std::function<bool(const std::string& name)>& remove);
+        bool contains(const std::string& name) const;
+        size_t size() const;
+        /**
+         * @brief endpoints of every participant
+         * 
+         */
+        std::vector<boost::asio::ip::udp::endpoint> endpoints() const;
+        /**
+         * @brief add a frame received from a participant to its jitter buffer
+         * 
+         * @return false if the participant is not in the conference or the frame was late
+         */
+        bool push(const std::string& name, uint16_t sequence, uint32_t timestamp, std::string_view data, const boost::posix_time::ptime& arrival);
+        /**
+         * @brief mix a frame period and send a frame to every participant that hears someone
+         * 
+         * @param capture the voice of the host
+         * @param speech false if the host is silent, its voice is not mixed
+         * @param playback receives what the host hears
+         * @param send used to send the frames
+         */
+        void mix(const int16_t* capture, bool speech, int16_t* playback, const Sender& send);
+        /**
+         * @brief mix a frame period of the participants only, nothing is sent
+         * 
+         * @param playback receives the mix
+         */
+        void play(int16_t* playback);
+    private:
+        struct Participant
+        {
+            boost::asio::ip::udp::endpoint endpoint;
+            JitterBuffer jitter_buffer;
+            OpusDecoder* decoder = nullptr;
+            OpusEncoder* encoder = nullptr;
+            std::vector<int16_t> decoded;
+            std::vector<int16_t> output;
+            std::string received;
+            std::vector<unsigned char> packet;
+            // decoded contains voice in this period
+            bool active = false;
+            uint16_t sequence = 0;
+            uint32_t timestamp = 0;
+            Participant(unsigned int frame_samples, unsigned int sample_rate);
+            ~Participant();
+        };
+        // run job(i) for every i below count on the pool and wait
+        void _parallel(size_t count, const std::function<void(size_t)>& job);
+        unsigned int frame_samples;
+        unsigned int sample_rate;
+        unsigned int threads;
+        std::unique_ptr<boost::asio::thread_pool> pool;
+        std::map<std::string,std::unique_ptr<Participant>> participants;
+        // the same participants, for the pool
+        std::vector<Participant*> order;
+        std::vector<int32_t> total;
+        std::vector<int16_t> silence;
+    };
+}
@@ -0,0 +1,88 @@
+#include "VoiceDetector.hpp"
+#include "../kernels/kernels.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+namespace network::audio
+{
+    VoiceDetector::VoiceDetector(unsigned int frame_samples, unsigned int sample_rate, uint16_t threshold):
+        sample_rate(sample_rate)
+    {
+        reset(frame_samples,threshold);
+    }
+    void VoiceDetector::reset(unsigned int frame_samples, uint16_t threshold)
+    {
+        this->threshold = threshold;
+        double frame_ms = 1000.0 * frame_samples / sample_rate;
+        hangover_frames = (unsigned int)std::ceil(HANGOVER_MS / frame_ms);
+        floor_rise = std::pow(2.0,frame_ms / FLOOR_DOUBLING_MS);
+        // until it's measured the floor is the threshold, a call can start in the middle of a word
+        noise_floor = threshold;
+        hangover = 0;
+        last_level = 0;
+        active = false;
+        started = false;
+    }
+    bool VoiceDetector::detect(const int16_t* samples, size_t count)
+    {
+        bool was_active = active;
+        double level = kernels::mean_abs(samples,count);
+        last_level = level;
+        if(threshold == 0 or count == 0)
+        {
+            active = true;
+            started = not was_active;
+            return true;
+        }
+        size_t zero_crossings = 0;
+        for(size_t i = 1; i < count; i++)
+            zero_crossings += (samples[i] < 0) != (samples[i-1] < 0);
+        double crossing_rate = double(zero_crossings) / count;
+
+        if(level < noise_floor)
+            noise_floor += (level - noise_floor) / 2;
+        else
+            noise_floor *= floor_rise;
+        // a floor of 0 (digital silence) would make any sound speech
+        double floor = std::max(noise_floor,1.0);
+
+        bool speech = level >= threshold and (level >= floor * SPEECH_MARGIN
+            or (level >= floor * FRICATIVE_MARGIN and crossing_rate >= FRICATIVE_ZERO_CROSSINGS));
+        if(speech)
+            hangover = hangover_frames;
+        else if(hangover > 0)
+            hangover--;
+        active = speech or hangover > 0;
+        started = active and not was_active;
+        return active;
+    }
+    bool VoiceDetector::onset() const
+    {
+        return started;
+    }
+    uint16_t VoiceDetector::noise_level() const
+    {
+        return (uint16_t)std::clamp(noise_floor,0.0,double(INT16_MAX));
+    }
+    uint16_t VoiceDetector::level() const
+    {
+        return (uint16_t)std::clamp(last_level,0.0,double(INT16_MAX));
+    }
+
+    void ComfortNoise::set_level(uint16_t level)
+    {
+        this->level = level;
+    }
+    void ComfortNoise::generate(int16_t* samples, size_t count)
+    {
+        // uniform noise between -2*level and 2*level has a mean absolute value of level
+        int32_t amplitude = std::min(2 * (int32_t)level,(int32_t)INT16_MAX);
+        for(size_t i = 0; i < count; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            samples[i] = (int16_t)(int32_t((state >> 16) % (2 * amplitude + 1)) - amplitude);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+namespace network::audio
+{
+    /**
+     * @brief decides which captured frames contain speech.
+     * A frame is speech when its level is over the threshold and well over the background noise, or a bit over it
+     * with many zero crossings (fricatives like "s" and "f" are quiet but noisy). The noise floor follows the quietest
+     * frames, and after the last speech frame a hangover keeps the detector active so the ends of words are not cut
+     * 
+     */
+    class VoiceDetector
+    {
+    public:
+        // level over the noise floor of a voiced frame
+        static constexpr double SPEECH_MARGIN = 3;
+        // level over the noise floor of a fricative
+        static constexpr double FRICATIVE_MARGIN = 1.5;
+        // fraction of consecutive samples with a different sign in a fricative
+        static constexpr double FRICATIVE_ZERO_CROSSINGS = 0.25;
+        // speech continues this long after the last speech frame
+        static constexpr unsigned int HANGOVER_MS = 300;
+        // the noise floor can double in this time if the background gets louder
+        static constexpr unsigned int FLOOR_DOUBLING_MS = 2000;
+        /**
+         * @brief create a detector
+         * 
+         * @param frame_samples samples in a frame
+         * @param sample_rate samples per second
+         * @param threshold minimum level (mean absolute sample) of speech, 0 makes every frame speech
+         */
+        VoiceDetector(unsigned int frame_samples, unsigned int sample_rate, uint16_t threshold);
+        /**
+         * @brief forget the noise floor, used when a new call starts
+         * 
+         * @param frame_samples samples in a frame of the new call
+         * @param threshold minimum level of speech, 0 makes every frame speech
+         */
+        void reset(unsigned int frame_samples, uint16_t threshold);
+        /**
+         * @brief classify the next frame
+         * 
+         * @return true if the frame is speech (or in the hangover) and must be sent
+         */
+        bool detect(const int16_t* samples, size_t count);
+        /**
+         * @brief the last frame detected started a talkspurt
+         * 
+         */
+        bool onset() const;
+        /**
+         * @brief level of the background noise, as mean absolute sample
+         * 
+         */
+        uint16_t noise_level() const;
+        /**
+         * @brief level of the last frame detected, as mean absolute sample
+         * 
+         */
+        uint16_t level() const;
+    private:
+        unsigned int sample_rate;
+        uint16_t threshold;
+        unsigned int hangover_frames = 0;
+        double floor_rise = 1;
+        double noise_floor = 0;
+        double last_level = 0;
+        unsigned int hangover = 0;
+        bool active = false;
+        bool started = false;
+    };
+    /**
+     * @brief white noise at the level of the background noise of the other peer, played during its silences
+     * so the call doesn't sound dead
+     * 
+     */
+    class ComfortNoise
+    {
+    public:
+        /**
+         * @brief set the level of the noise
+         * 
+         * @param level mean absolute sample, 0 is silence
+         */
+        void set_level(uint16_t level);
+        /**
+         * @brief fill a frame with noise
+         * 
+         */
+        void generate(int16_t* samples, size_t count);
+    private:
+        uint16_t level = 0;
+        // xorshift32 state, never 0
+        uint32_t state = 0x9e3779b9;
+    };
+}
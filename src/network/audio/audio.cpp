@@ -2,8 +2,12 @@
 #include "../../defines.hpp"
 #include "../../ansi_escape.hpp"
 #include <mutex>
+#include <atomic>
+#include <charconv>
+#include <optional>
+#include <algorithm>
 #include <string_view>
-#include <boost/thread/sync_bounded_queue.hpp>
+#include <boost/thread.hpp>
 #include <portaudio.h>
 #include <opus/opus.h>
 #include "../../terminal/terminal.hpp"
@@ -13,11 +17,21 @@
 #include "../MessageQueue/MessageQueue.hpp"
 #include "../udp/udp.hpp"
 #include "../../parsing/parsing.hpp"
-#include "../../base64/base64.h"
+#include "../udp/wire/wire.hpp"
+#include "JitterBuffer/JitterBuffer.hpp"
+#include "FrameRing/FrameRing.hpp"
+#include "VoiceDetector/VoiceDetector.hpp"
+#include "Mixer/Mixer.hpp"
+#include "Forwarder/Forwarder.hpp"
 namespace network::audio
 {
     std::vector<std::string> whitelist;
     network::MessageQueue audio_queue;
+    // late voice frames are useless, the newest ones are kept
+    constexpr network::udp::QueueOptions QUEUE_DEFAULTS = {64,network::OverflowPolicy::drop_oldest};
+    // call setup and teardown, rare but never dropped: a lost AUDIOSTART or AUDIOSTOP leaves a call pending or a participant in a conference
+    network::MessageQueue control_queue;
+    constexpr network::udp::QueueOptions CONTROL_QUEUE_DEFAULTS = {64,network::OverflowPolicy::block};
     std::mutex name_mutex;
     std::string pending_name;
     struct AudioBuddy
@@ -35,74 +49,118 @@ namespace network::audio
     OpusEncoder* encoder = nullptr;
     OpusDecoder* decoder = nullptr;
 
-    unsigned char* input_encoder_buffer = nullptr;
-    unsigned char* output_decoder_buffer = nullptr;
-
     uint16_t voice_threshold = 40;
 
     constexpr opus_int32 SAMPLE_RATE = 48000;
     
-    constexpr unsigned long FRAMES_PER_BUFFER = 120;
+    // 60ms, the longest Opus frame
+    constexpr unsigned long MAX_FRAME_SAMPLES = SAMPLE_RATE*60/1000;
+    // frame durations supported by Opus, in samples
+    constexpr unsigned long FRAME_SIZES[] = {SAMPLE_RATE/400,SAMPLE_RATE/200,SAMPLE_RATE/100,SAMPLE_RATE/50,SAMPLE_RATE/25,MAX_FRAME_SAMPLES};
+    constexpr opus_int32 MIN_BITRATE = 6000;
+    constexpr opus_int32 MAX_BITRATE = 510000;
     
     #define AUDIO_DATA_TYPE int16_t
     #define AUDIO_DATA_TYPE_PA paInt16
 
-    constexpr opus_int32 BUFFER_OPUS_SIZE = FRAMES_PER_BUFFER*sizeof(AUDIO_DATA_TYPE)/4;
-    unsigned long ENCODED_FRAMES_SIZE = b64e_size(BUFFER_OPUS_SIZE);
+    // during silence the level of the background noise is sent this often
+    constexpr unsigned int NOISE_UPDATE_MS = 400;
+
+    // decoded frames kept ready for the output callback, more frames add latency, less frames risk underruns
+    constexpr size_t PLAYBACK_FRAMES = 2;
+    // how often the audio_sender service moves frames between the rings and the network during a call
+    constexpr unsigned int PUMP_PERIOD_US = 1000;
 
-    struct DecodedBuffer
+    /**
+     * @brief a frame of raw samples, the only thing the audio callbacks touch
+     * 
+     */
+    struct PcmFrame
     {
-        uint8_t data[FRAMES_PER_BUFFER*sizeof(AUDIO_DATA_TYPE)];
+        // capture time of the first sample, in samples since the call started
+        uint32_t timestamp;
+        AUDIO_DATA_TYPE samples[MAX_FRAME_SAMPLES];
     };
+    /**
+     * @brief the codec settings both peers use during a call
+     * 
+     */
+    struct CallParameters
+    {
+        unsigned long frame_samples;
+        opus_int32 bitrate;
+        bool fec;
+    };
+    CodecOptions codec_options;
+    // settings of the current call, protected by name_mutex
+    CallParameters call_parameters;
     
-    unsigned char* b64_encoded_buffer_data = nullptr;
-
-    boost::sync_bounded_queue<std::string> input_buffer{256};
-    boost::sync_bounded_queue<std::string> output_buffer{256};
+    // filled by the input callback, encoded and sent by audio_sender
+    FrameRing<PcmFrame,32> capture_ring;
+    // decoded by audio_sender, played by the output callback
+    FrameRing<PcmFrame,4> playback_ring;
+    JitterBuffer jitter_buffer{MAX_FRAME_SAMPLES,SAMPLE_RATE};
+    VoiceDetector voice_detector{MAX_FRAME_SAMPLES,SAMPLE_RATE,40};
+    // played when the other peer is silent, protected by name_mutex
+    ComfortNoise comfort_noise;
+    // samples captured since the call started, frames that are not sent are counted too
+    uint32_t captured_samples = 0;
+    uint16_t sent_sequence = 0;
+    // frames not sent since the last noise update
+    unsigned int silent_frames = 0;
+    // the conference hosted by this peer, protected by name_mutex
+    std::unique_ptr<Mixer> mixer;
+    // receives the mix of the host when the playback ring is full
+    PcmFrame discarded_playback;
+    // the conference forwarded by this peer, protected by name_mutex
+    std::unique_ptr<Forwarder> forwarder;
+    // the speakers forwarded to this peer when the other peer of the call is a forwarder, protected by name_mutex
+    std::unique_ptr<Mixer> forwarded_speakers;
+    // the streams are running, protected by name_mutex
+    bool streaming = false;
+    boost::condition_variable_any streaming_changed;
     
-    unsigned long long input_dropped_frames = 0;
-    unsigned long long output_dropped_frames = 0;
-
-    int16_t volume(const int16_t* input, unsigned long frameCount)
-    {
-        size_t ret = 0;
-        for(auto v = input; v < input+frameCount; v++)
-        {
-            ret += std::abs(*v);
-        }
-        ret /= frameCount;
-        return (int16_t)ret;
-    }
+    std::atomic<unsigned long long> input_dropped_frames = 0;
+    std::atomic<unsigned long long> output_dropped_frames = 0;
+    std::atomic<unsigned long long> input_xruns = 0;
+    std::atomic<unsigned long long> output_xruns = 0;
 
+    // runs on the real time thread of PortAudio: no allocations, no locks, no codec
     int input_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData)
     {
-        if(input_buffer.full()) // dropping frames
+        if(statusFlags & (paInputOverflow | paInputUnderflow))
+            input_xruns.fetch_add(1,std::memory_order_relaxed);
+        auto timestamp = captured_samples;
+        captured_samples += (uint32_t)frameCount;
+        auto frame = capture_ring.write_slot();
+        if(frame == nullptr) // dropping frames
         {
-            input_dropped_frames++;
+            input_dropped_frames.fetch_add(1,std::memory_order_relaxed);
             return 0;
         }
-        if(volume((const int16_t*)input,frameCount) < voice_threshold)
-            return 0;
-        auto encoded_size = opus_encode(encoder,(opus_int16*)input,frameCount,input_encoder_buffer,BUFFER_OPUS_SIZE);
-        if(encoded_size < 0)
-            return 0;
-        b64_encode(input_encoder_buffer,encoded_size,b64_encoded_buffer_data);
-        input_buffer.push(std::string((char*)b64_encoded_buffer_data));
+        frame->timestamp = timestamp;
+        auto samples = std::min(frameCount,call_parameters.frame_samples);
+        memcpy(frame->samples,input,samples*sizeof(AUDIO_DATA_TYPE));
+        memset(frame->samples+samples,0,(call_parameters.frame_samples-samples)*sizeof(AUDIO_DATA_TYPE));
+        capture_ring.commit_write();
         return 0;
     }
+    // runs on the real time thread of PortAudio: no allocations, no locks, no codec
     int output_callback(const void *input, void *output, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData)
-    {//we assume that data is already binary
-        static std::string encoded;
-        if(not output_buffer.try_pull(encoded))
-        {
+    {
+        if(statusFlags & (paOutputUnderflow | paOutputOverflow))
+            output_xruns.fetch_add(1,std::memory_order_relaxed);
+        auto frame = playback_ring.read_slot();
+        if(frame == nullptr)
+        {// audio_sender did not decode in time
+            output_xruns.fetch_add(1,std::memory_order_relaxed);
             memset(output,0,frameCount*sizeof(AUDIO_DATA_TYPE));
             return 0;
         }
-        auto decoded_size = b64d_size((unsigned int)encoded.length());
-        b64_decode((unsigned char*)encoded.c_str(),(unsigned int)encoded.length(),output_decoder_buffer);
-        auto opus_decoded_size = opus_decode(decoder,output_decoder_buffer,decoded_size,(opus_int16*)output,frameCount,0);
-        if(opus_decoded_size < 0)
-            return 0;
+        auto samples = std::min(frameCount,call_parameters.frame_samples);
+        memcpy(output,frame->samples,samples*sizeof(AUDIO_DATA_TYPE));
+        memset((AUDIO_DATA_TYPE*)output+samples,0,(frameCount-samples)*sizeof(AUDIO_DATA_TYPE));
+        playback_ring.commit_read();
         return 0;
     }
 
@@ -112,7 +170,52 @@ namespace network::audio
         std::string why;
         AudioError(const std::string& why):why(why){};
     };
-    void comms_init()
+    /**
+     * @brief the settings this peer would like to use
+     * 
+     */
+    CallParameters local_parameters()
+    {
+        return {(unsigned long)(codec_options.frame_duration_ms * SAMPLE_RATE / 1000),codec_options.bitrate,codec_options.fec};
+    }
+    /**
+     * @brief the settings of the call, both peers get the same result
+     * 
+     */
+    CallParameters negotiate(const CallParameters& local, const CallParameters& remote)
+    {// the most constrained peer decides
+        return {std::max(local.frame_samples,remote.frame_samples),std::min(local.bitrate,remote.bitrate),local.fec and remote.fec};
+    }
+    /**
+     * @brief compose the fields of AUDIOSTART or AUDIOACCEPT
+     * 
+     */
+    std::vector<std::string> compose_parameters(const std::string& keyword, const CallParameters& parameters)
+    {
+        return {keyword,std::to_string(parameters.frame_samples * 1000000 / SAMPLE_RATE),std::to_string(parameters.bitrate),parameters.fec?"1":"0"};
+    }
+    /**
+     * @brief parse the settings of AUDIOSTART or AUDIOACCEPT
+     * 
+     * @return the settings or nothing if they are missing or not valid
+     */
+    std::optional<CallParameters> parse_parameters(const parsing::Tokens& args)
+    {
+        if(args.size() != 4)
+            return {};
+        unsigned long frame_us;
+        opus_int32 bitrate;
+        if(std::from_chars(args[1].data(),args[1].data()+args[1].length(),frame_us).ec != std::errc{}
+            or std::from_chars(args[2].data(),args[2].data()+args[2].length(),bitrate).ec != std::errc{})
+            return {};
+        CallParameters parameters = {frame_us * SAMPLE_RATE / 1000000,bitrate,args[3] == "1"};
+        if(std::find(std::begin(FRAME_SIZES),std::end(FRAME_SIZES),parameters.frame_samples) == std::end(FRAME_SIZES)
+            or frame_us != parameters.frame_samples * 1000000 / SAMPLE_RATE
+            or bitrate < MIN_BITRATE or bitrate > MAX_BITRATE)
+            return {};
+        return parameters;
+    }
+    void comms_init(const CallParameters& parameters)
     {
         try
         {
@@ -125,6 +228,7 @@ namespace network::audio
             input_stream_params.sampleFormat = AUDIO_DATA_TYPE_PA;
             if(input_stream_params.device == paNoDevice)
                 throw AudioError("Pa_GetDefaultInputDevice");
+            call_parameters = parameters;
             auto input_device = Pa_GetDeviceInfo(input_stream_params.device);
             input_stream_params.suggestedLatency = input_device->defaultLowInputLatency;
             PaStreamParameters output_stream_params;
@@ -136,10 +240,6 @@ namespace network::audio
                 throw AudioError("Pa_GetDefaultOutputDevice");
             auto output_device = Pa_GetDeviceInfo(output_stream_params.device);
             output_stream_params.suggestedLatency = output_device->defaultLowOutputLatency;
-            
-            input_encoder_buffer = new unsigned char[BUFFER_OPUS_SIZE];
-            output_decoder_buffer = new unsigned char[BUFFER_OPUS_SIZE];
-            b64_encoded_buffer_data = new unsigned char[ENCODED_FRAMES_SIZE + 1];
 
             int error = 0;
             encoder = opus_encoder_create(SAMPLE_RATE,1,OPUS_APPLICATION_VOIP,&error);
@@ -149,19 +249,34 @@ namespace network::audio
             if(error != OPUS_OK)
                 throw AudioError("opus_decoder_create");
 
-            opus_encoder_ctl(encoder,OPUS_SET_BITRATE(OPUS_BITRATE_MAX));
-            opus_decoder_ctl(decoder,OPUS_SET_BITRATE(OPUS_BITRATE_MAX));
+            opus_encoder_ctl(encoder,OPUS_SET_BITRATE(parameters.bitrate));
+            opus_encoder_ctl(encoder,OPUS_SET_COMPLEXITY(codec_options.complexity));
+            opus_encoder_ctl(encoder,OPUS_SET_DTX(codec_options.dtx?1:0));
+            opus_encoder_ctl(encoder,OPUS_SET_INBAND_FEC(parameters.fec?1:0));
+            opus_encoder_ctl(encoder,OPUS_SET_PACKET_LOSS_PERC(parameters.fec?EXPECTED_LOSS_PERCENT:0));
+            logging::log("DBG","Voice call codec: " HIGHLIGHT + std::to_string(parameters.frame_samples * 1000.0 / SAMPLE_RATE) + "ms" RESET " frames, " HIGHLIGHT + std::to_string(parameters.bitrate) + "bit/s" RESET ", FEC " HIGHLIGHT + (parameters.fec?"on":"off") + RESET);
+
+            jitter_buffer.reset(parameters.frame_samples);
+            voice_detector.reset(parameters.frame_samples,voice_threshold);
+            comfort_noise.set_level(0);
+            silent_frames = 0;
+            capture_ring.clear();
+            playback_ring.clear();
+            captured_samples = 0;
+            sent_sequence = 0;
 
-            if(Pa_OpenStream(&input_stream,&input_stream_params,nullptr,double(SAMPLE_RATE),FRAMES_PER_BUFFER,paNoFlag,input_callback,nullptr) != paNoError)
+            if(Pa_OpenStream(&input_stream,&input_stream_params,nullptr,double(SAMPLE_RATE),parameters.frame_samples,paNoFlag,input_callback,nullptr) != paNoError)
                 throw AudioError("Pa_OpenStream");
-            if(Pa_OpenStream(&output_stream,nullptr,&output_stream_params,double(SAMPLE_RATE),FRAMES_PER_BUFFER,paNoFlag,output_callback,nullptr) != paNoError)
+            if(Pa_OpenStream(&output_stream,nullptr,&output_stream_params,double(SAMPLE_RATE),parameters.frame_samples,paNoFlag,output_callback,nullptr) != paNoError)
                 throw AudioError("Pa_OpenStream");
 
             if(Pa_StartStream(input_stream) != paNoError)
                 throw AudioError("Pa_StartStream");
             if(Pa_StartStream(output_stream) != paNoError)
                 throw AudioError("Pa_StartStream");
-            
+
+            streaming = true;
+            streaming_changed.notify_all();
         }catch(AudioError& e)
         {
             if(e.why != "Pa_Initialize") 
@@ -184,27 +299,12 @@ namespace network::audio
             input_stream = nullptr;
             output_stream = nullptr;
 
-            if(input_encoder_buffer != nullptr)
-            {
-                delete [] input_encoder_buffer;
-                input_encoder_buffer = nullptr;
-            }
-            if(output_decoder_buffer != nullptr)
-            {
-                delete [] output_decoder_buffer;
-                output_decoder_buffer = nullptr;
-            }
-            if(b64_encoded_buffer_data != nullptr)
-            {
-                delete [] b64_encoded_buffer_data;
-                b64_encoded_buffer_data = nullptr;
-            }
-
             logging::audio_call_error_log(e.why);
         }
     }
     void comms_stop()
     {
+        streaming = false;
         Pa_StopStream(input_stream);
         Pa_StopStream(output_stream);
 
@@ -215,52 +315,170 @@ namespace network::audio
         
         opus_encoder_destroy(encoder);
         opus_decoder_destroy(decoder);
+        encoder = nullptr;
+        decoder = nullptr;
+        forwarded_speakers.reset();
 
         audio_buddy.name = "";
         pending_name = "";
         input_stream = nullptr;
         output_stream = nullptr;
-
-        if(input_encoder_buffer != nullptr)
+    }
+    void _stop_call()
+    {
+        if(mixer != nullptr)
+        {
+            for(auto& endpoint: mixer->endpoints())
+                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),endpoint);
+            logging::log("MSG","Voice conference ended");
+            comms_stop();
+            mixer.reset();
+        }
+        else if(forwarder != nullptr)
         {
-            delete [] input_encoder_buffer;
-            input_encoder_buffer = nullptr;
+            for(auto& endpoint: forwarder->endpoints())
+                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),endpoint);
+            logging::log("MSG","Voice forwarding ended");
+            forwarder.reset();
         }
-        if(output_decoder_buffer != nullptr)
+        else if(audio_buddy.name.length() != 0)
         {
-            delete [] output_decoder_buffer;
-            output_decoder_buffer = nullptr;
+            network::udp::send(parsing::compose_message({"AUDIOSTOP"}),audio_buddy.endpoint);\
+            logging::log("MSG","Voice call with " HIGHLIGHT + audio_buddy.name + RESET " ended");
+            comms_stop();
         }
-        if(b64_encoded_buffer_data != nullptr)
+    }
+    /**
+     * @brief mix a frame period of the conference for every captured frame, the microphone of the host is the clock of the conference
+     * 
+     */
+    void mix_captured()
+    {
+        for(auto frame = capture_ring.read_slot(); frame != nullptr; frame = capture_ring.read_slot())
         {
-            delete [] b64_encoded_buffer_data;
-            b64_encoded_buffer_data = nullptr;
+            auto disconnected = mixer->remove_if([](const std::string& name){ return not network::udp::connection_map.check_user(name); });
+            for(auto& name: disconnected)
+                logging::log("MSG",HIGHLIGHT + name + RESET " left the voice conference");
+            bool speech = voice_detector.detect(frame->samples,call_parameters.frame_samples);
+            auto output = playback_ring.write_slot();
+            mixer->mix(frame->samples,speech,output != nullptr ? output->samples : discarded_playback.samples,
+                [](const boost::asio::ip::udp::endpoint& endpoint, const std::vector<std::string>& fields){
+                    network::udp::send(fields,endpoint);
+                });
+            capture_ring.commit_read();
+            if(output != nullptr)
+                playback_ring.commit_write();
         }
     }
-    void _stop_call()
+    /**
+     * @brief an encoded frame, kept until the next one in case it starts a talkspurt
+     * 
+     */
+    struct EncodedPacket
+    {
+        uint32_t timestamp;
+        // voice level, used by forwarders to choose the speakers
+        uint16_t level;
+        opus_int32 size = -1;
+        unsigned char data[MAX_PACKET_SIZE];
+    };
+    void send_packet(const EncodedPacket& packet)
     {
-        if(audio_buddy.name.length() != 0)
+        if(packet.size > DTX_PACKET_SIZE)
+            network::udp::send({"AUDIO",std::to_string(sent_sequence++),std::to_string(packet.timestamp),std::string((char*)packet.data,packet.size),std::to_string(packet.level)},audio_buddy.endpoint);
+    }
+    /**
+     * @brief encode and send the captured frames, returns false if the call ended.
+     * Every frame is encoded so the encoder never loses its state, but only speech is sent,
+     * with the frame before it so the start of the first word is not cut
+     * 
+     */
+    bool send_captured(EncodedPacket*& current, EncodedPacket*& previous)
+    {
+        if(mixer != nullptr)
         {
-            network::udp::send(parsing::compose_message({"AUDIOSTOP"}),audio_buddy.endpoint);\
-            logging::log("MSG","Voice call with " HIGHLIGHT + audio_buddy.name + RESET " ended");
-            comms_stop();
+            mix_captured();
+            return true;
+        }
+        for(auto frame = capture_ring.read_slot(); frame != nullptr; frame = capture_ring.read_slot())
+        {
+            if(not network::udp::connection_map.check_user(audio_buddy.name))
+            {// the other user was disconnected somehow
+                _stop_call();
+                return false;
+            }
+            std::swap(current,previous);
+            current->timestamp = frame->timestamp;
+            current->size = opus_encode(encoder,frame->samples,call_parameters.frame_samples,current->data,MAX_PACKET_SIZE);
+            bool speech = voice_detector.detect(frame->samples,call_parameters.frame_samples);
+            current->level = voice_detector.level();
+            capture_ring.commit_read();
+            if(speech)
+            {
+                if(voice_detector.onset() and (int32_t)(current->timestamp - previous->timestamp) == (int32_t)call_parameters.frame_samples)
+                    send_packet(*previous);
+                send_packet(*current);
+                silent_frames = 0;
+            }else
+            {// the other peer plays comfort noise at this level
+                if(silent_frames == 0)
+                    network::udp::send({"AUDIONOISE",std::to_string(voice_detector.noise_level())},audio_buddy.endpoint);
+                silent_frames = (silent_frames + 1) % std::max<unsigned int>(NOISE_UPDATE_MS * SAMPLE_RATE / 1000 / call_parameters.frame_samples,1);
+            }
+        }
+        return true;
+    }
+    /**
+     * @brief decode frames from the jitter buffer until the output callback has PLAYBACK_FRAMES ready
+     * 
+     */
+    void fill_playback(std::string& encoded)
+    {
+        while(playback_ring.size() < PLAYBACK_FRAMES)
+        {
+            auto frame = playback_ring.write_slot();
+            if(forwarded_speakers != nullptr)
+            {// every speaker has its own jitter buffer and decoder
+                forwarded_speakers->play(frame->samples);
+                playback_ring.commit_write();
+                continue;
+            }
+            int decoded_size = -1;
+            switch(jitter_buffer.pop(encoded))
+            {
+            case JitterBuffer::Action::play:
+                decoded_size = opus_decode(decoder,(const unsigned char*)encoded.data(),(opus_int32)encoded.length(),frame->samples,call_parameters.frame_samples,0);
+                break;
+            case JitterBuffer::Action::conceal:
+                if(encoded.empty()) // packet loss concealment
+                    decoded_size = opus_decode(decoder,nullptr,0,frame->samples,call_parameters.frame_samples,0);
+                else // the lost frame is rebuilt from the FEC data inside the next one
+                    decoded_size = opus_decode(decoder,(const unsigned char*)encoded.data(),(opus_int32)encoded.length(),frame->samples,call_parameters.frame_samples,1);
+                break;
+            case JitterBuffer::Action::silence:
+                comfort_noise.generate(frame->samples,call_parameters.frame_samples);
+                decoded_size = (int)call_parameters.frame_samples;
+                break;
+            }
+            if(decoded_size < 0)
+                memset(frame->samples,0,sizeof(frame->samples));
+            playback_ring.commit_write();
         }
     }
     void audio_sender() {
+        EncodedPacket packets[2];
+        EncodedPacket* current = &packets[0];
+        EncodedPacket* previous = &packets[1];
+        std::string received_frame;
         while(true)
         {
-            auto encoded = input_buffer.pull();
-            std::unique_lock lock(name_mutex);
-            if(network::udp::connection_map.check_user(audio_buddy.name))
             {
-                if(audio_buddy.name.length() > 0)
-                {//we are connected
-                    network::udp::send(parsing::compose_message({"AUDIO",encoded}),audio_buddy.endpoint);
-                }
-            }else
-            {// the other user was disconnected somehow
-                _stop_call();
+                std::unique_lock lock(name_mutex);
+                streaming_changed.wait(lock,[](){ return streaming; });
+                if(send_captured(current,previous) and mixer == nullptr)
+                    fill_playback(received_frame);
             }
+            boost::this_thread::sleep_for(boost::chrono::microseconds(PUMP_PERIOD_US));
         }
     }
     bool check_whitelist(const std::string& name)
@@ -272,74 +490,215 @@ namespace network::audio
         }
         return false;
     }
-    void accept_connection(const boost::asio::ip::udp::endpoint& endpoint, const std::string& name)
+    /**
+     * @brief check if a call request can be accepted now: no call, or a conference with some space, requires name_mutex
+     * 
+     */
+    bool can_accept(const std::string& name)
+    {
+        return audio_buddy.name.length() == 0 and (mixer == nullptr or (mixer->size() < Mixer::MAX_PARTICIPANTS and not mixer->contains(name)))
+            and (forwarder == nullptr or (forwarder->size() < Forwarder::MAX_PARTICIPANTS and not forwarder->contains(name)));
+    }
+    /**
+     * @brief the parameters of the answer to a call request, requires name_mutex
+     * 
+     * @param requested the parameters of the request, ours are used if the request has none
+     */
+    CallParameters answer_parameters(const std::optional<CallParameters>& requested)
     {
-        network::udp::send(parsing::compose_message({"AUDIOACCEPT"}),endpoint);
+        auto parameters = negotiate(local_parameters(),requested.value_or(local_parameters()));
+        if(mixer != nullptr) // every stream of the conference is mixed with the same frame size
+            parameters.frame_samples = call_parameters.frame_samples;
+        if(forwarder != nullptr) // every participant mixes the speakers with the same frame size
+            parameters.frame_samples = local_parameters().frame_samples;
+        return parameters;
+    }
+    void accept_connection(const boost::asio::ip::udp::endpoint& endpoint, const std::string& name, const CallParameters& parameters)
+    {
+        if(forwarder != nullptr)
+        {
+            if(not forwarder->add(name,endpoint))
+            {
+                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),endpoint);
+                logging::log("ERR",HIGHLIGHT + name + RESET " could not join the forwarded voice conference");
+                return;
+            }
+            network::udp::send(compose_parameters("AUDIOACCEPT",parameters),endpoint);
+            logging::log("MSG",HIGHLIGHT + name + RESET " joined the forwarded voice conference");
+            return;
+        }
+        if(mixer != nullptr)
+        {
+            if(not mixer->add(name,endpoint,{parameters.bitrate,codec_options.complexity,codec_options.dtx,parameters.fec}))
+            {
+                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),endpoint);
+                logging::log("ERR",HIGHLIGHT + name + RESET " could not join the voice conference");
+                return;
+            }
+            network::udp::send(compose_parameters("AUDIOACCEPT",parameters),endpoint);
+            logging::log("MSG",HIGHLIGHT + name + RESET " joined the voice conference");
+            return;
+        }
+        network::udp::send(compose_parameters("AUDIOACCEPT",parameters),endpoint);
         audio_buddy = {name,endpoint};
         logging::log("MSG","Voice call accepted from " HIGHLIGHT + name + RESET);
-        comms_init();
+        comms_init(parameters);
     }
-    void audio()
+    // the voice frames and the control messages come from different queues, both are handled here under name_mutex
+    void handle_message(const MessageQueueItem& item, parsing::Tokens& args, std::vector<boost::asio::ip::udp::endpoint>& forward_targets)
     {
-        while(true)
+        network::udp::wire::tokenize(item.msg,args);
+        std::unique_lock lock(name_mutex);
+        if((args.size() == 1 or args.size() == 4) and args[0] == "AUDIOSTART")
         {
-            auto item = audio_queue.pull();
-            auto args = parsing::msg_split(item.msg);
-            std::unique_lock lock(name_mutex);
-            if(args.size() == 1 and args[0] == "AUDIOSTART")
-            {
-                if(audio_buddy.name.length() == 0)
-                {//no user connected for voice
-                    if(check_whitelist(item.src) or default_action == ConnectionAction::ACCEPT)
-                    {
-                        accept_connection(item.src_endpoint,item.src);
-                    }else if(default_action == ConnectionAction::REFUSE)
-                    {
-                        logging::log("MSG","Voice call refused automatically from \"" HIGHLIGHT +item.src+ RESET "\"");
-                        network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
-                    }else
-                    {
-                        terminal::input("User \"" HIGHLIGHT+item.src+RESET "\" requested to start a voice call, accept? (y/n)",
-                        [item](const std::string& input){
-                            if(input == "Y" or input == "y")
-                            {
-                                accept_connection(item.src_endpoint,item.src);
-                            }else
-                            {
-                                logging::log("MSG","Voice call refused from \"" HIGHLIGHT +item.src+ RESET "\"");
-                                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
-                            }
-                        });
-                    }
-                }else
-                {//user already connected for voice
+            if(can_accept(item.src))
+            {//no user connected for voice, or a conference with some space
+                // a request without valid settings is answered with ours
+                auto requested = parse_parameters(args);
+                if(check_whitelist(item.src) or default_action == ConnectionAction::ACCEPT)
+                {
+                    accept_connection(item.src_endpoint,item.src,answer_parameters(requested));
+                }else if(default_action == ConnectionAction::REFUSE)
+                {
+                    logging::log("MSG","Voice call refused automatically from \"" HIGHLIGHT +item.src+ RESET "\"");
                     network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
+                }else
+                {
+                    terminal::input("User \"" HIGHLIGHT+item.src+RESET "\" requested to start a voice call, accept? (y/n)",
+                    [item,requested](const std::string& input){
+                        // the answer comes from the terminal thread, the call or the conference could have changed in the meantime
+                        std::unique_lock lock(name_mutex);
+                        if(not can_accept(item.src))
+                        {
+                            logging::log("ERR","The voice call from \"" HIGHLIGHT +item.src+ RESET "\" can't be accepted anymore");
+                            network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
+                        }else if(input == "Y" or input == "y")
+                        {
+                            accept_connection(item.src_endpoint,item.src,answer_parameters(requested));
+                        }else
+                        {
+                            logging::log("MSG","Voice call refused from \"" HIGHLIGHT +item.src+ RESET "\"");
+                            network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
+                        }
+                    });
                 }
-                logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
-            }else if(args.size() == 1 and args[0] == "AUDIOACCEPT" and pending_name == item.src and audio_buddy.name.length()==0)
-            {
-                audio_buddy = {item.src,item.src_endpoint};
-                pending_name = "";
-                comms_init();
-                logging::log("MSG","Voice call accepted from " HIGHLIGHT + item.src + RESET);
-            }else if(args.size() == 1 and args[0] == "AUDIOSTOP" and (audio_buddy.name == item.src or pending_name == item.src))
-            {
-                if(audio_buddy.name.length()!=0)
-                    logging::log("MSG","Voice call with " HIGHLIGHT +audio_buddy.name+ RESET " was stopped from the other peer");
-                else
-                    logging::log("MSG","Voice call refused from " HIGHLIGHT +pending_name+ RESET);
-                comms_stop();
-                logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
-            }else if(args.size() == 2 and args[0] == "AUDIO" and audio_buddy.name == item.src)
+            }else
+            {//user already connected for voice
+                network::udp::send(parsing::compose_message({"AUDIOSTOP"}),item.src_endpoint);
+            }
+            logging::log("DBG","Handled " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src + RESET);
+        }else if((args.size() == 1 or args.size() == 4) and args[0] == "AUDIOACCEPT" and pending_name == item.src and audio_buddy.name.length()==0)
+        {
+            audio_buddy = {item.src,item.src_endpoint};
+            pending_name = "";
+            comms_init(parse_parameters(args).value_or(local_parameters()));
+            logging::log("MSG","Voice call accepted from " HIGHLIGHT + item.src + RESET);
+        }else if(args.size() == 1 and args[0] == "AUDIOSTOP" and mixer != nullptr and mixer->contains(item.src))
+        {
+            mixer->remove(item.src);
+            logging::log("MSG",HIGHLIGHT + item.src + RESET " left the voice conference");
+        }else if(args.size() == 1 and args[0] == "AUDIOSTOP" and forwarder != nullptr and forwarder->contains(item.src))
+        {
+            forwarder->remove(item.src);
+            logging::log("MSG",HIGHLIGHT + item.src + RESET " left the forwarded voice conference");
+        }else if((args.size() == 4 or args.size() == 5) and args[0] == "AUDIO" and forwarder != nullptr and forwarder->contains(item.src))
+        {// forwarded without decoding, only if the sender is one of the loudest speakers
+            uint16_t level = 0;
+            if(args.size() == 5)
+                std::from_chars(args[4].data(),args[4].data()+args[4].length(),level);
+            auto disconnected = forwarder->remove_if([](const std::string& name){ return not network::udp::connection_map.check_user(name); });
+            for(auto& name: disconnected)
+                logging::log("MSG",HIGHLIGHT + name + RESET " left the forwarded voice conference");
+            uint16_t sequence;
+            forwarder->route(item.src,level,boost::posix_time::microsec_clock::local_time(),forward_targets,sequence);
+            if(not forward_targets.empty())
             {
-                if(not output_buffer.try_push(args[1]))
-                    output_dropped_frames++;
+                std::vector<std::string> fields = {"AUDIOFWD",item.src,std::to_string(sequence),std::string(args[2]),std::string(args[3])};
+                for(auto& endpoint: forward_targets)
+                    network::udp::send(fields,endpoint);
             }
+        }else if(args.size() == 5 and args[0] == "AUDIOFWD" and audio_buddy.name == item.src)
+        {
+            uint16_t sequence;
+            uint32_t timestamp;
+            if(std::from_chars(args[2].data(),args[2].data()+args[2].length(),sequence).ec != std::errc{}
+                or std::from_chars(args[3].data(),args[3].data()+args[3].length(),timestamp).ec != std::errc{})
+                return;
+            if(forwarded_speakers == nullptr)
+                forwarded_speakers = std::make_unique<Mixer>(call_parameters.frame_samples,SAMPLE_RATE,0);
+            std::string speaker(args[1]);
+            if(not forwarded_speakers->contains(speaker))
+                forwarded_speakers->add(speaker);
+            if(not forwarded_speakers->push(speaker,sequence,timestamp,args[4],boost::posix_time::microsec_clock::local_time()))
+                output_dropped_frames.fetch_add(1,std::memory_order_relaxed);
+        }else if(args.size() == 1 and args[0] == "AUDIOSTOP" and (audio_buddy.name == item.src or pending_name == item.src))
+        {
+            if(audio_buddy.name.length()!=0)
+                logging::log("MSG","Voice call with " HIGHLIGHT +audio_buddy.name+ RESET " was stopped from the other peer");
+            else
+                logging::log("MSG","Voice call refused from " HIGHLIGHT +pending_name+ RESET);
+            comms_stop();
+            logging::log("DBG","Handled " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src + RESET);
+        }else if((args.size() == 4 or args.size() == 5) and args[0] == "AUDIO" and (audio_buddy.name == item.src or (mixer != nullptr and mixer->contains(item.src))))
+        {
+            uint16_t sequence;
+            uint32_t timestamp;
+            if(std::from_chars(args[1].data(),args[1].data()+args[1].length(),sequence).ec != std::errc{}
+                or std::from_chars(args[2].data(),args[2].data()+args[2].length(),timestamp).ec != std::errc{})
+                return;
+            auto arrival = boost::posix_time::microsec_clock::local_time();
+            if(not (mixer != nullptr ? mixer->push(item.src,sequence,timestamp,args[3],arrival) : jitter_buffer.push(sequence,timestamp,args[3],arrival)))
+                output_dropped_frames.fetch_add(1,std::memory_order_relaxed);
+        }else if(args.size() == 2 and args[0] == "AUDIONOISE" and audio_buddy.name == item.src)
+        {
+            uint16_t level;
+            if(std::from_chars(args[1].data(),args[1].data()+args[1].length(),level).ec == std::errc{})
+                comfort_noise.set_level(level);
+        }
+    }
+    void audio()
+    {
+        parsing::Tokens args;
+        MessageQueueItem item;
+        std::vector<boost::asio::ip::udp::endpoint> forward_targets;
+        while(true)
+        {
+            audio_queue.pull(item);
+            handle_message(item,args,forward_targets);
         }
     }
-    void init(const std::vector<std::string>& whitelist, const std::string& default_action, int16_t voice_volume_threshold)
+    void audio_control()
+    {
+        parsing::Tokens args;
+        MessageQueueItem item;
+        std::vector<boost::asio::ip::udp::endpoint> forward_targets;
+        while(true)
+        {
+            control_queue.pull(item);
+            handle_message(item,args,forward_targets);
+        }
+    }
+    void init(const std::vector<std::string>& whitelist, const std::string& default_action, int16_t voice_volume_threshold, const CodecOptions& codec_options)
     {
         voice_threshold = voice_volume_threshold;
+        audio::codec_options = codec_options;
+        const CodecOptions defaults;
+        auto frame_samples = codec_options.frame_duration_ms * SAMPLE_RATE / 1000;
+        if(std::find(std::begin(FRAME_SIZES),std::end(FRAME_SIZES),frame_samples) == std::end(FRAME_SIZES))
+        {
+            audio::codec_options.frame_duration_ms = defaults.frame_duration_ms;
+            logging::log("ERR","Error in configuration file at network.audio.frame_duration: this must be one of 2.5, 5, 10, 20, 40 or 60, " + std::to_string((int)defaults.frame_duration_ms) + " was selected as default");
+        }
+        if(codec_options.bitrate < MIN_BITRATE or codec_options.bitrate > MAX_BITRATE)
+        {
+            audio::codec_options.bitrate = defaults.bitrate;
+            logging::log("ERR","Error in configuration file at network.audio.bitrate: this must be between " + std::to_string(MIN_BITRATE) + " and " + std::to_string(MAX_BITRATE) + ", " + std::to_string(defaults.bitrate) + " was selected as default");
+        }
+        if(codec_options.complexity < 0 or codec_options.complexity > 10)
+        {
+            audio::codec_options.complexity = defaults.complexity;
+            logging::log("ERR","Error in configuration file at network.audio.complexity: this must be between 0 and 10, " + std::to_string(defaults.complexity) + " was selected as default");
+        }
         audio::whitelist = whitelist;
         if(default_action == "accept")
         {
@@ -357,26 +716,35 @@ namespace network::audio
             logging::log("ERR","Error in configuration file at network.connection.default_action: this must be one of \"accept\", \"refuse\" or \"prompt\", \"prompt\" was selected as default");
         }
 
-        network::udp::register_queue("AUDIOSTART",audio_queue,true);
-        network::udp::register_queue("AUDIOACCEPT",audio_queue,true);
-        network::udp::register_queue("AUDIOSTOP",audio_queue,true);
+        network::udp::setup_queue("audio",audio_queue,QUEUE_DEFAULTS);
         network::udp::register_queue("AUDIO",audio_queue,true);
+        network::udp::register_queue("AUDIOFWD",audio_queue,true);
+        network::udp::setup_queue("audio_control",control_queue,CONTROL_QUEUE_DEFAULTS);
+        network::udp::register_queue("AUDIOSTART",control_queue,true);
+        network::udp::register_queue("AUDIOACCEPT",control_queue,true);
+        network::udp::register_queue("AUDIOSTOP",control_queue,true);
+        network::udp::register_queue("AUDIONOISE",control_queue,true);
 
         multithreading::add_service("audio",audio);
+        multithreading::add_service("audio_control",audio_control);
         multithreading::add_service("audio_sender",audio_sender);
     }
     bool start_call(const std::string& name)
     {
         std::unique_lock lock(name_mutex);
+        if(mixer != nullptr or forwarder != nullptr)
+        {
+            logging::log("ERR","You are hosting a voice conference, the other peers must call you");
+            return false;
+        }
         if(audio_buddy.name.length() == 0)
         {
             if(DEBUG and name == "loopback")
             {   try
                 {
-                    std::unique_lock lock(udp::connection_map.obj);
-                    audio_buddy = {"loopback",udp::connection_map["loopback"].endpoint};
+                    audio_buddy = {"loopback",udp::connection_map["loopback"]->endpoint};
                     logging::log("MSG","Voice call accepted from " HIGHLIGHT "loopback" RESET);
-                    comms_init();
+                    comms_init(local_parameters());
                     return true;
                 }catch(network::DataMap::NotFound&)
                 {
@@ -389,12 +757,9 @@ namespace network::audio
                 try
                 {
                     boost::asio::ip::udp::endpoint endpoint;
-                    {
-                        std::unique_lock lock(udp::connection_map.obj);
-                        endpoint = udp::connection_map[name].endpoint;
-                    }
+                    endpoint = udp::connection_map[name]->endpoint;
                     pending_name = name;
-                    network::udp::send(parsing::compose_message({"AUDIOSTART"}),endpoint);
+                    network::udp::send(compose_parameters("AUDIOSTART",local_parameters()),endpoint);
                     return true;
                 }catch(network::DataMap::NotFound&)
                 {
@@ -409,10 +774,62 @@ namespace network::audio
         }
     }
 
+    JitterBuffer::Statistics playout_statistics()
+    {
+        return jitter_buffer.statistics();
+    }
+    bool start_conference()
+    {
+        std::unique_lock lock(name_mutex);
+        if(audio_buddy.name.length() != 0 or pending_name.length() != 0 or mixer != nullptr or forwarder != nullptr)
+        {
+            logging::log("ERR","You are already in a voice call");
+            return false;
+        }
+        auto parameters = local_parameters();
+        // the service calling mix() works too
+        auto threads = std::max(boost::thread::hardware_concurrency(),1u) - 1;
+        mixer = std::make_unique<Mixer>(parameters.frame_samples,SAMPLE_RATE,std::min<unsigned int>(threads,Mixer::MAX_PARTICIPANTS));
+        comms_init(parameters);
+        if(not streaming)
+        {
+            mixer.reset();
+            return false;
+        }
+        logging::log("MSG","Voice conference started, the other peers can join calling you");
+        return true;
+    }
+    bool start_forwarding()
+    {
+        std::unique_lock lock(name_mutex);
+        if(audio_buddy.name.length() != 0 or pending_name.length() != 0 or mixer != nullptr or forwarder != nullptr)
+        {
+            logging::log("ERR","You are already in a voice call");
+            return false;
+        }
+        forwarder = std::make_unique<Forwarder>();
+        logging::log("MSG","Voice forwarding started, the other peers can join calling you");
+        return true;
+    }
+    bool join_forwarder(std::string name)
+    {
+        if(name.length() == 0)
+        {// the peer that already relays the connection requests
+            try
+            {
+                name = udp::connection_map[udp::connection_map.server()]->name;
+            }catch(network::DataMap::NotFound&)
+            {
+                logging::log("ERR","You are not connected to any server");
+                return false;
+            }
+        }
+        return start_call(name);
+    }
     bool stop_call()
     {
         std::unique_lock lock(name_mutex);
-        if(audio_buddy.name.length() != 0)
+        if(audio_buddy.name.length() != 0 or mixer != nullptr or forwarder != nullptr)
         {
             _stop_call();
             return true;
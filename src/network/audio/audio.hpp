@@ -1,10 +1,34 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <atomic>
+#include "JitterBuffer/JitterBuffer.hpp"
 namespace network::audio
 {
-    extern unsigned long long input_dropped_frames;
-    extern unsigned long long output_dropped_frames;
+    // frames lost because the sender or the jitter buffer could not take them
+    extern std::atomic<unsigned long long> input_dropped_frames;
+    extern std::atomic<unsigned long long> output_dropped_frames;
+    // overflows and underflows reported by PortAudio, plus output periods with no decoded frame ready
+    extern std::atomic<unsigned long long> input_xruns;
+    extern std::atomic<unsigned long long> output_xruns;
+
+    /**
+     * @brief encoder settings, frame duration, bitrate and FEC are negotiated with the other peer at the start of a call
+     * 
+     */
+    struct CodecOptions
+    {
+        // 2.5, 5, 10, 20, 40 or 60, longer frames mean less packets but more latency
+        double frame_duration_ms = 10;
+        // target bitrate in bits/s, from 6000 to 510000
+        int32_t bitrate = 32000;
+        // from 0 (fastest) to 10 (best quality)
+        int complexity = 10;
+        // discontinuous transmission, almost nothing is sent during silence
+        bool dtx = false;
+        // in-band forward error correction, it needs frames of at least 10ms
+        bool fec = true;
+    };
 
     /**
      * @brief initialize the module
@@ -12,8 +36,9 @@ namespace network::audio
      * @param whitelist list of users to automatically accept
      * @param default_action what to do if a user is not in the whitelist
      * @param voice_volume_threshold the minimum volum to send when on a voice call
+     * @param codec_options the preferred encoder settings, invalid values are replaced by the defaults
      */
-    void init(const std::vector<std::string>& whitelist, const std::string& default_action, int16_t voice_volume_threshold=40);
+    void init(const std::vector<std::string>& whitelist, const std::string& default_action, int16_t voice_volume_threshold=40, const CodecOptions& codec_options = {});
     /**
      * @brief start a voice call with a connected user if no other call is happening
      * 
@@ -23,10 +48,38 @@ namespace network::audio
      */
     bool start_call(const std::string& name);
     /**
-     * @brief stop a voice call if there was one
+     * @brief host a voice conference, the other peers join calling this peer and everyone hears the mix of everyone else
+     * 
+     * @return true if the conference started
+     * @return false if already in a call or the audio could not start
+     */
+    bool start_conference();
+    /**
+     * @brief act as a selective forwarding unit: the other peers join calling this peer, each of them sends a single stream
+     * and receives the streams of the loudest speakers, nothing is decoded here and no audio device is needed
+     * 
+     * @return true if the forwarding started
+     * @return false if already in a call
+     */
+    bool start_forwarding();
+    /**
+     * @brief join a conference forwarded by another peer
+     * 
+     * @param name the forwarding peer, the server this peer connected to if empty
+     * @return true if the request was sent
+     */
+    bool join_forwarder(std::string name);
+    /**
+     * @brief stop a voice call or the hosted conference if there was one
      * 
      * @return true if you was connected to someone
      * @return false if you was not connected to anyone
      */
     bool stop_call();
+    /**
+     * @brief get the state of the jitter buffer of the current (or last) voice call
+     * 
+     * @return jitter, playout delay and frame counters
+     */
+    JitterBuffer::Statistics playout_statistics();
 }
\ No newline at end of file
@@ -0,0 +1,358 @@
+#include "kernels.hpp"
+#include <cmath>
+#include <algorithm>
+#if defined(__x86_64__) or defined(_M_X64) or defined(__i386__) or defined(_M_IX86)
+    #define KERNELS_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        // MSVC compiles every intrinsic without flags
+        #define TARGET_SSE2
+        #define TARGET_AVX2
+    #else
+        #define TARGET_SSE2 __attribute__((target("sse2")))
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+namespace network::audio::kernels
+{
+    // iterations of the vector loops before the 32 bit accumulators are moved to 64 bit, so they can't overflow
+    constexpr size_t FLUSH_ITERATIONS = 1 << 15;
+
+    int16_t saturate(int32_t value)
+    {
+        return (int16_t)std::clamp<int32_t>(value,INT16_MIN,INT16_MAX);
+    }
+
+    uint64_t scalar_abs_sum(const int16_t* samples, size_t count)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < count; i++)
+            sum += (uint64_t)std::abs((int32_t)samples[i]);
+        return sum;
+    }
+    uint64_t scalar_square_sum(const int16_t* samples, size_t count)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < count; i++)
+            sum += (uint64_t)((int32_t)samples[i] * (int32_t)samples[i]);
+        return sum;
+    }
+    uint16_t scalar_peak(const int16_t* samples, size_t count)
+    {
+        uint16_t peak = 0;
+        for(size_t i = 0; i < count; i++)
+            peak = std::max(peak,(uint16_t)std::abs((int32_t)samples[i]));
+        return peak;
+    }
+    void scalar_gain(int16_t* samples, size_t count, int16_t gain)
+    {
+        for(size_t i = 0; i < count; i++)
+            samples[i] = saturate(((int32_t)samples[i] * gain) >> 8);
+    }
+    void scalar_mix(int16_t* destination, const int16_t* source, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+            destination[i] = saturate((int32_t)destination[i] + source[i]);
+    }
+    void scalar_accumulate(int32_t* total, const int16_t* source, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+            total[i] += source[i];
+    }
+    void scalar_mix_minus(int16_t* destination, const int32_t* total, const int16_t* own, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+            destination[i] = saturate(total[i] - own[i]);
+    }
+    constexpr Kernels SCALAR = {"scalar",scalar_abs_sum,scalar_square_sum,scalar_peak,scalar_gain,scalar_mix,scalar_accumulate,scalar_mix_minus};
+
+#ifdef KERNELS_X86
+    TARGET_SSE2 uint64_t sum_u32(__m128i accumulator)
+    {
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128((__m128i*)lanes,accumulator);
+        return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    // absolute values as unsigned 16 bit, so -32768 becomes 32768
+    TARGET_SSE2 __m128i sse2_abs(__m128i x)
+    {
+        auto sign = _mm_srai_epi16(x,15);
+        return _mm_sub_epi16(_mm_xor_si128(x,sign),sign);
+    }
+    TARGET_SSE2 uint64_t sse2_abs_sum(const int16_t* samples, size_t count)
+    {
+        uint64_t sum = 0;
+        size_t i = 0;
+        auto zero = _mm_setzero_si128();
+        while(i + 8 <= count)
+        {
+            auto accumulator = _mm_setzero_si128();
+            for(size_t n = 0; n < FLUSH_ITERATIONS and i + 8 <= count; n++, i += 8)
+            {
+                auto x = sse2_abs(_mm_loadu_si128((const __m128i*)(samples + i)));
+                accumulator = _mm_add_epi32(accumulator,_mm_add_epi32(_mm_unpacklo_epi16(x,zero),_mm_unpackhi_epi16(x,zero)));
+            }
+            sum += sum_u32(accumulator);
+        }
+        return sum + scalar_abs_sum(samples + i,count - i);
+    }
+    TARGET_SSE2 uint64_t sse2_square_sum(const int16_t* samples, size_t count)
+    {
+        // a pair of squares is at most 2^31, it fits an unsigned 32 bit lane, then it's widened to 64 bit
+        auto accumulator = _mm_setzero_si128();
+        auto zero = _mm_setzero_si128();
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto x = _mm_loadu_si128((const __m128i*)(samples + i));
+            auto pairs = _mm_madd_epi16(x,x);
+            accumulator = _mm_add_epi64(accumulator,_mm_add_epi64(_mm_unpacklo_epi32(pairs,zero),_mm_unpackhi_epi32(pairs,zero)));
+        }
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128((__m128i*)lanes,accumulator);
+        return lanes[0] + lanes[1] + scalar_square_sum(samples + i,count - i);
+    }
+    TARGET_SSE2 uint16_t sse2_peak(const int16_t* samples, size_t count)
+    {
+        // SSE2 has only the signed max, the values are biased to compare them as unsigned
+        auto bias = _mm_set1_epi16(INT16_MIN);
+        auto peak = bias;
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+            peak = _mm_max_epi16(peak,_mm_xor_si128(sse2_abs(_mm_loadu_si128((const __m128i*)(samples + i))),bias));
+        alignas(16) uint16_t lanes[8];
+        _mm_store_si128((__m128i*)lanes,_mm_xor_si128(peak,bias));
+        return std::max(*std::max_element(lanes,lanes + 8),scalar_peak(samples + i,count - i));
+    }
+    TARGET_SSE2 void sse2_gain(int16_t* samples, size_t count, int16_t gain)
+    {
+        auto factor = _mm_set1_epi16(gain);
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto x = _mm_loadu_si128((const __m128i*)(samples + i));
+            auto low = _mm_mullo_epi16(x,factor);
+            auto high = _mm_mulhi_epi16(x,factor);
+            auto first = _mm_srai_epi32(_mm_unpacklo_epi16(low,high),8);
+            auto second = _mm_srai_epi32(_mm_unpackhi_epi16(low,high),8);
+            _mm_storeu_si128((__m128i*)(samples + i),_mm_packs_epi32(first,second));
+        }
+        scalar_gain(samples + i,count - i,gain);
+    }
+    TARGET_SSE2 void sse2_mix(int16_t* destination, const int16_t* source, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(destination + i)),_mm_loadu_si128((const __m128i*)(source + i)));
+            _mm_storeu_si128((__m128i*)(destination + i),sum);
+        }
+        scalar_mix(destination + i,source + i,count - i);
+    }
+    // sign extension of the low and high halves to 32 bit
+    TARGET_SSE2 __m128i sse2_widen_low(__m128i x)
+    {
+        return _mm_srai_epi32(_mm_unpacklo_epi16(x,x),16);
+    }
+    TARGET_SSE2 __m128i sse2_widen_high(__m128i x)
+    {
+        return _mm_srai_epi32(_mm_unpackhi_epi16(x,x),16);
+    }
+    TARGET_SSE2 void sse2_accumulate(int32_t* total, const int16_t* source, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto x = _mm_loadu_si128((const __m128i*)(source + i));
+            _mm_storeu_si128((__m128i*)(total + i),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(total + i)),sse2_widen_low(x)));
+            _mm_storeu_si128((__m128i*)(total + i + 4),_mm_add_epi32(_mm_loadu_si128((const __m128i*)(total + i + 4)),sse2_widen_high(x)));
+        }
+        scalar_accumulate(total + i,source + i,count - i);
+    }
+    TARGET_SSE2 void sse2_mix_minus(int16_t* destination, const int32_t* total, const int16_t* own, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto x = _mm_loadu_si128((const __m128i*)(own + i));
+            auto first = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(total + i)),sse2_widen_low(x));
+            auto second = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(total + i + 4)),sse2_widen_high(x));
+            _mm_storeu_si128((__m128i*)(destination + i),_mm_packs_epi32(first,second));
+        }
+        scalar_mix_minus(destination + i,total + i,own + i,count - i);
+    }
+    constexpr Kernels SSE2 = {"sse2",sse2_abs_sum,sse2_square_sum,sse2_peak,sse2_gain,sse2_mix,sse2_accumulate,sse2_mix_minus};
+
+    TARGET_AVX2 uint64_t avx2_abs_sum(const int16_t* samples, size_t count)
+    {
+        uint64_t sum = 0;
+        size_t i = 0;
+        auto zero = _mm256_setzero_si256();
+        while(i + 16 <= count)
+        {
+            auto accumulator = _mm256_setzero_si256();
+            for(size_t n = 0; n < FLUSH_ITERATIONS and i + 16 <= count; n++, i += 16)
+            {
+                auto x = _mm256_abs_epi16(_mm256_loadu_si256((const __m256i*)(samples + i)));
+                accumulator = _mm256_add_epi32(accumulator,_mm256_add_epi32(_mm256_unpacklo_epi16(x,zero),_mm256_unpackhi_epi16(x,zero)));
+            }
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256((__m256i*)lanes,accumulator);
+            for(auto lane: lanes)
+                sum += lane;
+        }
+        return sum + scalar_abs_sum(samples + i,count - i);
+    }
+    TARGET_AVX2 uint64_t avx2_square_sum(const int16_t* samples, size_t count)
+    {
+        auto accumulator = _mm256_setzero_si256();
+        auto zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16)
+        {
+            auto x = _mm256_loadu_si256((const __m256i*)(samples + i));
+            auto pairs = _mm256_madd_epi16(x,x);
+            accumulator = _mm256_add_epi64(accumulator,_mm256_add_epi64(_mm256_unpacklo_epi32(pairs,zero),_mm256_unpackhi_epi32(pairs,zero)));
+        }
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256((__m256i*)lanes,accumulator);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_square_sum(samples + i,count - i);
+    }
+    TARGET_AVX2 uint16_t avx2_peak(const int16_t* samples, size_t count)
+    {
+        auto peak = _mm256_setzero_si256();
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16)
+            peak = _mm256_max_epu16(peak,_mm256_abs_epi16(_mm256_loadu_si256((const __m256i*)(samples + i))));
+        alignas(32) uint16_t lanes[16];
+        _mm256_store_si256((__m256i*)lanes,peak);
+        return std::max(*std::max_element(lanes,lanes + 16),scalar_peak(samples + i,count - i));
+    }
+    TARGET_AVX2 void avx2_gain(int16_t* samples, size_t count, int16_t gain)
+    {
+        auto factor = _mm256_set1_epi16(gain);
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16)
+        {// unpack and pack work inside the 128 bit halves, so the order of the samples is kept
+            auto x = _mm256_loadu_si256((const __m256i*)(samples + i));
+            auto low = _mm256_mullo_epi16(x,factor);
+            auto high = _mm256_mulhi_epi16(x,factor);
+            auto first = _mm256_srai_epi32(_mm256_unpacklo_epi16(low,high),8);
+            auto second = _mm256_srai_epi32(_mm256_unpackhi_epi16(low,high),8);
+            _mm256_storeu_si256((__m256i*)(samples + i),_mm256_packs_epi32(first,second));
+        }
+        scalar_gain(samples + i,count - i,gain);
+    }
+    TARGET_AVX2 void avx2_mix(int16_t* destination, const int16_t* source, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16)
+        {
+            auto sum = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i*)(destination + i)),_mm256_loadu_si256((const __m256i*)(source + i)));
+            _mm256_storeu_si256((__m256i*)(destination + i),sum);
+        }
+        scalar_mix(destination + i,source + i,count - i);
+    }
+    TARGET_AVX2 void avx2_accumulate(int32_t* total, const int16_t* source, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            auto x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(source + i)));
+            _mm256_storeu_si256((__m256i*)(total + i),_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(total + i)),x));
+        }
+        scalar_accumulate(total + i,source + i,count - i);
+    }
+    TARGET_AVX2 void avx2_mix_minus(int16_t* destination, const int32_t* total, const int16_t* own, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16)
+        {
+            auto first = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(total + i)),_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i))));
+            auto second = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(total + i + 8)),_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(own + i + 8))));
+            // pack works inside the 128 bit halves, the quarters are put back in order
+            auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first,second),0xD8);
+            _mm256_storeu_si256((__m256i*)(destination + i),packed);
+        }
+        scalar_mix_minus(destination + i,total + i,own + i,count - i);
+    }
+    constexpr Kernels AVX2 = {"avx2",avx2_abs_sum,avx2_square_sum,avx2_peak,avx2_gain,avx2_mix,avx2_accumulate,avx2_mix_minus};
+
+    bool cpu_has_sse2()
+    {
+    #if defined(__x86_64__) or defined(_M_X64)
+        return true;
+    #elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info,1);
+        return info[3] & (1 << 26);
+    #else
+        return __builtin_cpu_supports("sse2");
+    #endif
+    }
+    bool cpu_has_avx2()
+    {
+    #ifdef _MSC_VER
+        int info[4];
+        __cpuid(info,0);
+        if(info[0] < 7)
+            return false;
+        __cpuid(info,1);
+        // the OS must save the AVX registers
+        if(not (info[2] & (1 << 27)) or (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info,7,0);
+        return info[1] & (1 << 5);
+    #else
+        return __builtin_cpu_supports("avx2");
+    #endif
+    }
+#endif
+
+    std::vector<const Kernels*> supported()
+    {
+        std::vector<const Kernels*> ret = {&SCALAR};
+    #ifdef KERNELS_X86
+        if(cpu_has_sse2())
+            ret.push_back(&SSE2);
+        if(cpu_has_avx2())
+            ret.push_back(&AVX2);
+    #endif
+        return ret;
+    }
+    const Kernels& best()
+    {
+        static const Kernels& selected = *supported().back();
+        return selected;
+    }
+
+    double mean_abs(const int16_t* samples, size_t count)
+    {
+        return count == 0 ? 0 : double(best().abs_sum(samples,count)) / count;
+    }
+    double rms(const int16_t* samples, size_t count)
+    {
+        return count == 0 ? 0 : std::sqrt(double(best().square_sum(samples,count)) / count);
+    }
+    uint16_t peak(const int16_t* samples, size_t count)
+    {
+        return best().peak(samples,count);
+    }
+    void gain(int16_t* samples, size_t count, double gain)
+    {
+        best().gain(samples,count,(int16_t)std::clamp(std::lround(gain * 256),0l,(long)INT16_MAX));
+    }
+    void mix(int16_t* destination, const int16_t* source, size_t count)
+    {
+        best().mix(destination,source,count);
+    }
+    void accumulate(int32_t* total, const int16_t* source, size_t count)
+    {
+        best().accumulate(total,source,count);
+    }
+    void mix_minus(int16_t* destination, const int32_t* total, const int16_t* own, size_t count)
+    {
+        best().mix_minus(destination,total,own,count);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+namespace network::audio::kernels
+{
+    /**
+     * @brief one implementation of the sample kernels, every implementation gives exactly the same results
+     * 
+     */
+    struct Kernels
+    {
+        // "scalar", "sse2" or "avx2"
+        const char* name;
+        // sum of the absolute values
+        uint64_t (*abs_sum)(const int16_t* samples, size_t count);
+        // sum of the squares
+        uint64_t (*square_sum)(const int16_t* samples, size_t count);
+        // largest absolute value (32768 for -32768)
+        uint16_t (*peak)(const int16_t* samples, size_t count);
+        // multiply by gain/256 (rounding down) and saturate
+        void (*gain)(int16_t* samples, size_t count, int16_t gain);
+        // add source to destination and saturate
+        void (*mix)(int16_t* destination, const int16_t* source, size_t count);
+        // add source to a 32 bit mix, it can't saturate
+        void (*accumulate)(int32_t* total, const int16_t* source, size_t count);
+        // total minus own, saturated, what a participant hears of a mix it contributed to
+        void (*mix_minus)(int16_t* destination, const int32_t* total, const int16_t* own, size_t count);
+    };
+    /**
+     * @brief the fastest implementation supported by this CPU, selected on the first call
+     * 
+     */
+    const Kernels& best();
+    /**
+     * @brief every implementation supported by this CPU, from the slowest
+     * 
+     */
+    std::vector<const Kernels*> supported();
+
+    /**
+     * @brief mean absolute value of the samples
+     * 
+     */
+    double mean_abs(const int16_t* samples, size_t count);
+    /**
+     * @brief root mean square of the samples
+     * 
+     */
+    double rms(const int16_t* samples, size_t count);
+    /**
+     * @brief largest absolute value of the samples
+     * 
+     */
+    uint16_t peak(const int16_t* samples, size_t count);
+    /**
+     * @brief multiply the samples by a gain, saturating
+     * 
+     * @param gain from 0 to 127, with a resolution of 1/256
+     */
+    void gain(int16_t* samples, size_t count, double gain);
+    /**
+     * @brief add source to destination, saturating
+     * 
+     */
+    void mix(int16_t* destination, const int16_t* source, size_t count);
+    /**
+     * @brief add source to a 32 bit mix
+     * 
+     */
+    void accumulate(int32_t* total, const int16_t* source, size_t count);
+    /**
+     * @brief write total minus own to destination, saturating
+     * 
+     */
+    void mix_minus(int16_t* destination, const int32_t* total, const int16_t* own, size_t count);
+}
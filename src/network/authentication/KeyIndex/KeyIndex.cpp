@@ -0,0 +1,101 @@
+#include "KeyIndex.hpp"
+#include <fstream>
+#include <cstring>
+namespace network::authentication
+{
+    constexpr char MAGIC[8] = {'M','O','K','A','K','E','Y','1'};
+    constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint64_t);
+    constexpr size_t ENTRY_HEADER_SIZE = 2 * sizeof(uint32_t);
+    template <typename T>
+    T read(const char* data)
+    {
+        T ret;
+        std::memcpy(&ret,data,sizeof(T));
+        return ret;
+    }
+    template <typename T>
+    void write_value(std::ofstream& file, T value)
+    {
+        file.write((const char*)&value,sizeof(T));
+    }
+    KeyIndex::KeyIndex(const std::string& filename)
+    {
+        try
+        {
+            file = boost::interprocess::file_mapping(filename.c_str(),boost::interprocess::read_only);
+            region = boost::interprocess::mapped_region(file,boost::interprocess::read_only);
+        }catch(const boost::interprocess::interprocess_exception&)
+        {
+            throw InvalidFile{};
+        }
+        data = (const char*)region.get_address();
+        file_size = region.get_size();
+        if(file_size < HEADER_SIZE or std::memcmp(data,MAGIC,sizeof(MAGIC)) != 0)
+            throw InvalidFile{};
+        count = read<uint64_t>(data + sizeof(MAGIC));
+        if(count > (file_size - HEADER_SIZE) / sizeof(uint64_t))
+            throw InvalidFile{};
+    }
+    std::pair<std::string_view,std::string_view> KeyIndex::entry(size_t index) const
+    {
+        auto offset = read<uint64_t>(data + HEADER_SIZE + index * sizeof(uint64_t));
+        if(offset > file_size or file_size - offset < ENTRY_HEADER_SIZE)
+            return {};
+        auto name_length = read<uint32_t>(data + offset);
+        auto key_length = read<uint32_t>(data + offset + sizeof(uint32_t));
+        if((uint64_t)name_length + key_length > file_size - offset - ENTRY_HEADER_SIZE)
+            return {};
+        auto name = data + offset + ENTRY_HEADER_SIZE;
+        return {std::string_view(name,name_length),std::string_view(name + name_length,key_length)};
+    }
+    size_t KeyIndex::size() const
+    {
+        return count;
+    }
+    std::string_view KeyIndex::name(size_t index) const
+    {
+        return entry(index).first;
+    }
+    std::string_view KeyIndex::key(size_t index) const
+    {
+        return entry(index).second;
+    }
+    std::optional<std::string_view> KeyIndex::find(std::string_view name) const
+    {
+        size_t begin = 0, end = count;
+        while(begin < end)
+        {
+            auto middle = begin + (end - begin) / 2;
+            auto [middle_name, key] = entry(middle);
+            auto comparison = middle_name.compare(name);
+            if(comparison == 0)
+                return key;
+            if(comparison < 0)
+                begin = middle + 1;
+            else
+                end = middle;
+        }
+        return std::nullopt;
+    }
+    bool KeyIndex::write(const std::string& filename, const std::vector<std::pair<std::string_view,std::string_view>>& entries)
+    {
+        std::ofstream file(filename,std::ios::out|std::ios::trunc|std::ios::binary);
+        file.write(MAGIC,sizeof(MAGIC));
+        write_value<uint64_t>(file,entries.size());
+        uint64_t offset = HEADER_SIZE + entries.size() * sizeof(uint64_t);
+        for(auto& [name, key]: entries)
+        {
+            write_value<uint64_t>(file,offset);
+            offset += ENTRY_HEADER_SIZE + name.length() + key.length();
+        }
+        for(auto& [name, key]: entries)
+        {
+            write_value<uint32_t>(file,(uint32_t)name.length());
+            write_value<uint32_t>(file,(uint32_t)key.length());
+            file.write(name.data(),name.length());
+            file.write(key.data(),key.length());
+        }
+        file.flush();
+        return (bool)file;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <string_view>
+#include <stdint.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+namespace network::authentication
+{
+    /**
+     * @brief a read only file of users and keys sorted by name and memory mapped, so it can be opened
+     * without reading it and a lookup only touches the pages of a binary search.
+     * The file is a header (magic and count), the offsets of the entries sorted by name and the entries,
+     * each one is the length of the name, the length of the key, the name and the key, all integers in host byte order
+     * 
+     */
+    class KeyIndex
+    {
+    private:
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+        const char* data = nullptr;
+        size_t file_size = 0;
+        uint64_t count = 0;
+        /**
+         * @brief get the name and the key of an entry, both empty if the entry is not valid
+         * 
+         */
+        std::pair<std::string_view,std::string_view> entry(size_t index) const;
+    public:
+        /**
+         * @brief thrown when the file can't be opened or is not a key index
+         * 
+         */
+        class InvalidFile: public std::exception
+        {
+        public:
+            const char* what(){return "InvalidFile";}
+        };
+        /**
+         * @brief open and map an index file, throws InvalidFile
+         * 
+         * @param filename path to the file
+         */
+        KeyIndex(const std::string& filename);
+        /**
+         * @brief how many users are in the index
+         * 
+         */
+        size_t size() const;
+        /**
+         * @brief get the name of a user
+         * 
+         * @param index from 0 to size()-1, the names are sorted
+         */
+        std::string_view name(size_t index) const;
+        /**
+         * @brief get the key of a user
+         * 
+         * @param index from 0 to size()-1
+         */
+        std::string_view key(size_t index) const;
+        /**
+         * @brief search a user
+         * 
+         * @param name the name of the user
+         * @return the key, "" if the user was blacklisted, std::nullopt if the user is not present
+         */
+        std::optional<std::string_view> find(std::string_view name) const;
+        /**
+         * @brief write an index file
+         * 
+         * @param filename path to the file, it is overwritten
+         * @param entries the names and the keys, sorted by name and without duplicates
+         * @return false if the file could not be written
+         */
+        static bool write(const std::string& filename, const std::vector<std::pair<std::string_view,std::string_view>>& entries);
+    };
+}
\ No newline at end of file
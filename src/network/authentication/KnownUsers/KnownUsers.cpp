@@ -2,79 +2,392 @@
 #include "../../../defines.hpp"
 #include "../../../ansi_escape.hpp"
 #include <fstream>
+#include <sstream>
+#include <filesystem>
 #include "../../../logging/logging.hpp"
+#include "../../udp/crypto/crypto.hpp"
+#include "../../file/ChunkFile/ChunkFile.hpp"
 namespace network::authentication
 {
-    void KnownUsers::load(const std::string& filename)
+    // the updates not compacted yet are appended to this file, next to the main one
+    const std::string JOURNAL_SUFFIX = ".journal";
+    // the main file is rewritten with at least this many updates in the journal
+    constexpr size_t COMPACT_ENTRIES = 1024;
+    // or when the oldest update in the journal is this old
+    constexpr unsigned int COMPACT_SECONDS = 300;
+    KnownUsers::KnownUsers(KeyParser parse_key): parse_key(std::move(parse_key))
     {
+        if(not this->parse_key)
+            this->parse_key = [](const std::string& key){ return std::shared_ptr<EVP_PKEY>(udp::crypto::string_to_pubkey(key)); };
+    }
+    void KnownUsers::load(const std::string& filename, Format format)
+    {
+        std::unique_lock disk_lock(disk_mutex);
         std::unique_lock lock(users_mutex);
         this->filename = filename;
-        try
+        this->format = format;
+        parsed_keys.clear();
+        pending_updates.clear();
+        users = toml::table{};
+        index.reset();
+        overlay.clear();
+        bool loaded = false;
+        if(format == Format::TOML)
         {
-            users = toml::parse_file(filename);   
+            try
+            {
+                users = toml::parse_file(filename);
+                loaded = true;
+            }
+            catch(const toml::parse_error&){}
+        }else
+        {
+            try
+            {
+                index = std::make_shared<const KeyIndex>(filename);
+                loaded = true;
+            }
+            catch(KeyIndex::InvalidFile&){}
+        }
+        if(loaded)
             logging::log("DBG","Know users info loaded from \"" HIGHLIGHT +filename+ RESET "\"");
+        else
+            logging::log("DBG","Know users info created at \"" HIGHLIGHT +filename+ RESET "\"");
+        auto replayed = _replay_journal();
+        if(replayed != 0)
+            logging::log("DBG","Replayed " + std::to_string(replayed) + " updates of the known users from \"" HIGHLIGHT +filename+JOURNAL_SUFFIX+ RESET "\"");
+        if(replayed != 0 or not loaded)
+        {
+            auto snapshot = _snapshot();
+            auto temporary = write_snapshot(snapshot);
+            if(temporary.length() != 0 and _replace(temporary))
+                overlay.clear();
         }
-        catch(const toml::parse_error&)
+    }
+    std::optional<std::string> KnownUsers::_find(const std::string& name) const
+    {
+        if(format == Format::TOML)
         {
-            std::fstream file(filename,std::ios::out|std::ios::trunc);
-            users = toml::table{};
-            file << users;
-            logging::log("DBG","Know users info created at \"" HIGHLIGHT +filename+ RESET "\"");
+            auto user = users.find(name);
+            if(user == users.end())
+                return std::nullopt;
+            auto info = user->second.as_table();
+            return info ? (*info)["key"].value_or<std::string>("") : "";
+        }
+        auto update = overlay.find(name);
+        if(update != overlay.end())
+            return update->second;
+        if(index == nullptr)
+            return std::nullopt;
+        auto key = index->find(name);
+        if(not key)
+            return std::nullopt;
+        return std::string(*key);
+    }
+    void KnownUsers::_set(const std::string& name, const std::string& key)
+    {
+        if(format == Format::TOML)
+            users.insert_or_assign(name,toml::table{{"key",key}});
+        else
+            overlay.insert_or_assign(name,key);
+    }
+    void KnownUsers::_erase(const std::string& name)
+    {
+        if(format == Format::TOML)
+            users.erase(name);
+        else
+            overlay.insert_or_assign(name,std::nullopt);
+    }
+    KnownUsers::Snapshot KnownUsers::_snapshot() const
+    {
+        if(format == Format::TOML)
+            return {users,nullptr,{}};
+        return {{},index,overlay};
+    }
+    size_t KnownUsers::_replay_journal()
+    {
+        std::ifstream file(filename+JOURNAL_SUFFIX,std::ios::binary);
+        if(not file)
+            return 0;
+        std::stringstream content;
+        content << file.rdbuf();
+        auto journal = content.str();
+        toml::table updates;
+        while(true)
+        {
+            try
+            {
+                updates = toml::parse(journal);
+                break;
+            }catch(const toml::parse_error&)
+            {// the last update was not written completely
+                auto last = journal.rfind("[[update]]");
+                if(last == journal.npos or last == 0)
+                    return 0;
+                journal.erase(last);
+            }
+        }
+        size_t replayed = 0;
+        if(auto array = updates["update"].as_array())
+        {
+            for(auto& update: *array)
+            {
+                auto entry = update.as_table();
+                if(entry == nullptr)
+                    continue;
+                auto name = (*entry)["name"].value<std::string>();
+                if(not name)
+                    continue;
+                auto key = (*entry)["key"].value<std::string>();
+                if(key)
+                    _set(*name,*key);
+                else
+                    _erase(*name);
+                replayed++;
+            }
+        }
+        return replayed;
+    }
+    std::vector<std::pair<std::string_view,std::string_view>> KnownUsers::sorted_users(const Snapshot& snapshot) const
+    {
+        std::vector<std::pair<std::string_view,std::string_view>> ret;
+        if(format == Format::TOML)
+        {
+            for(auto& [name, info]: snapshot.users)
+            {
+                if(info.is_table())
+                    ret.emplace_back(name.str(),(*info.as_table())["key"].value_or(std::string_view{}));
+            }
+            return ret;
+        }
+        // merge of two sequences sorted by name, the updates win
+        size_t indexed = snapshot.index ? snapshot.index->size() : 0;
+        size_t i = 0;
+        auto update = snapshot.overlay.begin();
+        while(i < indexed or update != snapshot.overlay.end())
+        {
+            auto name = i < indexed ? snapshot.index->name(i) : std::string_view{};
+            if(update != snapshot.overlay.end() and (i == indexed or std::string_view(update->first) <= name))
+            {
+                if(update->second)
+                    ret.emplace_back(update->first,*update->second);
+                if(i < indexed and update->first == name)
+                    i++;
+                update++;
+            }else
+            {
+                ret.emplace_back(name,snapshot.index->key(i));
+                i++;
+            }
+        }
+        return ret;
+    }
+    std::string KnownUsers::write_snapshot(Snapshot& snapshot)
+    {
+        auto temporary = filename + ".tmp";
+        bool written;
+        if(format == Format::TOML)
+        {
+            std::ofstream file(temporary,std::ios::out|std::ios::trunc);
+            file << snapshot.users;
+            file.flush();
+            written = (bool)file;
+        }else
+            written = KeyIndex::write(temporary,sorted_users(snapshot));
+        // the old file can't be replaced while it is mapped
+        snapshot.index.reset();
+        // the data must be on the disk before the rename, or a crash could leave an empty file in place of the old one
+        if(not written or not file::ChunkFile::sync_path(temporary))
+        {
+            logging::log("ERR","Error writing the known users to \"" HIGHLIGHT +temporary+ RESET "\"");
+            return "";
         }
+        return temporary;
     }
-    void KnownUsers::_save()
+    bool KnownUsers::_replace(const std::string& temporary)
     {
-        std::fstream file(filename,std::ios::out|std::ios::trunc);
-        file << users;
+        if(format == Format::INDEX)
+            index.reset();
+        std::error_code error;
+        std::filesystem::rename(temporary,filename,error);
+        bool replaced = not error;
+        if(not replaced)
+            logging::log("ERR","Error replacing \"" HIGHLIGHT +filename+ RESET "\": " + error.message());
+        auto directory = std::filesystem::absolute(filename).parent_path().string();
+        if(replaced and not file::ChunkFile::sync_path(directory,true))
+        {// without the rename on the disk the journal is still needed
+            logging::log("ERR","Error syncing \"" HIGHLIGHT +directory+ RESET "\", the journal is kept");
+            replaced = false;
+        }
+        if(replaced)
+        {// every update in the journal is in the new file now
+            std::ofstream journal(filename+JOURNAL_SUFFIX,std::ios::out|std::ios::trunc);
+            journal_entries = 0;
+        }
+        if(format == Format::TOML)
+            return replaced;
+        // the new file, or the old one again if it was not replaced
+        try
+        {
+            index = std::make_shared<const KeyIndex>(filename);
+        }catch(KeyIndex::InvalidFile&)
+        {
+            logging::log("ERR","Error opening \"" HIGHLIGHT +filename+ RESET "\"");
+            return false;
+        }
+        return replaced;
+    }
+    void KnownUsers::flush(bool force_compaction)
+    {
+        std::unique_lock disk_lock(disk_mutex);
+        std::map<std::string,std::optional<std::string>> updates;
+        Snapshot snapshot;
+        bool compaction;
+        {
+            std::unique_lock lock(users_mutex);
+            if(filename.length() == 0)
+                return;
+            updates.swap(pending_updates);
+            if(journal_entries == 0 and not updates.empty())
+                oldest_journal_entry = std::chrono::steady_clock::now();
+            journal_entries += updates.size();
+            compaction = force_compaction or journal_entries >= COMPACT_ENTRIES
+                or (journal_entries != 0 and std::chrono::steady_clock::now() - oldest_journal_entry >= std::chrono::seconds(COMPACT_SECONDS));
+            if(compaction)
+                snapshot = _snapshot();
+        }
+        if(not updates.empty() and not compaction)
+        {
+            toml::array entries;
+            for(auto& [name, key]: updates)
+            {
+                if(key)
+                    entries.push_back(toml::table{{"name",name},{"key",*key}});
+                else//deleted
+                    entries.push_back(toml::table{{"name",name}});
+            }
+            std::ofstream journal(filename+JOURNAL_SUFFIX,std::ios::out|std::ios::app|std::ios::binary);
+            journal << toml::table{{"update",std::move(entries)}} << "\n";
+            journal.flush();
+            if(not journal)
+                logging::log("ERR","Error writing the known users to \"" HIGHLIGHT +filename+JOURNAL_SUFFIX+ RESET "\"");
+        }
+        if(not compaction)
+            return;
+        auto temporary = write_snapshot(snapshot);
+        if(temporary.length() == 0)
+            return;
+        std::unique_lock lock(users_mutex);
+        if(not _replace(temporary))
+            return;
+        for(auto& [name, key]: snapshot.overlay)
+        {// the updates made during the compaction stay
+            auto update = overlay.find(name);
+            if(update != overlay.end() and update->second == key)
+                overlay.erase(update);
+        }
     }
     void KnownUsers::save()
     {
+        flush(true);
+    }
+    std::optional<size_t> KnownUsers::import_toml(const std::string& filename)
+    {
+        toml::table imported;
+        try
+        {
+            imported = toml::parse_file(filename);
+        }catch(const toml::parse_error&)
+        {
+            return std::nullopt;
+        }
+        size_t count = 0;
         std::unique_lock lock(users_mutex);
-        _save();
+        for(auto& [name, info]: imported)
+        {
+            if(not info.is_table())
+                continue;
+            std::string user(name.str());
+            auto key = (*info.as_table())["key"].value_or<std::string>("");
+            _set(user,key);
+            parsed_keys.erase(user);
+            pending_updates.insert_or_assign(user,key);
+            count++;
+        }
+        return count;
+    }
+    bool KnownUsers::export_toml(const std::string& filename)
+    {
+        toml::table exported;
+        {
+            std::unique_lock lock(users_mutex);
+            auto snapshot = _snapshot();
+            for(auto& [name, key]: sorted_users(snapshot))
+                exported.insert_or_assign(name,toml::table{{"key",key}});
+        }
+        std::ofstream file(filename,std::ios::out|std::ios::trunc);
+        file << exported;
+        file.flush();
+        return (bool)file;
     }
     bool KnownUsers::add_key(const std::string& name, const std::string& key)
     {
         std::unique_lock lock(users_mutex);
-        if(users.find(name) != users.end())
+        if(_find(name))
             return false;
-        users.emplace(name,toml::table{{"key",key}});
-        _save();
+        _set(name,key);
+        pending_updates.insert_or_assign(name,key);
         return true;
     }
     bool KnownUsers::replace_key(const std::string& name, const std::string& key)
     {
         std::unique_lock lock(users_mutex);
-        auto ret = users.find(name) != users.end();
-        users.emplace(name,toml::table{{"key",key}});
-        _save();
+        auto ret = _find(name).has_value();
+        _set(name,key);
+        parsed_keys.erase(name);
+        pending_updates.insert_or_assign(name,key);
         return ret;
     }
     bool KnownUsers::delete_key(const std::string& name)
     {
         std::unique_lock lock(users_mutex);
-        if(users.find(name) == users.end())
+        if(not _find(name))
             return false;
-        users.erase(name);
-        _save();
+        _erase(name);
+        parsed_keys.erase(name);
+        pending_updates.insert_or_assign(name,std::nullopt);
         return true;
     }
     std::vector<std::string> KnownUsers::get_all()
     {
         std::vector<std::string> ret;
         std::unique_lock lock(users_mutex);
-        for(auto& [name, info]: users)
-        {
-            if(info.is_table())
-                ret.emplace_back(name.str());
-        }
+        auto snapshot = _snapshot();
+        for(auto& [name, key]: sorted_users(snapshot))
+            ret.emplace_back(name);
         return ret;
     }
     std::string KnownUsers::get_key(const std::string& name)
     {
         std::unique_lock lock(users_mutex);
-        auto ret = users[name]["key"].value_or<std::string>("");
-        if(ret.length()==0 and users.find(name) == users.end())
+        auto ret = _find(name);
+        if(not ret)
             throw KeyNotFound{};
-        return ret;
+        return *ret;
+    }
+    std::shared_ptr<EVP_PKEY> KnownUsers::get_pubkey(const std::string& name)
+    {
+        std::unique_lock lock(users_mutex);
+        auto cached = parsed_keys.find(name);
+        if(cached != parsed_keys.end())
+            return cached->second;
+        auto key = _find(name);
+        if(not key)
+            throw KeyNotFound{};
+        std::shared_ptr<EVP_PKEY> parsed;
+        if(key->length() != 0)//not blacklisted
+            parsed = parse_key(*key);
+        parsed_keys.emplace(name,parsed);
+        return parsed;
     }
 }
\ No newline at end of file
@@ -2,32 +2,138 @@
 #include <string>
 #include <map>
 #include <mutex>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <unordered_map>
 #include <exception>
+#include <openssl/evp.h>
 #include "../../../toml.hpp"
+#include "../KeyIndex/KeyIndex.hpp"
 namespace network::authentication
 {
     class KnownUsers
     {
+    public:
+        /**
+         * @brief parses a key in the format stored in the file, throws std::runtime_error if the key is not valid
+         * 
+         */
+        using KeyParser = std::function<std::shared_ptr<EVP_PKEY>(const std::string& key)>;
+        /**
+         * @brief how the users are stored on disk: a toml file parsed at startup,
+         * or a KeyIndex that is only mapped at startup and searched on every lookup
+         * 
+         */
+        enum class Format
+        {
+            TOML,
+            INDEX
+        };
     private:
         std::mutex users_mutex;
+        Format format = Format::TOML;
+        // every user with the TOML format
         toml::table users;
+        // the users in the file with the INDEX format
+        std::shared_ptr<const KeyIndex> index;
+        // the updates not in the file yet with the INDEX format, nullopt if the user was deleted
+        std::map<std::string,std::optional<std::string>> overlay;
         std::string filename;
-        void _save();
+        KeyParser parse_key;
+        // keys already parsed, an entry is removed every time the key of the user changes
+        std::unordered_map<std::string,std::shared_ptr<EVP_PKEY>> parsed_keys;
+        // updates not written to disk yet, only the last one of every user, nullopt if the user was deleted
+        std::map<std::string,std::optional<std::string>> pending_updates;
+        // serializes the writes to disk, always locked before users_mutex
+        std::mutex disk_mutex;
+        // updates in the journal and not in the toml file, protected by disk_mutex
+        size_t journal_entries = 0;
+        std::chrono::steady_clock::time_point oldest_journal_entry;
+        /**
+         * @brief the users at the start of a compaction, copied to write them without holding users_mutex
+         * 
+         */
+        struct Snapshot
+        {
+            toml::table users;
+            std::shared_ptr<const KeyIndex> index;
+            std::map<std::string,std::optional<std::string>> overlay;
+        };
+        // every method starting with _ requires users_mutex
+        std::optional<std::string> _find(const std::string& name) const;
+        void _set(const std::string& name, const std::string& key);
+        void _erase(const std::string& name);
+        Snapshot _snapshot() const;
+        /**
+         * @brief apply the updates of the journal
+         * 
+         * @return the updates applied
+         */
+        size_t _replay_journal();
+        /**
+         * @brief write the snapshot to a temporary file, then release the index of the snapshot
+         * 
+         * @return the path to the temporary file, "" if it could not be written
+         */
+        std::string write_snapshot(Snapshot& snapshot);
+        /**
+         * @brief replace the file with the temporary one and empty the journal.
+         * With the INDEX format the file is unmapped for the rename (a mapped file can't be replaced everywhere)
+         * and mapped again after it, so no snapshot may hold the index
+         * 
+         * @return false if the file could not be replaced
+         */
+        bool _replace(const std::string& temporary);
+        /**
+         * @brief every user of the snapshot sorted by name, the names and the keys point into the snapshot
+         * 
+         */
+        std::vector<std::pair<std::string_view,std::string_view>> sorted_users(const Snapshot& snapshot) const;
     public:
-        KnownUsers() = default;
         /**
-         * @brief load the object from a toml file
+         * @brief Construct a new Known Users object
+         * 
+         * @param parse_key used by get_pubkey to parse the keys, the PEM format without the first and last line if not set
+         */
+        KnownUsers(KeyParser parse_key = {});
+        /**
+         * @brief load the object from a file and the updates of its journal
          * 
          * @param filename path to the file
+         * @param format the format of the file
+         */
+        void load(const std::string& filename, Format format = Format::TOML);
+        /**
+         * @brief add or replace every user of a toml file (in the format of known_users.toml), they will be saved by the next flush
+         * 
+         * @param filename path to the toml file
+         * @return how many users were imported, std::nullopt if the file could not be parsed
          */
-        void load(const std::string& filename);
+        std::optional<size_t> import_toml(const std::string& filename);
         /**
-         * @brief save the object to the previously opened file
+         * @brief write every user to a toml file (in the format of known_users.toml)
+         * 
+         * @param filename path to the toml file, it is overwritten
+         * @return false if the file could not be written
+         */
+        bool export_toml(const std::string& filename);
+        /**
+         * @brief save the object to the previously opened file, the journal is emptied
          * 
          */
         void save();
         /**
-         * @brief add a key if not already present and save to file
+         * @brief append the updates made since the last flush to the journal, only the last one of every user,
+         * and rewrite the toml file when the journal has too many updates or the oldest one is too old.
+         * The other methods never write to disk, this is called periodically by the authentication module
+         * 
+         * @param force_compaction rewrite the toml file anyway
+         */
+        void flush(bool force_compaction = false);
+        /**
+         * @brief add a key if not already present, it will be saved by the next flush
          * 
          * @param name the name of the user
          * @param key the key in the PEM format without the first and last line,
@@ -38,7 +144,7 @@ namespace network::authentication
         bool add_key(const std::string& name, const std::string& key);
         /**
          * @brief add or replace a key even if there is already one associated
-         * with the selected user and save to file
+         * with the selected user, it will be saved by the next flush
          * 
          * @param name the name of the user
          * @param key the key in PEM format without the first and last line, 
@@ -48,7 +154,7 @@ namespace network::authentication
          */
         bool replace_key(const std::string& name, const std::string& key);
         /**
-         * @brief delete a key associated with a user
+         * @brief delete a key associated with a user, it will be saved by the next flush
          * 
          * @param name the user name to remove from the list
          * @return true if the user was present
@@ -78,5 +184,14 @@ namespace network::authentication
          * the key can also be "" if the user was blacklisted
          */
         std::string get_key(const std::string& name);
+        /**
+         * @brief get the parsed key associated with a user, the key is parsed only the first time and
+         * it stays cached until it is replaced or deleted, throws KeyNotFound if the user was not present
+         * and std::runtime_error if the key is not valid
+         * 
+         * @param name the name of the user to search
+         * @return the key, nullptr if the user was blacklisted
+         */
+        std::shared_ptr<EVP_PKEY> get_pubkey(const std::string& name);
     };
 }
\ No newline at end of file
@@ -13,20 +13,68 @@
 #include <exception>
 #include <filesystem>
 #include <map>
+#include <vector>
+#include <unordered_map>
+#include <boost/thread.hpp>
 #include "../../logging/logging.hpp"
+#include "../../multithreading/multithreading.hpp"
 #include "../../base64/base64.h"
 #include "../udp/crypto/crypto.hpp"
 #include "KnownUsers/KnownUsers.hpp"
 namespace network::authentication
 {  
-    KnownUsers known_users;
+    // the updates of the known users are written to disk this often
+    constexpr unsigned int KNOWN_USERS_FLUSH_MS = 500;
+    void known_users_writer()
+    {
+        try
+        {
+            while(true)
+            {
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(KNOWN_USERS_FLUSH_MS));
+                known_users.flush();
+            }
+        }catch(boost::thread_interrupted&)
+        {// nothing is lost at shutdown
+            known_users.save();
+            throw;
+        }
+    }
+    void load_known_users(KnownUsers::Format format)
+    {
+        if(format == KnownUsers::Format::TOML)
+        {
+            known_users.load(KNOWN_USERS_FILE);
+            return;
+        }
+        bool import = not std::filesystem::exists(KNOWN_USERS_INDEX_FILE) and std::filesystem::exists(KNOWN_USERS_FILE);
+        known_users.load(KNOWN_USERS_INDEX_FILE,KnownUsers::Format::INDEX);
+        if(import)
+        {
+            auto imported = known_users.import_toml(KNOWN_USERS_FILE);
+            if(imported)
+            {
+                known_users.save();
+                logging::log("MSG","Imported " + std::to_string(*imported) + " known users from \"" HIGHLIGHT +KNOWN_USERS_FILE+ RESET "\"");
+            }
+        }
+    }
     #ifdef USE_EC_AUTHENTICATION
+    KnownUsers known_users;
     std::unique_ptr<EVP_PKEY,decltype(&::EVP_PKEY_free)> local_key{nullptr,nullptr};
     template <typename A, typename D>
     std::unique_ptr<A,D> make_handle(A* ptr,D destructor)
     {
         return std::unique_ptr<A,D>{ptr,destructor};
     }
+    // verify contexts already initialized with the key of a user, copied for every verification
+    struct PreparedVerify
+    {
+        std::shared_ptr<EVP_PKEY> key;
+        std::unique_ptr<EVP_MD_CTX,decltype(&::EVP_MD_CTX_free)> context{nullptr,EVP_MD_CTX_free};
+    };
+    // prepared contexts kept by every thread, all of them are dropped when there are too many
+    constexpr size_t MAX_PREPARED_VERIFY = 256;
 
     void gen_and_load_keys()
     {
@@ -71,7 +119,7 @@ namespace network::authentication
             logging::log("ERR","Something went wrong during the key loading: "+std::string(e.what()));
         }
     }
-    void init()
+    void init(KnownUsers::Format known_users_format)
     {
         std::filesystem::create_directories(MOKACCINO_ROOT);
         if(not std::filesystem::is_regular_file(PRIVKEY_PATH))
@@ -86,33 +134,44 @@ namespace network::authentication
         //logging::log("DBG",local_public_key());
         //print_keys();
         //logging::log("DBG","LPK: "+local_public_key());
-        known_users.load(KNOWN_USERS_FILE);
+        load_known_users(known_users_format);
         known_users.add_key("loopback",local_public_key());
+        multithreading::add_service("known_users",known_users_writer);
     }
 
-    bool verify(const std::string& data, const std::string& signed_data, const std::string& username)
+    bool verify(const std::string& data, const std::string& signed_data, const std::string& username, KnownUsers& users)
     {
-        try{
-            auto key_str = known_users.get_key(username);
-            if(key_str.length() == 0)//the user was blacklisted
-                return false;
-            try
-            {
-                std::unique_ptr<unsigned char> signature{new unsigned char[b64d_size((unsigned int)signed_data.length())]};
-                auto signature_size = b64_decode((unsigned char*)signed_data.c_str(),(unsigned int)signed_data.length(),signature.get());
-                auto pubkey = udp::crypto::string_to_pubkey(key_str);
-                auto message_digest_context = make_handle(EVP_MD_CTX_new(),EVP_MD_CTX_free);
-                EVP_DigestVerifyInit(message_digest_context.get(),nullptr,EVP_sha384(),nullptr,pubkey.get());
-                EVP_DigestVerifyUpdate(message_digest_context.get(),data.c_str(),data.length());
-                return 1==EVP_DigestVerifyFinal(message_digest_context.get(),signature.get(),signature_size);
-            }catch(const std::runtime_error&)
-            {
-                logging::log("ERR","The public key provided by " HIGHLIGHT +username+ RESET "was not a valid key");
+        thread_local std::unordered_map<std::string,PreparedVerify> prepared_verify;
+        thread_local auto message_digest_context = make_handle(EVP_MD_CTX_new(),EVP_MD_CTX_free);
+        thread_local std::vector<unsigned char> signature;
+        try
+        {
+            auto pubkey = users.get_pubkey(username);
+            if(pubkey == nullptr)//the user was blacklisted
                 return false;
+            if(prepared_verify.size() >= MAX_PREPARED_VERIFY and not prepared_verify.contains(username))
+                prepared_verify.clear();
+            auto& prepared = prepared_verify[username];
+            if(prepared.key != pubkey)
+            {//first verification or the key changed
+                prepared.key = nullptr;
+                prepared.context = make_handle(EVP_MD_CTX_new(),EVP_MD_CTX_free);
+                if(1 != EVP_DigestVerifyInit(prepared.context.get(),nullptr,EVP_sha384(),nullptr,pubkey.get()))
+                    throw std::runtime_error{"Error initializing the verify context"};
+                prepared.key = pubkey;
             }
+            signature.resize(b64d_size((unsigned int)signed_data.length()));
+            auto signature_size = b64_decode((unsigned char*)signed_data.c_str(),(unsigned int)signed_data.length(),signature.data());
+            EVP_MD_CTX_copy_ex(message_digest_context.get(),prepared.context.get());
+            EVP_DigestVerifyUpdate(message_digest_context.get(),data.c_str(),data.length());
+            return 1==EVP_DigestVerifyFinal(message_digest_context.get(),signature.data(),signature_size);
         }catch(KnownUsers::KeyNotFound&)
         {
             return false;
+        }catch(const std::runtime_error&)
+        {
+            logging::log("ERR","The public key provided by " HIGHLIGHT +username+ RESET "was not a valid key");
+            return false;
         }
     }
     std::string sign(const std::string& data)
@@ -170,6 +229,12 @@ namespace network::authentication
         RSA_set0_key(ret,n,e,nullptr);
         return ret;
     }
+    KnownUsers known_users{[](const std::string& key)
+    {
+        std::shared_ptr<EVP_PKEY> ret{EVP_PKEY_new(),EVP_PKEY_free};
+        EVP_PKEY_assign_RSA(ret.get(),string_to_pubkey(key));
+        return ret;
+    }};
     void print_keys()
     {
         auto* n = RSA_get0_n(local_key);
@@ -233,7 +298,7 @@ namespace network::authentication
         BIO_free_all(bp_private);
         BN_free(bne);
     }
-    void init()
+    void init(KnownUsers::Format known_users_format)
     {
         BIO *bp_public = nullptr;
         BIO *bp_private = nullptr;
@@ -268,22 +333,22 @@ namespace network::authentication
         }
         //print_keys();
         //logging::log("DBG","LPK: "+local_public_key());
-        known_users.load(KNOWN_USERS_FILE);
+        load_known_users(known_users_format);
         known_users.add_key("loopback",local_public_key());
+        multithreading::add_service("known_users",known_users_writer);
     }
 
-    bool verify(const std::string& data, const std::string& signed_data, const std::string& username)
+    bool verify(const std::string& data, const std::string& signed_data, const std::string& username, KnownUsers& users)
     {
         try{
-            auto key_str = known_users.get_key(username);
-            if(key_str.length() == 0)//the user was blacklisted
+            auto pubkey = users.get_pubkey(username);
+            if(pubkey == nullptr)//the user was blacklisted
                 return false;
-            std::unique_ptr<RSA,decltype(&::RSA_free)> pubkey {string_to_pubkey(key_str),RSA_free};
             std::unique_ptr<unsigned char> hashed_data{new unsigned char[SHA384_DIGEST_LENGTH]};
             SHA384((unsigned char*)data.c_str(),data.length(),hashed_data.get());
             std::unique_ptr<unsigned char> decoded_signature{new unsigned char[b64d_size((unsigned int)signed_data.length())]};
             unsigned int signature_len = b64_decode((unsigned char*)signed_data.c_str(),(unsigned int)signed_data.length(),decoded_signature.get());
-            bool success = (RSA_verify(NID_sha384,hashed_data.get(),SHA384_DIGEST_LENGTH,decoded_signature.get(),signature_len,pubkey.get()) == 1);
+            bool success = (RSA_verify(NID_sha384,hashed_data.get(),SHA384_DIGEST_LENGTH,decoded_signature.get(),signature_len,(RSA*)EVP_PKEY_get0_RSA(pubkey.get())) == 1);
             return success;
         }catch(KnownUsers::KeyNotFound&)
         {
@@ -11,10 +11,11 @@ namespace network::authentication
      * @param data data to sign
      * @param signed_data signed data
      * @param username user that signed the data
+     * @param users where the key of the user is searched
      * @return true if the user signed the data
      * @return false if the user did not sign the data
      */
-    bool verify(const std::string& data, const std::string& signed_data, const std::string& username);
+    bool verify(const std::string& data, const std::string& signed_data, const std::string& username, KnownUsers& users = known_users);
     /**
      * @brief sign the data with the local private key
      * 
@@ -37,6 +38,8 @@ namespace network::authentication
     /**
      * @brief initialize the module
      * 
+     * @param known_users_format how the known users are stored, with the INDEX format the
+     * users of known_users.toml are imported the first time
      */
-    void init();
+    void init(KnownUsers::Format known_users_format = KnownUsers::Format::TOML);
 }
\ No newline at end of file
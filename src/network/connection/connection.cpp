@@ -7,6 +7,7 @@
 #include "../../logging/logging.hpp"
 #include "../../terminal/terminal.hpp"
 #include "../udp/udp.hpp"
+#include "../udp/wire/wire.hpp"
 #include "../ConnectionAction/ConnectionAction.hpp"
 #include "../MessageQueue/MessageQueue.hpp"
 #include "../authentication/authentication.hpp"
@@ -14,6 +15,8 @@
 namespace network::connection
 {
     MessageQueue connection_queue;
+    // anyone can send CONNECT/HANDSHAKE, so a flood must not block the listener: a dropped handshake times out and the connecting side retries it
+    constexpr udp::QueueOptions QUEUE_DEFAULTS = {1024,OverflowPolicy::drop_newest};
     std::string username;
     ConnectionAction default_action = ConnectionAction::PROMPT;
     std::vector<std::string> whitelist;
@@ -33,8 +36,9 @@ namespace network::connection
     {
         try
         {
-            std::unique_lock lock(udp::connection_map.obj);
-            auto& info = udp::connection_map[name];
+            auto peer = udp::connection_map[name];
+            std::unique_lock lock(peer->mutex);
+            auto& info = *peer;
             if(info.asymmetric_key.length() == 0)
             {
                 auto key = udp::crypto::gen_ecdhe_key();
@@ -51,8 +55,9 @@ namespace network::connection
     {
         try
         {
-            std::unique_lock lock(udp::connection_map.obj);
-            auto& info = udp::connection_map[name];
+            auto peer = udp::connection_map[name];
+            std::unique_lock lock(peer->mutex);
+            auto& info = *peer;
             info.encrypted = false;
             info.symmetric_key_valid = false;
             info.asymmetric_key = "";
@@ -90,57 +95,62 @@ namespace network::connection
     }
     void connection()
     {
+        parsing::Tokens args;
+        MessageQueueItem item;
         while(true)
         {
-            auto item = connection_queue.pull();
-            auto args = parsing::msg_split(item.msg);
+            connection_queue.pull(item);
+            parsing::tokenize(item.msg,args);
             if(args.size() > 0)
             {
                 std::unique_lock lock(status_map_mutex);
-                if(args[0] == "CONNECT" and args.size() == 5 and not udp::connection_map.check_user(args[1]))
+                if(args[0] == "CONNECT" and args.size() == 5 and not udp::connection_map.check_user(std::string(args[1])))
                 {
-                    if(check_whitelist(args[1]) or default_action == ConnectionAction::ACCEPT)
+                    std::string name{args[1]}, nonce{args[2]}, public_key{args[3]};
+                    if(check_whitelist(name) or default_action == ConnectionAction::ACCEPT)
                     {
-                        accept_connection(item.src_endpoint,args[1],args[2],args[3],item.msg);
+                        accept_connection(item.src_endpoint,name,nonce,public_key,item.msg);
                     }else if(default_action == ConnectionAction::REFUSE)
                     {
                         udp::send(parsing::compose_message({"DISCONNECT","connection refused"}),item.src_endpoint);
-                        logging::log("MSG","Connection refused automatically from \"" HIGHLIGHT +args[1]+ RESET "\"");
+                        logging::log("MSG","Connection refused automatically from \"" HIGHLIGHT +name+ RESET "\"");
                     }else
                         terminal::input(
-                            "User \"" HIGHLIGHT + args[1] + RESET 
+                            "User \"" HIGHLIGHT + name + RESET 
                             "\" (" HIGHLIGHT +item.src_endpoint.address().to_string()+ RESET 
                             ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET 
                             ") requested to connect, accept? (y/n)",
-                            [args,item](const std::string& input){
+                            [name,nonce,public_key,item](const std::string& input){
                                 if(input == "Y" or input == "y")
-                                    accept_connection(item.src_endpoint,args[1],args[2],args[3],item.msg);
+                                    accept_connection(item.src_endpoint,name,nonce,public_key,item.msg);
                                 else
                                 {
                                     udp::send(parsing::compose_message({"DISCONNECT","connection refused"}),item.src_endpoint);
-                                    logging::log("MSG","Connection refused from \"" HIGHLIGHT +args[1]+ RESET "\"");
+                                    logging::log("MSG","Connection refused from \"" HIGHLIGHT +name+ RESET "\"");
                                 }
                             });
                 }
                 else if(args[0] == "HANDSHAKE" and args.size() == 6 and status_map[item.src_endpoint].expected_message == "HANDSHAKE")
                 {
-                    authentication::known_users.add_key(args[1],args[4]);
+                    std::string name{args[1]};
+                    authentication::known_users.add_key(name,std::string(args[4]));
                     auto sent_nonce = status_map[item.src_endpoint].sent_nonce;
-                    if(parsing::verify_signature_from_message(item.msg,args[1]) and sent_nonce == args[3])
+                    if(parsing::verify_signature_from_message(item.msg,name) and sent_nonce == args[3])
                     {
                         status_map.erase(item.src_endpoint);
-                        udp::connection_map.add_user(args[1],item.src_endpoint);
-                        auto m = parsing::compose_message({"CONNECTED",args[2]});
+                        udp::connection_map.add_user(name,item.src_endpoint);
+                        auto m = parsing::compose_message({"CONNECTED",std::string(args[2])});
                         parsing::sign_and_append(m);
                         udp::send(m,item.src_endpoint);
-                        if(not udp::server_request_success(args[1]))
-                            logging::log("MSG","Connection accepted from " HIGHLIGHT + args[1] + RESET " at " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
+                        udp::send(parsing::compose_message({"BINARY",std::to_string(udp::wire::VERSION)}),item.src_endpoint);
+                        if(not udp::server_request_success(name))
+                            logging::log("MSG","Connection accepted from " HIGHLIGHT + name + RESET " at " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
                         if(autoencryption)
-                            start_encryption(args[1]);
+                            start_encryption(name);
                     }
                     else
                     {
-                        logging::log("ERR","Connection refused from \"" HIGHLIGHT + args[1] + RESET "\" because of an authentication error");
+                        logging::log("ERR","Connection refused from \"" HIGHLIGHT + name + RESET "\" because of an authentication error");
                         status_map.erase(item.src_endpoint);
                     }
                 }
@@ -152,6 +162,7 @@ namespace network::connection
                     {
                         status_map.erase(item.src_endpoint);
                         udp::connection_map.add_user(name,item.src_endpoint);
+                        udp::send(parsing::compose_message({"BINARY",std::to_string(udp::wire::VERSION)}),item.src_endpoint);
                         logging::log("MSG","Peer " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET " is now connected as user \"" HIGHLIGHT+name+RESET"\"");
                         if(autoencryption)
                             start_encryption(name);
@@ -166,28 +177,30 @@ namespace network::connection
                 {
                     std::string reason;
                     if(args.size() == 2)
-                        reason = args[1];
+                        reason = std::string(args[1]);
                     logging::received_disconnect_log(item.src,reason);
                     udp::connection_map.remove_user(item.src);
                 }
                 //REQUEST <to>
                 else if(args[0] == "REQUEST" and args.size() == 2)
                 {
+                    std::string name{args[1]};
                     try{
-                        auto key = authentication::known_users.get_key(args[1]);
-                        auto m = parsing::compose_message({"KEY",args[1],key});
+                        auto key = authentication::known_users.get_key(name);
+                        auto m = parsing::compose_message({"KEY",name,key});
                         parsing::sign_and_append(m);
                         udp::send(m,item.src_endpoint);
                     }catch(authentication::KnownUsers::KeyNotFound&)
                     {}
-                    if(not udp::connection_map.check_user(args[1]))
+                    if(not udp::connection_map.check_user(name))
                     {//not found
-                        udp::send(parsing::compose_message({"FAIL",args[1]}),item.src_endpoint);
+                        udp::send(parsing::compose_message({"FAIL",name}),item.src_endpoint);
                     }
                     else
                     {
-                        std::unique_lock lock(udp::connection_map.obj);
-                        auto& target = udp::connection_map[args[0]];
+                        auto peer = udp::connection_map[std::string(args[0])];
+                        std::unique_lock lock(peer->mutex);
+                        auto& target = *peer;
                         auto m = parsing::compose_message(
                             {"REQUESTED",
                             item.src,
@@ -199,40 +212,42 @@ namespace network::connection
                 }
                 else if(args[0] == "KEY" and args.size() == 4 and udp::connection_map.server() == item.src_endpoint)
                 {
+                    std::string name{args[1]};
                     if(parsing::verify_signature_from_message(item.msg,item.src))
-                        authentication::known_users.add_key(args[1],args[2]);
+                        authentication::known_users.add_key(name,std::string(args[2]));
                     else
                     {
-                        logging::log("ERR","Certificate sent from " HIGHLIGHT +item.src+ RESET " for the user " HIGHLIGHT + args[1] + RESET " was not valid, if you want to retry the connection (at your own risk) you can use the command \"key delete " HIGHLIGHT +parsing::compose_message({args[1]})+ RESET "\" and then retry to connect");
+                        logging::log("ERR","Certificate sent from " HIGHLIGHT +item.src+ RESET " for the user " HIGHLIGHT + name + RESET " was not valid, if you want to retry the connection (at your own risk) you can use the command \"key delete " HIGHLIGHT +parsing::compose_message({name})+ RESET "\" and then retry to connect");
                         //we disable the connection with the user because there is a risk of MiM attack
-                        authentication::known_users.replace_key(args[1],"");
+                        authentication::known_users.replace_key(name,"");
                     }
                 }
                 //REQUESTED <from> <at>
-                else if(args[0] == "REQUESTED" and args.size() == 5 and not udp::connection_map.check_user(args[1]) and udp::connection_map.server() == item.src_endpoint)
+                else if(args[0] == "REQUESTED" and args.size() == 5 and not udp::connection_map.check_user(std::string(args[1])) and udp::connection_map.server() == item.src_endpoint)
                 {
                     if(parsing::verify_signature_from_message(item.msg,item.src))
                     {
                         try{
-                            auto endpoint = parsing::endpoint_from_str(args[2]);
-                            if(check_whitelist(args[1]) or default_action == ConnectionAction::ACCEPT)
+                            auto endpoint = parsing::endpoint_from_str(std::string(args[2]));
+                            std::string name{args[1]}, public_key{args[3]};
+                            if(check_whitelist(name) or default_action == ConnectionAction::ACCEPT)
                             {
-                                accept_server_request(endpoint,args[1],args[3]);
+                                accept_server_request(endpoint,name,public_key);
                             }else if(default_action == ConnectionAction::REFUSE)
                             {
-                                logging::log("MSG","Connection refused automatically from \"" HIGHLIGHT +args[1]+ RESET "\"");
+                                logging::log("MSG","Connection refused automatically from \"" HIGHLIGHT +name+ RESET "\"");
                             }else
                                 terminal::input(
-                                    "User \"" HIGHLIGHT + args[1] + RESET 
+                                    "User \"" HIGHLIGHT + name + RESET 
                                     "\" (" HIGHLIGHT +endpoint.address().to_string()+ RESET 
                                     ":" HIGHLIGHT + std::to_string(endpoint.port()) + RESET 
                                     ") requested to connect, accept? (y/n)",
-                                    [args,item,endpoint](const std::string& input){
+                                    [name,public_key,endpoint](const std::string& input){
                                         if(input == "Y" or input == "y")
-                                            accept_server_request(endpoint,args[1],args[3]);
+                                            accept_server_request(endpoint,name,public_key);
                                         else
                                         {
-                                            logging::log("MSG","Connection refused from \"" HIGHLIGHT +args[1]+ RESET "\"");
+                                            logging::log("MSG","Connection refused from \"" HIGHLIGHT +name+ RESET "\"");
                                         }
                                 });
                         }catch(parsing::EndpointFromStrError&)
@@ -240,13 +255,28 @@ namespace network::connection
                     }
                     else
                     {
-                        logging::log("ERR","User " HIGHLIGHT +args[1]+ RESET " requested you at " HIGHLIGHT +item.src+ RESET "but its key was modified, for safety reasons the connection was interrupted");
+                        logging::log("ERR","User " HIGHLIGHT +std::string(args[1])+ RESET " requested you at " HIGHLIGHT +item.src+ RESET "but its key was modified, for safety reasons the connection was interrupted");
                     }
                 }
                 else if(args[0] == "FAIL" and args.size() == 2)
                 {
-                    udp::server_request_fail(args[1]);
-                    logging::log("ERR","User \"" HIGHLIGHT + args[1] + RESET "\" not found at " HIGHLIGHT + item.src + RESET);
+                    udp::server_request_fail(std::string(args[1]));
+                    logging::log("ERR","User \"" HIGHLIGHT + std::string(args[1]) + RESET "\" not found at " HIGHLIGHT + item.src + RESET);
+                }
+                // BINARY <wire version>
+                else if(args[0] == "BINARY" and args.size() == 2)
+                {
+                    if(args[1] == std::to_string(udp::wire::VERSION))
+                    {
+                        bool reply = false;
+                        {
+                            std::unique_lock lock(item.peer->mutex);
+                            reply = not item.peer->binary;
+                            item.peer->binary = true;
+                        }
+                        if(reply)
+                            udp::send(parsing::compose_message({"BINARY",std::string(args[1])}),item.src_endpoint);
+                    }
                 }
                 else if(DEBUG and args[0] == "TEST")
                 {
@@ -254,14 +284,14 @@ namespace network::connection
                 }
                 else if(args[0] == "PING" and args.size() == 2)
                 {
-                    udp::send(parsing::compose_message({"PONG",args[1]}),item.src_endpoint);
+                    udp::send(parsing::compose_message({"PONG",std::string(args[1])}),item.src_endpoint);
                     //logging::log("DBG","Handled ping from " HIGHLIGHT + item.src + RESET);
                 }
                 else if(args[0] == "PONG" and args.size() == 2)
                 {
-                    std::unique_lock lock(udp::connection_map.obj);
                     auto now = boost::posix_time::microsec_clock::local_time();
-                    auto& data = udp::connection_map[item.src];
+                    std::unique_lock lock(item.peer->mutex);
+                    auto& data = *item.peer;
                     if(std::to_string(data.last_ping_id) == args[1])
                     {//it's the last ping
                         data.last_ping_id = 0; // ping received
@@ -281,35 +311,32 @@ namespace network::connection
                 {
                     if(parsing::verify_signature_from_message(item.msg,item.src))
                     {
-                        try{
-                            std::unique_lock lock(udp::connection_map.obj);
-                            auto& user_info = udp::connection_map[item.src];
-                            if(not user_info.symmetric_key_valid)
-                            {
-                                auto key = udp::crypto::gen_ecdhe_key();
-                                try
-                                {
-                                    auto remote_key = udp::crypto::string_to_pubkey(args[1]);
-                                    user_info.asymmetric_key = udp::crypto::privkey_to_string(key.get());
-                                    user_info.symmetric_key = udp::crypto::ecdhe(key.get(),remote_key.get());
-                                    auto m = parsing::compose_message({"CRYPTACCEPT",udp::crypto::pubkey_to_string(key.get())});
-                                    parsing::sign_and_append(m);
-                                    udp::send(m,item.src_endpoint);
-                                    user_info.symmetric_key_valid = true;
-                                    user_info.crypt_requested = boost::posix_time::microsec_clock::local_time();
-                                }catch(std::runtime_error&)
-                                {}
-                            }
-                            else if(not user_info.encrypted)
+                        std::unique_lock lock(item.peer->mutex);
+                        auto& user_info = *item.peer;
+                        if(not user_info.symmetric_key_valid)
+                        {
+                            auto key = udp::crypto::gen_ecdhe_key();
+                            try
                             {
-                                auto key = udp::crypto::string_to_privkey(user_info.asymmetric_key);
+                                auto remote_key = udp::crypto::string_to_pubkey(std::string(args[1]));
+                                user_info.asymmetric_key = udp::crypto::privkey_to_string(key.get());
+                                user_info.symmetric_key = udp::crypto::ecdhe(key.get(),remote_key.get());
                                 auto m = parsing::compose_message({"CRYPTACCEPT",udp::crypto::pubkey_to_string(key.get())});
                                 parsing::sign_and_append(m);
                                 udp::send(m,item.src_endpoint);
+                                user_info.symmetric_key_valid = true;
                                 user_info.crypt_requested = boost::posix_time::microsec_clock::local_time();
-                            }
-                        }catch(DataMap::NotFound&)
-                        {}
+                            }catch(std::runtime_error&)
+                            {}
+                        }
+                        else if(not user_info.encrypted)
+                        {
+                            auto key = udp::crypto::string_to_privkey(user_info.asymmetric_key);
+                            auto m = parsing::compose_message({"CRYPTACCEPT",udp::crypto::pubkey_to_string(key.get())});
+                            parsing::sign_and_append(m);
+                            udp::send(m,item.src_endpoint);
+                            user_info.crypt_requested = boost::posix_time::microsec_clock::local_time();
+                        }
                     }
                     else
                     {// maybe MiM
@@ -321,31 +348,26 @@ namespace network::connection
                 {
                     if(parsing::verify_signature_from_message(item.msg,item.src))
                     {
-                        try
+                        std::unique_lock lock(item.peer->mutex);
+                        auto& user_info = *item.peer;
+                        if(user_info.asymmetric_key.length() != 0 and not user_info.encrypted)
                         {
-                            std::unique_lock lock(udp::connection_map.obj);
-                            auto& user_info = udp::connection_map[item.src];
-                            if(user_info.asymmetric_key.length() != 0 and not user_info.encrypted)
-                            {
-                                auto key = udp::crypto::string_to_privkey(user_info.asymmetric_key);
-                                try
-                                {
-                                    auto remote_key = udp::crypto::string_to_pubkey(args[1]);
-                                    user_info.symmetric_key = udp::crypto::ecdhe(key.get(),remote_key.get());
-                                    udp::send(parsing::compose_message({"CRYPTACK"}),item.src_endpoint);
-                                    user_info.encrypted = true;
-                                    user_info.crypt_requested = boost::posix_time::ptime{};
-                                    logging::log("MSG","Connection with " HIGHLIGHT +item.src+ RESET " is now encrypted");
-                                }catch(std::runtime_error&)
-                                {}
-                            }
-                            else if(user_info.asymmetric_key.length() !=0 and user_info.encrypted)
+                            auto key = udp::crypto::string_to_privkey(user_info.asymmetric_key);
+                            try
                             {
+                                auto remote_key = udp::crypto::string_to_pubkey(std::string(args[1]));
+                                user_info.symmetric_key = udp::crypto::ecdhe(key.get(),remote_key.get());
                                 udp::send(parsing::compose_message({"CRYPTACK"}),item.src_endpoint);
-                            }
+                                user_info.encrypted = true;
+                                user_info.crypt_requested = boost::posix_time::ptime{};
+                                logging::log("MSG","Connection with " HIGHLIGHT +item.src+ RESET " is now encrypted");
+                            }catch(std::runtime_error&)
+                            {}
+                        }
+                        else if(user_info.asymmetric_key.length() !=0 and user_info.encrypted)
+                        {
+                            udp::send(parsing::compose_message({"CRYPTACK"}),item.src_endpoint);
                         }
-                        catch(DataMap::NotFound&)
-                        {}
                     }
                     else
                     {
@@ -355,44 +377,34 @@ namespace network::connection
                 // CRYPTSTOP
                 else if(args[0] == "CRYPTSTOP" and args.size() == 1)
                 {
-                    try
-                    {
-                        std::unique_lock lock(udp::connection_map.obj);
-                        auto& user_info = udp::connection_map[item.src];
-                        if(user_info.asymmetric_key.length() != 0 and not user_info.encrypted)
-                            logging::log("ERR","Encryption refused from " HIGHLIGHT +item.src+ RESET); 
-                        else if(user_info.encrypted)       
-                            logging::log("MSG","User " HIGHLIGHT +item.src+ RESET " stopped the encryption");    
-                        user_info.asymmetric_key = "";
-                        user_info.encrypted = false;
-                    }
-                    catch(DataMap::NotFound&)
-                    {}
+                    std::unique_lock lock(item.peer->mutex);
+                    auto& user_info = *item.peer;
+                    if(user_info.asymmetric_key.length() != 0 and not user_info.encrypted)
+                        logging::log("ERR","Encryption refused from " HIGHLIGHT +item.src+ RESET); 
+                    else if(user_info.encrypted)       
+                        logging::log("MSG","User " HIGHLIGHT +item.src+ RESET " stopped the encryption");    
+                    user_info.asymmetric_key = "";
+                    user_info.encrypted = false;
                 }
                 else if(args[0] == "CRYPTACK" and args.size() == 1)
                 {
-                    try
+                    std::unique_lock lock(item.peer->mutex);
+                    auto& user_info = *item.peer;
+                    if(not user_info.encrypted)
                     {
-                        std::unique_lock lock(udp::connection_map.obj);
-                        auto& user_info = udp::connection_map[item.src];
-                        if(not user_info.encrypted)
+                        if(user_info.asymmetric_key.length() != 0 and user_info.symmetric_key_valid)
                         {
-                            if(user_info.asymmetric_key.length() != 0 and user_info.symmetric_key_valid)
-                            {
-                                user_info.encrypted = true;
-                                logging::log("MSG","Connection with " HIGHLIGHT +item.src+ RESET " is now encrypted");
-                            }
-                            else
-                            {
-                                stop_encryption(item.src);
-                            }
+                            user_info.encrypted = true;
+                            logging::log("MSG","Connection with " HIGHLIGHT +item.src+ RESET " is now encrypted");
+                        }
+                        else
+                        {
+                            stop_encryption(item.src);
                         }
                     }
-                    catch(DataMap::NotFound&)
-                    {}
                 }
                 else {
-                    logging::log("DBG","Dropped " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
+                    logging::log("DBG","Dropped " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
                 }
             }
         }
@@ -419,6 +431,7 @@ namespace network::connection
             logging::log("ERR","Error in configuration file at network.connection.default_action: this must be one of \"accept\", \"refuse\" or \"prompt\", \"prompt\" was selected as default");
         }
         
+        udp::setup_queue("connection",connection_queue,QUEUE_DEFAULTS);
         udp::register_queue("CONNECT",connection_queue,false);
         udp::register_queue("HANDSHAKE",connection_queue,false);
         udp::register_queue("CONNECTED",connection_queue,false);
@@ -429,6 +442,7 @@ namespace network::connection
         udp::register_queue("FAIL",connection_queue,true);
         udp::register_queue("PING",connection_queue,true);
         udp::register_queue("PONG",connection_queue,true);
+        udp::register_queue("BINARY",connection_queue,true);
         udp::register_queue("CRYPTSTART",connection_queue,true);
         udp::register_queue("CRYPTACCEPT",connection_queue,true);
         udp::register_queue("CRYPTSTOP",connection_queue,true);
@@ -440,8 +454,7 @@ namespace network::connection
     bool connect(const boost::asio::ip::udp::endpoint& endpoint,const std::string& expected_name)
     {
         try{//already connected
-            std::unique_lock lock(udp::connection_map.obj);
-            auto name = udp::connection_map[endpoint].name;
+            auto name = udp::connection_map[endpoint]->name;
             logging::log("ERR","You are already connected with " HIGHLIGHT +name+ RESET " at " HIGHLIGHT + endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(endpoint.port()) + RESET);
             return false;
         }catch(DataMap::NotFound&)
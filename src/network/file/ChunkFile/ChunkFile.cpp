@@ -0,0 +1,197 @@
+#include "ChunkFile.hpp"
+#include <filesystem>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+namespace network::file
+{
+    ChunkFile::ChunkFile(ChunkFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+    ChunkFile& ChunkFile::operator=(ChunkFile&& other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        close();
+        file_size = other.file_size;
+        temporary_path = std::move(other.temporary_path);
+        other.temporary_path.clear();
+        #ifdef _WIN32
+        stream = std::move(other.stream);
+        #else
+        fd = other.fd;
+        other.fd = -1;
+        #endif
+        return *this;
+    }
+    ChunkFile::~ChunkFile()
+    {
+        close();
+    }
+    void ChunkFile::close()
+    {
+        #ifdef _WIN32
+        if(stream.is_open())
+            stream.close();
+        #else
+        if(fd != -1)
+            ::close(fd);
+        fd = -1;
+        #endif
+        if(not temporary_path.empty())
+        {
+            std::error_code ec;
+            std::filesystem::remove(temporary_path,ec);
+            temporary_path.clear();
+        }
+    }
+    ChunkFile ChunkFile::open_read(const std::string& path)
+    {
+        ChunkFile ret;
+        #ifdef _WIN32
+        ret.stream.open(path,std::ios::in|std::ios::binary);
+        if(not ret.stream)
+            throw OpenError{};
+        ret.stream.seekg(0,std::ios::end);
+        ret.file_size = ret.stream.tellg();
+        #else
+        ret.fd = ::open(path.c_str(),O_RDONLY);
+        if(ret.fd == -1)
+            throw OpenError{};
+        struct stat info;
+        if(fstat(ret.fd,&info) != 0 or not S_ISREG(info.st_mode))
+            throw OpenError{};
+        ret.file_size = info.st_size;
+        #ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(ret.fd,0,0,POSIX_FADV_SEQUENTIAL);
+        #endif
+        #endif
+        return ret;
+    }
+    ChunkFile ChunkFile::create_temporary(const std::string& path, size_t size)
+    {
+        ChunkFile ret;
+        #ifdef _WIN32
+        ret.stream.open(path,std::ios::in|std::ios::out|std::ios::trunc|std::ios::binary);
+        if(not ret.stream)
+            throw OpenError{};
+        ret.temporary_path = path;
+        std::error_code ec;
+        std::filesystem::resize_file(path,size,ec);
+        if(ec)
+            throw OpenError{};
+        #else
+        ret.fd = ::open(path.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+        if(ret.fd == -1)
+            throw OpenError{};
+        ret.temporary_path = path;
+        #ifdef __linux__
+        // reserve the space now so that the download can't fail halfway because the disk is full
+        if(size != 0 and posix_fallocate(ret.fd,0,(off_t)size) != 0 and ftruncate(ret.fd,(off_t)size) != 0)
+            throw OpenError{};
+        #else
+        if(ftruncate(ret.fd,(off_t)size) != 0)
+            throw OpenError{};
+        #endif
+        #endif
+        ret.file_size = size;
+        return ret;
+    }
+    size_t ChunkFile::size() const
+    {
+        return file_size;
+    }
+    bool ChunkFile::read(size_t offset, char* out, size_t length)
+    {
+        if(offset + length > file_size)
+            return false;
+        #ifdef _WIN32
+        stream.seekg(offset);
+        stream.read(out,length);
+        return (size_t)stream.gcount() == length;
+        #else
+        size_t done = 0;
+        while(done < length)
+        {
+            auto n = pread(fd,out+done,length-done,(off_t)(offset+done));
+            if(n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+        #endif
+    }
+    bool ChunkFile::write(size_t offset, std::string_view data)
+    {
+        if(offset + data.length() > file_size)
+            return false;
+        #ifdef _WIN32
+        stream.seekp(offset);
+        stream.write(data.data(),data.length());
+        return (bool)stream;
+        #else
+        size_t done = 0;
+        while(done < data.length())
+        {
+            auto n = pwrite(fd,data.data()+done,data.length()-done,(off_t)(offset+done));
+            if(n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+        #endif
+    }
+    bool ChunkFile::commit(const std::string& path)
+    {
+        if(temporary_path.empty())
+            return false;
+        #ifdef _WIN32
+        stream.flush();
+        bool synced = (bool)stream;
+        stream.close();
+        #else
+        bool synced = fsync(fd) == 0;
+        synced = ::close(fd) == 0 and synced;
+        fd = -1;
+        #endif
+        if(not synced)
+        {
+            close();
+            return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary_path,path,ec);
+        if(ec)
+        {
+            close();
+            return false;
+        }
+        temporary_path.clear();
+        // without this a crash could still lose the completed file
+        return sync_path(std::filesystem::absolute(path).parent_path().string(),true);
+    }
+    bool ChunkFile::sync_path(const std::string& path, bool directory)
+    {
+        #ifdef _WIN32
+        if(directory)// the entries of a directory can't be synced
+            return true;
+        int fd = _open(path.c_str(),_O_RDWR|_O_BINARY);
+        if(fd == -1)
+            return false;
+        bool synced = _commit(fd) == 0;
+        return _close(fd) == 0 and synced;
+        #else
+        int fd = ::open(path.c_str(),directory ? O_RDONLY|O_DIRECTORY : O_RDWR);
+        if(fd == -1)
+            return false;
+        bool synced = fsync(fd) == 0;
+        return ::close(fd) == 0 and synced;
+        #endif
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <exception>
+#ifdef _WIN32
+#include <fstream>
+#endif
+namespace network::file
+{
+    /**
+     * @brief a file accessed by offset without loading it in memory, used to
+     * read the chunks of an upload and to write the chunks of a download in a
+     * temporary file that is renamed only when the download is completed
+     * 
+     */
+    class ChunkFile
+    {
+    public:
+        /**
+         * @brief thrown when the file can't be opened or created
+         * 
+         */
+        class OpenError: public std::exception
+        {
+        public:
+            const char* what(){return "OpenError";}
+        };
+        ChunkFile() = default;
+        ChunkFile(ChunkFile&& other) noexcept;
+        ChunkFile& operator=(ChunkFile&& other) noexcept;
+        ChunkFile(const ChunkFile&) = delete;
+        ChunkFile& operator=(const ChunkFile&) = delete;
+        /**
+         * @brief close the file, if it's a temporary file that was not committed it is deleted
+         * 
+         */
+        ~ChunkFile();
+        /**
+         * @brief open an existing file for reading, throws OpenError if it can't be opened
+         * 
+         * @param path path of the file
+         * @return the opened file
+         */
+        static ChunkFile open_read(const std::string& path);
+        /**
+         * @brief create a temporary file of the given size for writing, throws OpenError if it can't be created
+         * 
+         * @param path path of the temporary file, it is deleted if the file is not committed
+         * @param size the size of the file, the space is reserved immediately if the file system supports it
+         * @return the created file
+         */
+        static ChunkFile create_temporary(const std::string& path, size_t size);
+        /**
+         * @brief size of the file in bytes
+         * 
+         */
+        size_t size() const;
+        /**
+         * @brief read part of the file
+         * 
+         * @param offset position of the first byte to read
+         * @param out where the data is written, at least length bytes
+         * @param length how many bytes to read
+         * @return true if exactly length bytes were read
+         */
+        bool read(size_t offset, char* out, size_t length);
+        /**
+         * @brief write part of the file
+         * 
+         * @param offset position of the first byte to write
+         * @param data the data to write
+         * @return true if the whole data was written
+         */
+        bool write(size_t offset, std::string_view data);
+        /**
+         * @brief flush a temporary file to disk, close it and move it to its final path, then sync the directory
+         * 
+         * @param path the final path, if it exists it's replaced
+         * @return true if the file was moved and the move is on disk
+         */
+        bool commit(const std::string& path);
+        /**
+         * @brief write to disk what the system is caching for a file, or for the entries of a directory
+         * 
+         * @param path path of the file or of the directory
+         * @param directory true if path is a directory, a rename is only on disk once its directory is synced
+         * @return false if the data could not be written
+         */
+        static bool sync_path(const std::string& path, bool directory = false);
+    private:
+        void close();
+        size_t file_size = 0;
+        // empty if the file is not temporary or was already committed
+        std::string temporary_path;
+        #ifdef _WIN32
+        std::fstream stream;
+        #else
+        int fd = -1;
+        #endif
+    };
+}
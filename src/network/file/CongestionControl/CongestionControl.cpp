@@ -0,0 +1,103 @@
+#include "CongestionControl.hpp"
+#include <algorithm>
+namespace network::file
+{
+    // pacing is faster than cwnd/rtt so that the window can actually be filled
+    constexpr double SLOW_START_PACING_GAIN = 2.0;
+    constexpr double PACING_GAIN = 1.25;
+    const boost::posix_time::time_duration DEFAULT_RTT = boost::posix_time::milliseconds(100);
+    const boost::posix_time::time_duration MIN_RTO = boost::posix_time::milliseconds(100);
+    const boost::posix_time::time_duration MAX_RTO = boost::posix_time::seconds(5);
+    // how much of the highest delivery rate is kept for each new sample
+    constexpr double DELIVERY_RATE_DECAY = 0.9;
+    // a window of this many bandwidth-delay products keeps the link busy while ACKs are delayed or lost
+    constexpr double BDP_WINDOW_GAIN = 2.0;
+
+    CongestionControl::CongestionControl(boost::posix_time::time_duration initial_rtt)
+    {
+        if(initial_rtt > boost::posix_time::time_duration{})
+        {
+            srtt = initial_rtt;
+            rttvar = initial_rtt/2;
+        }
+        else
+        {
+            srtt = DEFAULT_RTT;
+            rttvar = DEFAULT_RTT/2;
+        }
+    }
+    void CongestionControl::on_ack(size_t acked_chunks, boost::posix_time::time_duration rtt_sample)
+    {
+        if(rtt_sample > boost::posix_time::time_duration{})
+        {// RFC 6298
+            if(not has_rtt_sample or rtt_sample < min_rtt)
+                min_rtt = rtt_sample;
+            if(not has_rtt_sample)
+            {
+                srtt = rtt_sample;
+                rttvar = rtt_sample/2;
+                has_rtt_sample = true;
+            }
+            else
+            {
+                auto delta = srtt > rtt_sample ? srtt - rtt_sample : rtt_sample - srtt;
+                rttvar = rttvar*3/4 + delta/4;
+                srtt = srtt*7/8 + rtt_sample/8;
+            }
+        }
+        if(cwnd < ssthresh)
+            cwnd += (double)acked_chunks;
+        else
+            cwnd += (double)acked_chunks/cwnd;
+        cwnd = std::min(cwnd,MAX_WINDOW);
+    }
+    void CongestionControl::on_delivery_rate(double bytes_per_second)
+    {
+        max_delivery_rate = std::max(bytes_per_second,max_delivery_rate*DELIVERY_RATE_DECAY);
+    }
+    void CongestionControl::on_loss(const boost::posix_time::ptime& now, size_t chunk_size)
+    {
+        if(not last_reduction.is_not_a_date_time() and now - last_reduction < srtt)
+            return;
+        last_reduction = now;
+        // if the link is still delivering the whole window the loss is not caused by congestion and the window is kept
+        double window = bdp_window(chunk_size);
+        if(window >= cwnd)
+            return;
+        ssthresh = std::clamp(std::max(cwnd/2,window),MIN_WINDOW,MAX_WINDOW);
+        cwnd = ssthresh;
+    }
+    void CongestionControl::on_timeout(size_t chunk_size)
+    {
+        // slow start is repeated up to the window the link was delivering
+        ssthresh = std::clamp(std::max(cwnd/2,bdp_window(chunk_size)),MIN_WINDOW,MAX_WINDOW);
+        cwnd = MIN_WINDOW;
+        // exponential backoff
+        rttvar = std::min(rttvar*2,MAX_RTO);
+    }
+    double CongestionControl::bdp_window(size_t chunk_size) const
+    {
+        if(not has_rtt_sample)
+            return 0;
+        // the bandwidth-delay product measured from the delivery rate and the round trip time without queues
+        double bdp = max_delivery_rate * (double)min_rtt.total_microseconds() * 1e-6 / (double)chunk_size;
+        return bdp*BDP_WINDOW_GAIN;
+    }
+    size_t CongestionControl::window() const
+    {
+        return (size_t)cwnd;
+    }
+    boost::posix_time::time_duration CongestionControl::rtt() const
+    {
+        return srtt;
+    }
+    boost::posix_time::time_duration CongestionControl::rto() const
+    {
+        return std::clamp(srtt + rttvar*4,MIN_RTO,MAX_RTO);
+    }
+    boost::posix_time::time_duration CongestionControl::pacing_interval() const
+    {
+        double gain = cwnd < ssthresh ? SLOW_START_PACING_GAIN : PACING_GAIN;
+        return boost::posix_time::microseconds((long long)((double)srtt.total_microseconds() / (cwnd*gain)));
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace network::file
+{
+    /**
+     * @brief congestion window of an upload, measured in chunks.
+     * The window grows exponentially (slow start) and then linearly (congestion avoidance)
+     * when chunks are acknowledged and is halved when a loss is detected (AIMD).
+     * Chunks are paced so that a whole window is spread over a round trip time
+     * 
+     */
+    class CongestionControl
+    {
+    public:
+        // the window never goes below this
+        static constexpr double MIN_WINDOW = 2;
+        // the window never goes above this
+        static constexpr double MAX_WINDOW = 8192;
+        // window at the start of a transfer
+        static constexpr double INITIAL_WINDOW = 10;
+        /**
+         * @brief create the controller for a new transfer
+         * 
+         * @param initial_rtt an estimate of the round trip time (for example PeerData::avg_latency),
+         * it's used until the first sample is measured, it can be zero if unknown
+         */
+        explicit CongestionControl(boost::posix_time::time_duration initial_rtt = {});
+        /**
+         * @brief new chunks were acknowledged
+         * 
+         * @param acked_chunks how many chunks were acknowledged for the first time
+         * @param rtt_sample the round trip time measured for this ACK, zero if it could not be measured
+         */
+        void on_ack(size_t acked_chunks, boost::posix_time::time_duration rtt_sample);
+        /**
+         * @brief a new throughput sample, measured over a round trip. The highest recent sample is kept
+         * 
+         * @param bytes_per_second bytes acknowledged in a second
+         */
+        void on_delivery_rate(double bytes_per_second);
+        /**
+         * @brief a chunk was lost (duplicate ACKs), the window is reduced at most once per round trip.
+         * The window is not reduced below twice the bandwidth-delay product measured with the highest delivery rate
+         * and the minimum round trip time, so random losses on a link that is not congested don't reduce it
+         * 
+         * @param now current time
+         * @param chunk_size the size of a chunk in bytes
+         */
+        void on_loss(const boost::posix_time::ptime& now, size_t chunk_size);
+        /**
+         * @brief nothing was acknowledged for a whole retransmission timeout, the window restarts from the minimum
+         * 
+         * @param chunk_size the size of a chunk in bytes
+         */
+        void on_timeout(size_t chunk_size);
+        /**
+         * @brief how many chunks can be in flight
+         * 
+         */
+        size_t window() const;
+        /**
+         * @brief smoothed round trip time
+         * 
+         */
+        boost::posix_time::time_duration rtt() const;
+        /**
+         * @brief retransmission timeout (srtt + 4*rttvar, bounded)
+         * 
+         */
+        boost::posix_time::time_duration rto() const;
+        /**
+         * @brief time between two chunks so that the window is spread over a round trip
+         * 
+         */
+        boost::posix_time::time_duration pacing_interval() const;
+    private:
+        // twice the bandwidth-delay product in chunks, zero if it was not measured yet
+        double bdp_window(size_t chunk_size) const;
+        double cwnd = INITIAL_WINDOW;
+        double ssthresh = MAX_WINDOW;
+        boost::posix_time::time_duration srtt;
+        boost::posix_time::time_duration rttvar;
+        // the smallest round trip time measured, the delay of the link without queues
+        boost::posix_time::time_duration min_rtt;
+        // bytes/s, the highest delivery rate measured, it decays with every new sample
+        double max_delivery_rate = 0;
+        bool has_rtt_sample = false;
+        // the last time the window was reduced, losses in the same round trip are a single event
+        boost::posix_time::ptime last_reduction;
+    };
+}
@@ -1,15 +1,19 @@
 #include "file.hpp"
 #include "../../defines.hpp"
 #include "../../ansi_escape.hpp"
-#include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
+#include <queue>
+#include <optional>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <boost/thread.hpp>
 #include "../MessageQueue/MessageQueue.hpp"
 #include "../../logging/logging.hpp"
 #include "../udp/DataMap/DataMap.hpp"
 #include "../udp/udp.hpp"
+#include "../udp/wire/wire.hpp"
 #include "../../multithreading/multithreading.hpp"
 #include "../../parsing/parsing.hpp"
 #include "../../terminal/terminal.hpp"
@@ -17,11 +21,17 @@
 namespace network::file
 {
     MessageQueue file_queue;
+    // a chunk dropped by a full queue is recovered like one lost on the network
+    constexpr udp::QueueOptions QUEUE_DEFAULTS = {4096,OverflowPolicy::drop_newest};
     constexpr size_t CHUNK_SIZE = 1024;
     constexpr unsigned int ACK_EVERY = 100;//milliseconds if no new packets received
+    constexpr size_t ACK_EVERY_CHUNKS = 2; // in order chunks received before sending an ACK
+    constexpr size_t MAX_SACK_CHUNKS = 1024; // chunks after the ACK described by the selective ACK bitmap
+    constexpr int REORDERING_WINDOW_DIVISOR = 4; // a chunk is lost if one sent rtt/4 after it was received
     constexpr unsigned int ACCEPT_TIMEOUT = 10; // seconds
     constexpr double TP_EXP_AVG_ALPHA = 0.1;
-    size_t window_size = 10; // CHUNKS
+    // the sender can fall this much behind the pacing schedule and catch up sending a burst
+    const boost::posix_time::time_duration MAX_PACING_BURST = boost::posix_time::milliseconds(1);
     size_t FileTransferInfo::chunk_count(size_t data_size)
     {
         size_t ret = data_size/CHUNK_SIZE;
@@ -55,19 +65,24 @@ namespace network::file
     FileTransferInfo FileTransferInfo::prepare_for_upload(
             const std::string& file_name,
             const std::string& username,
-            const std::vector<unsigned char>& data)
+            ChunkFile&& storage,
+            boost::posix_time::time_duration rtt)
     {
         FileTransferInfo ret;
         ret.file_name = file_name;
         ret.username = username;
         ret.accepted = false;
-        ret.data = data;
-        ret.received_chunks = std::vector<bool>(chunk_count(data.size()),false);
+        ret.file_size = storage.size();
+        ret.storage = std::move(storage);
+        ret.received_chunks = std::vector<bool>(chunk_count(ret.file_size),false);
         ret.next_sequence_number = 0;
         ret.last_acked_number = 0;
         ret.average_throughput = 0;
         ret.direction = FileTransferDirection::upload;
         ret.last_ack = boost::posix_time::microsec_clock::local_time();
+        ret.congestion = CongestionControl(rtt);
+        ret.last_progress = ret.last_ack;
+        ret.next_send = ret.last_ack;
         return ret;
     }
     FileTransferInfo FileTransferInfo::prepare_for_download(
@@ -75,11 +90,14 @@ namespace network::file
         const std::string& username, 
         size_t file_size)
     {
+        static std::atomic<unsigned int> download_id = 0;
         FileTransferInfo ret;
         ret.file_name = file_name;
         ret.username = username;
         ret.accepted = true;
-        ret.data = std::vector<unsigned char>(file_size);
+        ret.file_size = file_size;
+        std::filesystem::create_directories(DOWNLOAD_PATH);
+        ret.storage = ChunkFile::create_temporary(DOWNLOAD_PATH+file_name+"."+std::to_string(download_id++)+".part",file_size);
         ret.received_chunks = std::vector<bool>(chunk_count(file_size),false);
         ret.next_sequence_number = 0;
         ret.last_acked_number = 0;
@@ -89,335 +107,606 @@ namespace network::file
         return ret;
     }
     std::mutex file_transfers_mutex;
-    std::map<std::string,FileTransferInfo> file_transfers;
-    std::string hash(const std::vector<unsigned char>& file_content)
+    std::map<std::string,std::shared_ptr<FileTransfer>,std::less<>> uploads;
+    std::map<std::string,std::shared_ptr<FileTransfer>,std::less<>> downloads;
+    struct ScheduledTransfer
+    {
+        boost::posix_time::ptime time;
+        std::weak_ptr<FileTransfer> transfer;
+        bool operator>(const ScheduledTransfer& other) const
+        {
+            return time > other.time;
+        }
+    };
+    /**
+     * @brief transfers waiting for file_sender, the earliest first. A transfer can have older entries
+     * that don't match FileTransfer::wake_up anymore, they are skipped
+     * 
+     */
+    boost::mutex scheduler_mutex;
+    boost::condition_variable scheduler_ready;
+    std::priority_queue<ScheduledTransfer,std::vector<ScheduledTransfer>,std::greater<>> scheduled_transfers;
+    // file_sender will handle the transfer at "time" or earlier if it's already scheduled earlier, transfer->mutex must be locked
+    void _schedule(const std::shared_ptr<FileTransfer>& transfer, const boost::posix_time::ptime& time)
+    {
+        if(not transfer->wake_up.is_not_a_date_time() and transfer->wake_up <= time)
+            return;
+        transfer->wake_up = time;
+        {
+            boost::unique_lock lock(scheduler_mutex);
+            scheduled_transfers.push({time,transfer});
+        }
+        scheduler_ready.notify_one();
+    }
+    std::shared_ptr<FileTransfer> _find(std::map<std::string,std::shared_ptr<FileTransfer>,std::less<>>& transfers, std::string_view file_hash)
+    {
+        std::unique_lock lock(file_transfers_mutex);
+        auto transfer = transfers.find(file_hash);
+        if(transfer == transfers.end())
+            return nullptr;
+        return transfer->second;
+    }
+    // remove a transfer from uploads/downloads, transfer.mutex must be locked
+    void _remove(FileTransfer& transfer)
     {
-        std::unique_ptr<unsigned char> md{new unsigned char[SHA384_DIGEST_LENGTH]};
-        std::unique_ptr<char> b64md{new char[b64e_size(SHA384_DIGEST_LENGTH)+1]};
-        SHA384(file_content.data(),file_content.size(),md.get());
-        b64_encode(md.get(),SHA384_DIGEST_LENGTH,(unsigned char*)b64md.get());
+        transfer.active = false;
+        std::unique_lock lock(file_transfers_mutex);
+        auto& transfers = transfer.info.direction == FileTransferDirection::upload ? uploads : downloads;
+        auto it = transfers.find(transfer.file_hash);
+        if(it != transfers.end() and it->second.get() == &transfer)
+            transfers.erase(it);
+    }
+    // the file is hashed reading a block at a time
+    std::string hash(ChunkFile& file)
+    {
+        constexpr size_t HASH_BLOCK_SIZE = 1<<16;
+        std::unique_ptr<char[]> block{new char[HASH_BLOCK_SIZE]};
+        unsigned char md[SHA384_DIGEST_LENGTH];
+        std::unique_ptr<char[]> b64md{new char[b64e_size(SHA384_DIGEST_LENGTH)+1]};
+        std::unique_ptr<EVP_MD_CTX,decltype(&::EVP_MD_CTX_free)> context{EVP_MD_CTX_new(),EVP_MD_CTX_free};
+        EVP_DigestInit_ex(context.get(),EVP_sha384(),nullptr);
+        for(size_t offset = 0; offset < file.size(); offset += HASH_BLOCK_SIZE)
+        {
+            auto length = std::min(HASH_BLOCK_SIZE,file.size()-offset);
+            if(not file.read(offset,block.get(),length))
+                throw FileNotFound{};
+            EVP_DigestUpdate(context.get(),block.get(),length);
+        }
+        EVP_DigestFinal_ex(context.get(),md,nullptr);
+        b64_encode(md,SHA384_DIGEST_LENGTH,(unsigned char*)b64md.get());
         return b64md.get();
     }
     bool init_file_upload(const std::string& to, const std::string& filename)
     {
         if(not udp::connection_map.check_user(to))
             throw UserNotFound{};
-        std::fstream f{filename,std::ios::in|std::ios::binary};
-        if(not f)
+        ChunkFile storage;
+        try
+        {
+            storage = ChunkFile::open_read(filename);
+        }
+        catch(ChunkFile::OpenError&)
+        {
             throw FileNotFound{};
-        f.seekg(0,std::ios::end);
-        auto file_size = f.tellg();
-        f.seekg(0,std::ios::beg);
-        std::vector<unsigned char> file_data(file_size);
-        f.read((char*)file_data.data(),file_size);
-        FileTransferInfo info = FileTransferInfo::prepare_for_upload(
+        }
+        auto file_hash = hash(storage);
+        boost::posix_time::time_duration rtt;
+        try
+        {
+            auto peer = udp::connection_map[to];
+            std::unique_lock lock(peer->mutex);
+            rtt = peer->avg_latency;
+        }
+        catch(DataMap::NotFound&)
+        {
+            throw UserNotFound{};
+        }
+        auto transfer = std::make_shared<FileTransfer>();
+        transfer->info = FileTransferInfo::prepare_for_upload(
             std::filesystem::path(filename).filename().string(),
             to,
-            file_data
+            std::move(storage),
+            rtt
         );
-        auto file_hash = hash(file_data);
-        std::unique_lock lock(file_transfers_mutex);
-        if(file_transfers.find(file_hash) != file_transfers.end())
-            return false;
-        file_transfers[file_hash] = info;
-        udp::send(parsing::compose_message({"FILEINIT",file_hash,std::to_string(info.data.size()),info.file_name}),to);
+        transfer->file_hash = file_hash;
+        {
+            std::unique_lock lock(file_transfers_mutex);
+            if(not uploads.try_emplace(file_hash,transfer).second)
+                return false;
+        }
+        std::unique_lock lock(transfer->mutex);
+        udp::send(parsing::compose_message({"FILEINIT",file_hash,std::to_string(transfer->info.file_size),transfer->info.file_name}),to);
+        // if it's not accepted in time the transfer is removed
+        _schedule(transfer,transfer->info.last_ack + boost::posix_time::seconds(ACCEPT_TIMEOUT));
         return true;
     }
     bool init_file_download(const std::string& from, const std::string& file_hash, size_t file_size, const std::string& file_name)
     {
-        FileTransferInfo info = FileTransferInfo::prepare_for_download(
-            parsing::clean_file_name(file_name),
-            from,
-            file_size
-        );
-        std::unique_lock lock(file_transfers_mutex);
-        if(file_transfers.find(file_hash) != file_transfers.end())
+        if(_find(downloads,file_hash) != nullptr)
+            return false;
+        auto transfer = std::make_shared<FileTransfer>();
+        try
+        {
+            transfer->info = FileTransferInfo::prepare_for_download(
+                parsing::clean_file_name(file_name),
+                from,
+                file_size
+            );
+        }
+        catch(std::exception&)
+        {// ChunkFile::OpenError or a filesystem error
             return false;
-        file_transfers[file_hash] = info;
-        udp::send(parsing::compose_message({"FILEACK",file_hash,"0"}),from);
+        }
+        transfer->file_hash = file_hash;
+        {
+            std::unique_lock lock(file_transfers_mutex);
+            if(not downloads.try_emplace(file_hash,transfer).second)
+                return false;
+        }
+        std::unique_lock lock(transfer->mutex);
+        udp::send({"FILEACK",file_hash,"0"},from);
+        _schedule(transfer,transfer->info.last_ack + boost::posix_time::milliseconds(ACK_EVERY));
         return true;
     }
-    bool _finalize_file_download(const std::string& file_hash)
+    // FILEACK <file hash> <next sequence number> [<selective ACK bitmap>], the bitmap is added only
+    // if some chunks after the next sequence number were received
+    void _send_ack(std::string_view file_hash, FileTransferInfo& info, const boost::asio::ip::udp::endpoint& endpoint)
     {
-        if(file_transfers.find(file_hash) == file_transfers.end())
-            return false;
-        auto& info = file_transfers[file_hash];
-        if(info.next_sequence_number != info.data.size())
-            return false;
-        std::filesystem::create_directories(DOWNLOAD_PATH);
-        std::fstream f{DOWNLOAD_PATH+info.file_name,std::ios::out|std::ios::trunc|std::ios::binary};
-        f.write((char*)info.data.data(),info.data.size());
-        logging::log("MSG","File from " HIGHLIGHT + info.username + RESET " saved at \"" HIGHLIGHT +DOWNLOAD_PATH+info.file_name+ RESET "\"");
-        file_transfers.erase(file_hash);
-        return true;
+        std::string sack;
+        auto first = info.next_sequence_number/CHUNK_SIZE + 1;
+        auto last = std::min(info.received_chunks.size(),first + MAX_SACK_CHUNKS);
+        for(size_t i = first; i < last; i++)
+        {
+            if(info.received_chunks[i])
+            {
+                auto bit = i - first;
+                if(sack.length() <= bit/8)
+                    sack.resize(bit/8 + 1,'\0');
+                sack[bit/8] |= (char)(1u << (bit%8));
+            }
+        }
+        if(sack.empty())
+            udp::send({"FILEACK",std::string(file_hash),std::to_string(info.next_sequence_number)},endpoint);
+        else
+            udp::send({"FILEACK",std::string(file_hash),std::to_string(info.next_sequence_number),sack},endpoint);
+        info.update_ack();
     }
-    bool handle_data(const std::string& username,const boost::asio::ip::udp::endpoint& endpoint,const std::string& file_hash, size_t sequence_number, const std::string& data)
+    // transfer.mutex must be locked
+    bool _finalize_file_download(FileTransfer& transfer)
     {
-        std::unique_lock lock(file_transfers_mutex);
-        if(file_transfers.find(file_hash) == file_transfers.end())
+        auto& info = transfer.info;
+        if(info.next_sequence_number != info.file_size)
             return false;
-        auto& info = file_transfers[file_hash];
-        if(info.username != username)
+        bool saved = info.storage.commit(DOWNLOAD_PATH+info.file_name);
+        if(saved)
+            logging::log("MSG","File from " HIGHLIGHT + info.username + RESET " saved at \"" HIGHLIGHT +DOWNLOAD_PATH+info.file_name+ RESET "\"");
+        else
+            logging::log("ERR","File from " HIGHLIGHT + info.username + RESET " could not be saved at \"" HIGHLIGHT +DOWNLOAD_PATH+info.file_name+ RESET "\"");
+        _remove(transfer);
+        return saved;
+    }
+    bool handle_data(const std::string& username,const boost::asio::ip::udp::endpoint& endpoint,std::string_view file_hash, size_t sequence_number, std::string_view data)
+    {
+        auto transfer = _find(downloads,file_hash);
+        if(transfer == nullptr)
             return false;
-        if(info.direction != FileTransferDirection::download)
+        std::unique_lock lock(transfer->mutex);
+        auto& info = transfer->info;
+        if(not transfer->active or info.username != username)
             return false;
         if(sequence_number%CHUNK_SIZE!=0)
             return false;
-        std::unique_ptr<unsigned char> chunk{new unsigned char[b64d_size((unsigned int)data.length())]};
-        auto data_size = b64_decode((unsigned char*)data.c_str(),(unsigned int)data.length(),chunk.get());
+        auto data_size = data.length();
         auto chunk_number = sequence_number/CHUNK_SIZE;
         
         if(info.received_chunks[chunk_number])
         {// already received
-            udp::send(parsing::compose_message({"FILEACK",file_hash,std::to_string(info.next_sequence_number)}),endpoint);
-            info.update_ack();
+            _send_ack(file_hash,info,endpoint);
             return true;
         }
         //not of CHUNK_SIZE or not last chunk and missing size
-        if(data_size != CHUNK_SIZE and not (chunk_number == info.received_chunks.size() - 1 and data_size == info.data.size()%CHUNK_SIZE))
+        if(data_size != CHUNK_SIZE and not (chunk_number == info.received_chunks.size() - 1 and data_size == info.file_size%CHUNK_SIZE))
+            return false;
+        if(not info.storage.write(sequence_number,data))
             return false;
-        std::copy(chunk.get(),chunk.get()+data_size,info.data.begin()+sequence_number);
         info.received_chunks[chunk_number] = true;
         //check if there are chunks received out of order
         for(size_t i = info.next_sequence_number/CHUNK_SIZE; i<info.received_chunks.size() and info.received_chunks[i]; i++)
         {
             if(i == info.received_chunks.size()-1) // last chunk
-                info.next_sequence_number=info.data.size();
+                info.next_sequence_number=info.file_size;
             else // any other chunk
                 info.next_sequence_number+=CHUNK_SIZE;
         }
-        // check if we haven't acked for window_size chunks or we have received the entire file
-        if(info.next_sequence_number == info.data.size() or info.last_acked_number+(window_size*CHUNK_SIZE) <= info.next_sequence_number)
+        // a chunk received out of order means that one before it was lost, the duplicate ACK tells it to the sender immediately,
+        // otherwise we ACK every ACK_EVERY_CHUNKS chunks or when we have received the entire file
+        if(info.next_sequence_number == info.file_size 
+            or info.next_sequence_number <= sequence_number
+            or info.last_acked_number+(ACK_EVERY_CHUNKS*CHUNK_SIZE) <= info.next_sequence_number)
         { // in this case we need to send an ACK asap
-            udp::send(parsing::compose_message({"FILEACK",file_hash,std::to_string(info.next_sequence_number)}),endpoint);
-            info.update_ack();
+            _send_ack(file_hash,info,endpoint);
 
-            if(info.next_sequence_number == info.data.size())
-                return _finalize_file_download(file_hash);
+            if(info.next_sequence_number == info.file_size)
+                return _finalize_file_download(*transfer);
         }
         return true;
     }
-    // returns the size of the data sent
-    inline size_t _create_and_send_file_packet(size_t sequence_number_to_send,const std::string& file_hash, const FileTransferInfo& info, const boost::asio::ip::udp::endpoint& endpoint)
+    // returns the size of the data sent, 0 if the whole file was already sent, std::nullopt if the file could not be read
+    inline std::optional<size_t> _create_and_send_file_packet(size_t sequence_number_to_send,std::string_view file_hash, FileTransferInfo& info, const boost::asio::ip::udp::endpoint& endpoint)
     {
-        auto packet_size = std::min(CHUNK_SIZE,info.data.size() - sequence_number_to_send);
+        auto packet_size = std::min(CHUNK_SIZE,info.file_size - sequence_number_to_send);
         if(packet_size == 0)
             return 0;
-        std::unique_ptr<char> encoded_data{new char[b64e_size((unsigned int)packet_size)+1]};
-        b64_encode(info.data.data()+sequence_number_to_send,(unsigned int)packet_size,(unsigned char*)encoded_data.get());
-        udp::send(parsing::compose_message({"FILE",file_hash,std::to_string(sequence_number_to_send),encoded_data.get()}),endpoint);
+        std::string chunk(packet_size,'\0');
+        if(not info.storage.read(sequence_number_to_send,chunk.data(),packet_size))
+        {
+            logging::log("ERR","Error reading \"" HIGHLIGHT + info.file_name + RESET "\", the file may have been modified during the transfer");
+            return std::nullopt;
+        }
+        udp::send({"FILE",std::string(file_hash),std::to_string(sequence_number_to_send),chunk},endpoint);
         //logging::log("DBG","Sent packet seqn:" HIGHLIGHT +std::to_string(sequence_number_to_send)+ RESET " to " HIGHLIGHT +info.username+ RESET);
         return packet_size;
     }
-    bool handle_ack(const std::string& username, const boost::asio::ip::udp::endpoint& endpoint, const std::string& file_hash, size_t acked_number)
+    // the chunk will be sent again before the new ones
+    inline void _mark_lost(FileTransferInfo& info, FileTransferInfo::SentChunk& chunk)
     {
-        std::unique_lock lock(file_transfers_mutex);
-        if(file_transfers.find(file_hash) == file_transfers.end())
-            return false;
-        auto& info = file_transfers[file_hash];
-        if(info.username != username)
+        chunk.state = FileTransferInfo::ChunkState::lost;
+        info.chunks_in_flight--;
+        info.chunks_lost++;
+    }
+    bool handle_ack(const std::string& username, std::string_view file_hash, size_t acked_number, std::string_view sack)
+    {
+        using ChunkState = FileTransferInfo::ChunkState;
+        auto transfer = _find(uploads,file_hash);
+        if(transfer == nullptr)
             return false;
-        if(info.direction != FileTransferDirection::upload)
+        std::unique_lock lock(transfer->mutex);
+        auto& info = transfer->info;
+        if(not transfer->active or info.username != username)
             return false;
-        if(acked_number != info.data.size() and acked_number%CHUNK_SIZE != 0)
+        if(acked_number != info.file_size and acked_number%CHUNK_SIZE != 0)
             return false;
         if(acked_number > info.next_sequence_number)//acked a packet we did not send
             return false;
         if(acked_number==0 and not info.accepted)
         {
             info.accepted = true;
+            info.last_ack = boost::posix_time::microsec_clock::local_time();
+            info.last_progress = info.last_ack;
+            info.next_send = info.last_ack;
             logging::log("MSG","File transfer accepted from " HIGHLIGHT + info.username + RESET);
+            _schedule(transfer,info.last_ack);
             return true;
         }
-        if(acked_number==info.data.size())
+        if(acked_number==info.file_size)
         {//file completely received
             logging::log("MSG","File successfully sent to " HIGHLIGHT + info.username + RESET);
-            file_transfers.erase(file_hash);
+            _remove(*transfer);
             return true;
         }
-
-        if(acked_number == info.last_acked_number)//duplicate ack, not the connection accepted ack
-        {// we need to resend the double acked packet because it was lost
-            _create_and_send_file_packet(info.last_acked_number,file_hash,info,endpoint);
+        if(acked_number < info.last_acked_number)// reordered ack
             return true;
-        }
         auto now = boost::posix_time::microsec_clock::local_time();
-        info.update_average_throughput(acked_number - info.last_acked_number,now-info.last_ack);
+        // the newest chunk delivered gives a round trip time sample if it was sent only once
+        boost::posix_time::time_duration rtt_sample;
+        boost::posix_time::ptime newest_delivered;
+        size_t delivered = 0;
+        auto deliver = [&](FileTransferInfo::SentChunk& chunk)
+        {
+            if(chunk.state == ChunkState::sacked)
+                return;
+            if(chunk.state == ChunkState::in_flight)
+                info.chunks_in_flight--;
+            else
+                info.chunks_lost--;
+            chunk.state = ChunkState::sacked;
+            delivered++;
+            if(newest_delivered.is_not_a_date_time() or chunk.sent > newest_delivered)
+            {
+                newest_delivered = chunk.sent;
+                rtt_sample = chunk.retransmitted ? boost::posix_time::time_duration{} : now - chunk.sent;
+            }
+        };
+        for(auto acked_chunks = (acked_number - info.last_acked_number)/CHUNK_SIZE; acked_chunks > 0 and not info.sent_chunks.empty(); acked_chunks--)
+        {
+            deliver(info.sent_chunks.front());
+            info.sent_chunks.pop_front();
+        }
+        // bit i of the bitmap is the chunk i+1 after the one at acked_number, that is still missing
+        for(size_t i = 0; i < sack.length()*8 and i+1 < info.sent_chunks.size(); i++)
+        {
+            if(sack[i/8] & (1u << (i%8)))
+                deliver(info.sent_chunks[i+1]);
+        }
         info.last_acked_number = acked_number;
-        info.last_ack = now;
+        if(delivered == 0)// duplicate ack
+            return true;
+        info.congestion.on_ack(delivered,rtt_sample);
+        info.acked_since_sample += delivered*CHUNK_SIZE;
+        if(now - info.last_ack >= info.congestion.rtt())
+        {// ACKs arrive in bursts, a shorter interval would overestimate the throughput
+            info.update_average_throughput(info.acked_since_sample,now-info.last_ack);
+            info.congestion.on_delivery_rate((double)info.acked_since_sample/((double)(now-info.last_ack).total_microseconds()*1e-6));
+            info.acked_since_sample = 0;
+            info.last_ack = now;
+        }
+        info.last_progress = now;
+        if(not sack.empty())
+        {// a chunk still in flight that was sent before a delivered one (allowing some reordering) was lost
+            auto reordering_window = info.congestion.rtt()/REORDERING_WINDOW_DIVISOR;
+            bool loss = false;
+            for(auto& chunk: info.sent_chunks)
+            {
+                if(chunk.state == ChunkState::in_flight and chunk.sent + reordering_window < newest_delivered)
+                {
+                    _mark_lost(info,chunk);
+                    loss = true;
+                }
+            }
+            if(loss)
+                info.congestion.on_loss(now,CHUNK_SIZE);
+        }
+        // the window has room for new chunks or the lost ones
+        _schedule(transfer,now);
         return true;
     }
-    bool delete_file_transfer(const std::string& username, const std::string& file_hash)
+    bool delete_file_transfer(const std::string& username, std::string_view file_hash)
     {
-        std::unique_lock lock(file_transfers_mutex);
-        if(file_transfers.find(file_hash) == file_transfers.end())
+        for(auto transfers: {&uploads,&downloads})
+        {
+            auto transfer = _find(*transfers,file_hash);
+            if(transfer == nullptr)
+                continue;
+            std::unique_lock lock(transfer->mutex);
+            if(transfer->active and transfer->info.username == username)
+            {
+                _remove(*transfer);
+                return true;
+            }
+        }
+        return false;
+    }
+    bool stop_file_transfer(const std::string& file_hash, FileTransferDirection direction)
+    {
+        auto transfer = _find(direction == FileTransferDirection::upload ? uploads : downloads,file_hash);
+        if(transfer == nullptr)
             return false;
-        auto& info = file_transfers[file_hash];
-        if(info.username != username)
+        std::unique_lock lock(transfer->mutex);
+        if(not transfer->active)
             return false;
-        file_transfers.erase(file_hash);
+        udp::send(parsing::compose_message({"FILESTOP",file_hash}),transfer->info.username);
+        _remove(*transfer);
         return true;
     }
-    void file_sender()
+    // send the chunks allowed by the congestion window and the pacing, the lost ones first,
+    // returns when the next chunk can be sent or the next retransmission timer expires (not_a_date_time if we have to wait for an ACK),
+    // the transfer is stopped if the file can't be read anymore
+    boost::posix_time::ptime _send_upload_chunks(FileTransfer& transfer, const boost::asio::ip::udp::endpoint& endpoint)
     {
-        while(true)
+        using ChunkState = FileTransferInfo::ChunkState;
+        auto& file_hash = transfer.file_hash;
+        auto& info = transfer.info;
+        auto now = boost::posix_time::microsec_clock::local_time();
+        auto rto = info.congestion.rto();
+        if(info.chunks_in_flight > 0)
+        {// every chunk has its own retransmission timer
+            bool expired = false;
+            for(auto& chunk: info.sent_chunks)
+            {
+                if(chunk.state == ChunkState::in_flight and now - chunk.sent > rto)
+                {
+                    _mark_lost(info,chunk);
+                    expired = true;
+                }
+            }
+            if(expired and now - info.last_progress > rto)
+            {// nothing was delivered for a whole timeout
+                info.congestion.on_timeout(CHUNK_SIZE);
+                info.last_progress = now;
+            }
+            else if(expired)
+                info.congestion.on_loss(now,CHUNK_SIZE);
+        }
+        if(now - info.next_send > MAX_PACING_BURST)
+            info.next_send = now - MAX_PACING_BURST;
+        auto window = info.congestion.window();
+        size_t first_lost = 0;
+        bool read_error = false;
+        while(info.chunks_in_flight < window and info.next_send <= now)
         {
-            std::vector<std::string> keys;
+            if(info.chunks_lost > 0)
             {
-                std::unique_lock lock(file_transfers_mutex);
-                keys.reserve(file_transfers.size());
-                for(auto& [key, value]: file_transfers)
+                while(info.sent_chunks[first_lost].state != ChunkState::lost)
+                    first_lost++;
+                auto& chunk = info.sent_chunks[first_lost];
+                if(not _create_and_send_file_packet(info.last_acked_number + first_lost*CHUNK_SIZE,file_hash,info,endpoint))
                 {
-                    keys.emplace_back(key);
+                    read_error = true;
+                    break;
                 }
+                chunk.state = ChunkState::in_flight;
+                chunk.sent = now;
+                chunk.retransmitted = true;
+                info.chunks_lost--;
             }
-            if(keys.empty())
-                boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
             else
             {
-                for(auto& k: keys)
+                auto packet_size = _create_and_send_file_packet(info.next_sequence_number,file_hash,info,endpoint);
+                if(not packet_size)
                 {
-                    std::unique_lock lock(file_transfers_mutex);
-                    if(file_transfers.find(k) != file_transfers.end())
-                    { // key still present
-                        auto& info = file_transfers[k];
-                        try
-                        {
-                            boost::asio::ip::udp::endpoint endpoint;
-                            {
-                                std::unique_lock lock(udp::connection_map.obj);
-                                endpoint = udp::connection_map[info.username].endpoint;   
-                            }
-                            auto window_difference = info.next_sequence_number - info.last_acked_number;
-                            auto max_window_size = std::min(window_size*CHUNK_SIZE, info.data.size() - info.last_acked_number);
-                            switch (info.direction)
-                            {
-                            case FileTransferDirection::upload:
-                                // we have "window_difference" packets that we don't know if they were received or not
-                                // we send (window_size*CHUNK_SIZE)-window_difference bytes starting from next_sequence_number
-                                // so that we have the next window_difference == window_size*CHUNK_SIZE
-                                if(info.accepted)
-                                {
-                                    auto now = boost::posix_time::microsec_clock::local_time();
-                                    if(window_difference < window_size*CHUNK_SIZE)
-                                    {
-                                        for(;window_difference < window_size*CHUNK_SIZE;window_difference = info.next_sequence_number - info.last_acked_number)
-                                        {
-                                            auto packet_size = _create_and_send_file_packet(info.next_sequence_number,k,info,endpoint);
-                                            if(packet_size == 0)
-                                                break;//we sent the whole file
-                                            info.next_sequence_number += packet_size;
-                                        }
-                                    }
-                                    else if((now - info.last_ack).total_milliseconds() > ACK_EVERY*2)
-                                    {// is the other peer dead? try sending the last acked packet
-                                        _create_and_send_file_packet(info.last_acked_number,k,info,endpoint);
-                                    }
-                                }
-                                else
-                                {// the user did not accept/went offline
-                                    auto now = boost::posix_time::microsec_clock::local_time();
-                                    if((now-info.last_ack).total_seconds() > ACCEPT_TIMEOUT)
-                                    {
-                                        udp::send(parsing::compose_message({"FILESTOP",k}),info.username);
-                                        logging::log("MSG","Request to send a file to " HIGHLIGHT +info.username+ RESET " timed out");
-                                        file_transfers.erase(k);
-                                    }
-                                }
-                                break;
-                            case FileTransferDirection::download:
-                                {
-                                    auto now = boost::posix_time::microsec_clock::local_time();
-                                    // we have "window_difference" packets that we didn't ack or the last ack was very long ago
-                                    if(window_difference >= max_window_size or (now-info.last_ack).total_milliseconds() > ACK_EVERY)
-                                    { // we ack everything we received
-                                        info.update_ack();
-                                        udp::send(parsing::compose_message({"FILEACK",k,std::to_string(info.last_acked_number)}),endpoint);
-                                    }
-                                }
-                                break;
-                            }
-                        }
-                        catch(DataMap::NotFound&)
-                        { // user disconnected during file transfer
-                            logging::log("ERR","File transfer with " HIGHLIGHT + info.username + RESET " stopped because the user disconnected");
-                            file_transfers.erase(k);
-                        }
+                    read_error = true;
+                    break;
+                }
+                if(*packet_size == 0)
+                    break;//we sent the whole file
+                info.sent_chunks.push_back({ChunkState::in_flight,now,false});
+                info.next_sequence_number += *packet_size;
+            }
+            info.chunks_in_flight++;
+            info.next_send += info.congestion.pacing_interval();
+        }
+        if(read_error)
+        {// retrying would fail again every pacing interval
+            udp::send(parsing::compose_message({"FILESTOP",file_hash}),info.username);
+            _remove(transfer);
+            return {};
+        }
+        boost::posix_time::ptime wake_up;
+        if(info.chunks_in_flight < info.congestion.window() and (info.chunks_lost > 0 or info.next_sequence_number < info.file_size))
+            wake_up = info.next_send;
+        for(auto& chunk: info.sent_chunks)
+        {
+            if(chunk.state == ChunkState::in_flight and (wake_up.is_not_a_date_time() or chunk.sent + rto < wake_up))
+                wake_up = chunk.sent + rto;
+        }
+        return wake_up;
+    }
+    // transfer.mutex must be locked, returns when the transfer must be handled again (not_a_date_time if it's not needed)
+    boost::posix_time::ptime _handle_transfer(FileTransfer& transfer)
+    {
+        auto& info = transfer.info;
+        auto now = boost::posix_time::microsec_clock::local_time();
+        boost::asio::ip::udp::endpoint endpoint;
+        try
+        {
+            endpoint = udp::connection_map[info.username]->endpoint;
+        }
+        catch(DataMap::NotFound&)
+        { // user disconnected during file transfer
+            logging::log("ERR","File transfer with " HIGHLIGHT + info.username + RESET " stopped because the user disconnected");
+            _remove(transfer);
+            return {};
+        }
+        switch (info.direction)
+        {
+        case FileTransferDirection::upload:
+            if(info.accepted)
+                return _send_upload_chunks(transfer,endpoint);
+            // the user did not accept/went offline
+            if((now-info.last_ack).total_seconds() >= ACCEPT_TIMEOUT)
+            {
+                udp::send(parsing::compose_message({"FILESTOP",transfer.file_hash}),info.username);
+                logging::log("MSG","Request to send a file to " HIGHLIGHT +info.username+ RESET " timed out");
+                _remove(transfer);
+                return {};
+            }
+            return info.last_ack + boost::posix_time::seconds(ACCEPT_TIMEOUT);
+        case FileTransferDirection::download:
+            // the last ack was very long ago, it may have been lost
+            if((now-info.last_ack).total_milliseconds() >= ACK_EVERY)
+            { // we ack everything we received
+                _send_ack(transfer.file_hash,info,endpoint);
+            }
+            return info.last_ack + boost::posix_time::milliseconds(ACK_EVERY);
+        }
+        return {};
+    }
+    // handles every transfer when its pacing deadline, its retransmission timer or its ACK timer expires
+    // or when an ACK makes room in its window
+    void file_sender()
+    {
+        while(true)
+        {
+            ScheduledTransfer next;
+            {
+                boost::unique_lock lock(scheduler_mutex);
+                while(true)
+                {
+                    if(scheduled_transfers.empty())
+                    {
+                        scheduler_ready.wait(lock);
+                        continue;
                     }
+                    auto now = boost::posix_time::microsec_clock::local_time();
+                    auto time = scheduled_transfers.top().time;
+                    if(time <= now)
+                        break;
+                    scheduler_ready.wait_for(lock,boost::chrono::microseconds((time-now).total_microseconds()));
                 }
-                boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                next = scheduled_transfers.top();
+                scheduled_transfers.pop();
             }
+            auto transfer = next.transfer.lock();
+            if(transfer == nullptr)
+                continue;
+            std::unique_lock lock(transfer->mutex);
+            if(not transfer->active or transfer->wake_up != next.time)
+                continue;// removed or scheduled again
+            transfer->wake_up = boost::posix_time::ptime{};
+            auto wake_up = _handle_transfer(*transfer);
+            if(transfer->active and not wake_up.is_not_a_date_time())
+                _schedule(transfer,wake_up);
         }
     }
     void file()
     {
+        parsing::Tokens args;
+        MessageQueueItem item;
         while(true)
         {
-            auto item = file_queue.pull();
-            auto args = parsing::msg_split(item.msg);
-            // FILE <base64 file hash> <sequence number> <base64 data>
+            file_queue.pull(item);
+            udp::wire::tokenize(item.msg,args);
+            if(args.empty())
+                continue;
+            // FILE <base64 file hash> <sequence number> <data, base64 in text messages>
             if(args[0] == "FILE" and args.size() == 4)
             {
-                try
-                {
-                    auto sequence_number = std::stoull(args[2]);
+                unsigned long long sequence_number;
+                if(parsing::to_number(args[2],sequence_number))
                     handle_data(item.src,item.src_endpoint,args[1],sequence_number,args[3]);
-                }catch(std::exception&)
-                {}
                 //logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
             }
-            // FILEACK <base64 file hash> <next sequence number to receive>
-            else if(args[0] == "FILEACK" and args.size() == 3)
+            // FILEACK <base64 file hash> <next sequence number to receive> [<selective ACK bitmap, base64 in text messages>]
+            else if(args[0] == "FILEACK" and (args.size() == 3 or args.size() == 4))
             {
-                try{
-                    auto next_sequence_number = std::stoull(args[2]);
-                    handle_ack(item.src,item.src_endpoint,args[1],next_sequence_number);
-                }catch(std::exception&)
-                {}
+                unsigned long long next_sequence_number;
+                if(parsing::to_number(args[2],next_sequence_number))
+                    handle_ack(item.src,args[1],next_sequence_number,args.size() == 4 ? args[3] : std::string_view{});
                 //logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
             }
             // FILEINIT <base64 file hash> <total file size> <file name>
             else if(args[0] == "FILEINIT" and args.size() == 4)
             {
-                try{
-                    auto file_size = std::stoull(args[2]);
-                    std::string file_name = parsing::clean_file_name(args[3]);
+                unsigned long long file_size;
+                if(parsing::to_number(args[2],file_size))
+                {
+                    std::string file_hash{args[1]}, file_name{args[3]};
                     terminal::input("Accept a file of " HIGHLIGHT + std::to_string(file_size/1024) + RESET "KB from " HIGHLIGHT + item.src + RESET "? (y/n)",
-                    [item,file_size,args](const std::string& input){
+                    [item,file_size,file_hash,file_name](const std::string& input){
                         if(input == "Y" or input == "y")
                         {
-                            if(not init_file_download(item.src,args[1],file_size,args[3]))
+                            if(not init_file_download(item.src,file_hash,file_size,file_name))
                                 logging::log("ERR","Error downloading a file from " HIGHLIGHT + item.src + RESET);
                         }else
                         {
                             logging::log("MSG","File refused from \"" HIGHLIGHT +item.src+ RESET "\"");
-                            udp::send(parsing::compose_message({"FILESTOP",args[1]}),item.src_endpoint);
+                            udp::send(parsing::compose_message({"FILESTOP",file_hash}),item.src_endpoint);
                         }
                     });
-                }catch(std::exception&)
-                {}
-                logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
+                }
+                logging::log("DBG","Handled " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src + RESET);
             }
             // FILESTOP <base64 file hash>
             else if(args[0] == "FILESTOP" and args.size() == 2)
             {
                 if(delete_file_transfer(item.src,args[1]))
                     logging::log("MSG","File transfer stopped from " HIGHLIGHT + item.src + RESET);
-                logging::log("DBG","Handled " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src + RESET);
+                logging::log("DBG","Handled " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src + RESET);
             }
             else 
             {
-                logging::log("DBG","Dropped " HIGHLIGHT + args[0] + RESET " from " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
+                logging::log("DBG","Dropped " HIGHLIGHT + std::string(args[0]) + RESET " from " HIGHLIGHT + item.src_endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(item.src_endpoint.port()) + RESET);
             }
         }
     }
     size_t ongoing_transfers_count()
     {
         std::unique_lock lock(file_transfers_mutex);
-        return file_transfers.size();
+        return uploads.size() + downloads.size();
     }
     void init()
     {
+        udp::setup_queue("file",file_queue,QUEUE_DEFAULTS);
         udp::register_queue("FILE",file_queue,true);
         udp::register_queue("FILEACK",file_queue,true);
         udp::register_queue("FILEINIT",file_queue,true);
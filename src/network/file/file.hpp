@@ -2,9 +2,13 @@
 #include <exception>
 #include <string>
 #include <vector>
+#include <deque>
 #include <mutex>
+#include <memory>
 #include <map>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include "ChunkFile/ChunkFile.hpp"
+#include "CongestionControl/CongestionControl.hpp"
 namespace network::file
 {
     enum class FileTransferDirection
@@ -24,8 +28,10 @@ namespace network::file
         std::string username;
         // true if the other user accepted the transfer
         bool accepted;
-        // file binary data (bytes)
-        std::vector<unsigned char> data;
+        // file size in bytes
+        size_t file_size = 0;
+        // the file being sent or the temporary file being received, chunks are read/written only when needed
+        ChunkFile storage;
         //true if a chunk has been received (used only for download)
         std::vector<bool> received_chunks;
         // first byte not received (only for download) or first byte yet to send (only for upload)
@@ -38,32 +44,86 @@ namespace network::file
         boost::posix_time::ptime last_ack;
         // average number of bytes sent in a second
         double average_throughput = 0;
+        // bytes acknowledged since last_ack, the throughput of an upload is sampled once per round trip
+        size_t acked_since_sample = 0;
+        // congestion window, round trip time estimate and pacing (only for upload)
+        CongestionControl congestion;
+        enum class ChunkState
+        {
+            // sent and not acknowledged yet
+            in_flight,
+            // acknowledged selectively, waiting for the chunks before it
+            sacked,
+            // lost, waiting to be sent again
+            lost
+        };
+        struct SentChunk
+        {
+            ChunkState state;
+            // time of the last transmission, a chunk not acknowledged within the retransmission timeout is lost
+            boost::posix_time::ptime sent;
+            // retransmitted chunks are not used to measure the round trip time (Karn's algorithm)
+            bool retransmitted;
+        };
+        // the chunks from last_acked_number to next_sequence_number, one for every chunk (only for upload)
+        std::deque<SentChunk> sent_chunks;
+        // chunks in sent_chunks that are ChunkState::in_flight, the congestion window limits them
+        size_t chunks_in_flight = 0;
+        // chunks in sent_chunks that are ChunkState::lost
+        size_t chunks_lost = 0;
+        // time of the last ACK that acknowledged new data, used for the retransmission timeout (only for upload)
+        boost::posix_time::ptime last_progress;
+        // earliest time the next chunk can be sent (only for upload)
+        boost::posix_time::ptime next_send;
         void update_average_throughput(size_t delta_bytes, const boost::posix_time::time_duration& delta_time);
         void update_ack();
         // get how many chunks there are in a file of "data_size" bytes
         static size_t chunk_count(size_t data_size);
-        // constructor for upload
+        // constructor for upload, "rtt" is the latency measured with the user if available
         static FileTransferInfo prepare_for_upload(
             const std::string& file_name,
             const std::string& username,
-            const std::vector<unsigned char>& data);
-        // constructore for download
+            ChunkFile&& storage,
+            boost::posix_time::time_duration rtt = {});
+        // constructore for download, throws ChunkFile::OpenError if the temporary file can't be created
         static FileTransferInfo prepare_for_download(
             const std::string& file_name,
             const std::string& username, 
             size_t file_size);
     };
     /**
-     * @brief use this before accessing file_transfers
+     * @brief an ongoing file transfer, it's shared by the handlers and file_sender and every transfer has its own lock
+     * 
+     */
+    struct FileTransfer
+    {
+        // lock before accessing the other members, file_transfers_mutex can be locked while holding it but not the opposite
+        std::mutex mutex;
+        FileTransferInfo info;
+        // base64 hash of the file, the key in uploads/downloads
+        std::string file_hash;
+        // false once the transfer has been removed from uploads/downloads
+        bool active = true;
+        // when file_sender will handle the transfer again, not_a_date_time if it's not scheduled
+        boost::posix_time::ptime wake_up;
+    };
+    /**
+     * @brief use this before accessing uploads or downloads, it only protects the maps and not the transfers
      * 
      */
     extern std::mutex file_transfers_mutex;
     /**
-     * @brief lock file_transfers_mutex before accessing, this map contains every info about ongoing file transfers,
+     * @brief lock file_transfers_mutex before accessing, this map contains every ongoing upload,
      * the key is the file hash encoded base64
      * 
      */
-    extern std::map<std::string,FileTransferInfo> file_transfers;
+    extern std::map<std::string,std::shared_ptr<FileTransfer>,std::less<>> uploads;
+    /**
+     * @brief lock file_transfers_mutex before accessing, this map contains every ongoing download,
+     * the key is the file hash encoded base64
+     * 
+     */
+    extern std::map<std::string,std::shared_ptr<FileTransfer>,std::less<>> downloads;
     /**
      * @brief get how many files are being transferred
      * 
@@ -98,6 +158,26 @@ namespace network::file
      * @return false if a file with the same hash is already sending
      */
     bool init_file_upload(const std::string& to, const std::string& path);
+    /**
+     * @brief accept a file offered by "from" with FILEINIT, the file is saved in DOWNLOAD_PATH
+     * 
+     * @param from username of the sender
+     * @param file_hash base64 hash of the file
+     * @param file_size size of the file in bytes
+     * @param file_name name of the file
+     * @return true if the download started
+     * @return false if a file with the same hash is already downloading or the temporary file can't be created
+     */
+    bool init_file_download(const std::string& from, const std::string& file_hash, size_t file_size, const std::string& file_name);
+    /**
+     * @brief stop a file transfer and tell it to the other user with FILESTOP
+     * 
+     * @param file_hash base64 hash of the file
+     * @param direction FileTransferDirection::upload or FileTransferDirection::download
+     * @return true if the transfer was stopped
+     * @return false if there is no such transfer
+     */
+    bool stop_file_transfer(const std::string& file_hash, FileTransferDirection direction);
     /**
      * @brief initialize the module
      * 
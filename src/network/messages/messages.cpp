@@ -8,18 +8,22 @@
 namespace network::messages
 {
     MessageQueue messages_queue;
+    constexpr udp::QueueOptions QUEUE_DEFAULTS = {256,OverflowPolicy::drop_newest};
     void messages()
     {
+        parsing::Tokens args;
+        MessageQueueItem item;
         while(true)
         {
-            auto item = messages_queue.pull();
-            auto args = parsing::msg_split(item.msg);
+            messages_queue.pull(item);
+            parsing::tokenize(item.msg,args);
             if(args.size() >= 2)
-                logging::recieved_text_message_log(item.src,args[1]);
+                logging::recieved_text_message_log(item.src,std::string(args[1]));
         }
     }
     void init()
     {
+        udp::setup_queue("messages",messages_queue,QUEUE_DEFAULTS);
         udp::register_queue("MSG",messages_queue,true);
 
         multithreading::add_service("messages",messages);
@@ -29,8 +29,11 @@ namespace network::timecheck
             // ping check
             for(auto& [name,endpoint]: users)
             {
-                std::unique_lock lock(udp::connection_map.obj);
-                auto& data_ref = udp::connection_map[name];
+                auto peer = udp::connection_map.find(name);
+                if(peer == nullptr) // removed in the meantime
+                    continue;
+                std::unique_lock lock(peer->mutex);
+                auto& data_ref = *peer;
                 auto now = boost::posix_time::microsec_clock::local_time();
                 if(data_ref.last_ping_id == 0) // not waiting for ping
                 {
@@ -1,125 +1,153 @@
 #include "DataMap.hpp"
+#include <algorithm>
+#include <boost/container_hash/hash.hpp>
 #include "../../../defines.hpp"
 #include "../../../logging/logging.hpp"
 namespace network
 {
-    bool DataMap::_add_user(const std::string& name,const boost::asio::ip::udp::endpoint& endpoint)
+    size_t DataMap::EndpointHash::operator()(const boost::asio::ip::udp::endpoint& endpoint) const
     {
-        if(name_data.find(name)!=name_data.end())//found
-            return false;
-        else if(endpoint_name.find(endpoint)!=endpoint_name.end())//found
-            return false;
+        size_t seed = endpoint.port();
+        auto address = endpoint.address();
+        if(address.is_v4())
+            boost::hash_combine(seed,address.to_v4().to_uint());
         else
         {
-            if(name != "loopback")
-                server_name = name;
-            auto& ref = name_data[name];
-            ref.name = name;
-            ref.endpoint = endpoint;
-            
-            endpoint_name[endpoint] = name;
-            return true;
+            auto bytes = address.to_v6().to_bytes();
+            boost::hash_range(seed,bytes.begin(),bytes.end());
         }
+        return seed;
     }
-    bool DataMap::_remove_user(const std::string& name)
+    DataMap::Shard& DataMap::_shard(const std::string& name)
     {
-        if(name_data.find(name)==name_data.end())//not found
-            return false;
-        else
-        {
-            auto endpoint = name_data[name].endpoint;
-            name_data.erase(name);
-            endpoint_name.erase(endpoint);
-            return true;
-        }
+        return shards[std::hash<std::string>{}(name) % SHARDS];
+    }
+    DataMap::Shard& DataMap::_shard(const boost::asio::ip::udp::endpoint& endpoint)
+    {
+        return shards[EndpointHash{}(endpoint) % SHARDS];
     }
-    bool DataMap::_remove_user(const boost::asio::ip::udp::endpoint& endpoint)
+    bool DataMap::_remove_user(const Peer& peer)
     {
-        if(endpoint_name.find(endpoint)==endpoint_name.end())//not found
+        if(peer == nullptr)
             return false;
-        else
         {
-            auto name = endpoint_name[endpoint];
-            endpoint_name.erase(endpoint);
-            name_data.erase(name);
-            return true;
+            auto& shard = _shard(peer->name);
+            std::unique_lock lock(shard.mutex);
+            shard.by_name.erase(peer->name);
+        }
+        {
+            auto& shard = _shard(peer->endpoint);
+            std::unique_lock lock(shard.mutex);
+            shard.by_endpoint.erase(peer->endpoint);
         }
+        count--;
+        return true;
     }
     const char* DataMap::NotFound::what()
     {
         return "Name/Endpoint not found";
     }
-    DataMap::PeerData& DataMap::_op_sqbr(const std::string& name)
-    {
-        auto ret = name_data.find(name);
-        if(ret==name_data.end())
-            throw NotFound{};
-        return (*ret).second;
-    }
-    DataMap::PeerData& DataMap::_op_sqbr(const boost::asio::ip::udp::endpoint& endpoint)
-    {
-        auto ret = endpoint_name.find(endpoint);
-        if(ret==endpoint_name.end())
-            throw NotFound{};
-        return name_data[(*ret).second];
-    }
 
     bool DataMap::add_user(const std::string& name,const boost::asio::ip::udp::endpoint& endpoint)
     {
-        std::unique_lock lock(obj);
+        std::unique_lock lock(writers);
         logging::new_user_log(name,endpoint);
-        return _add_user(name,endpoint);
+        if(find(name) != nullptr or find(endpoint) != nullptr)
+            return false;
+        if(name != "loopback")
+            server_name = name;
+        auto peer = std::make_shared<PeerData>();
+        peer->name = name;
+        peer->endpoint = endpoint;
+        {
+            auto& shard = _shard(name);
+            std::unique_lock shard_lock(shard.mutex);
+            shard.by_name.emplace(name,peer);
+        }
+        {// the receive path searches by endpoint, so the peer is complete once it's visible there
+            auto& shard = _shard(endpoint);
+            std::unique_lock shard_lock(shard.mutex);
+            shard.by_endpoint.emplace(endpoint,peer);
+        }
+        count++;
+        return true;
     }
     bool DataMap::remove_user(const std::string& name)
     {
-        std::unique_lock lock(obj);
+        std::unique_lock lock(writers);
         logging::removed_user_log(name);
-        return _remove_user(name);
+        return _remove_user(find(name));
     }
     bool DataMap::remove_user(const boost::asio::ip::udp::endpoint& endpoint)
     {
-        std::unique_lock lock(obj);
-        logging::removed_user_log(endpoint_name[endpoint]);
-        return _remove_user(endpoint);
+        std::unique_lock lock(writers);
+        auto peer = find(endpoint);
+        if(peer != nullptr)
+            logging::removed_user_log(peer->name);
+        return _remove_user(peer);
     }
     size_t DataMap::size()
     {
-        std::unique_lock lock(obj);
-        return name_data.size();
+        return count;
+    }
+    DataMap::Peer DataMap::operator[](const std::string& name)
+    {
+        auto peer = find(name);
+        if(peer == nullptr)
+            throw NotFound{};
+        return peer;
+    }
+    DataMap::Peer DataMap::operator[](const boost::asio::ip::udp::endpoint& endpoint)
+    {
+        auto peer = find(endpoint);
+        if(peer == nullptr)
+            throw NotFound{};
+        return peer;
     }
-    DataMap::PeerData& DataMap::operator[](const std::string& name)
+    DataMap::Peer DataMap::find(const std::string& name)
     {
-        //std::unique_lock lock(obj);
-        return _op_sqbr(name);
+        auto& shard = _shard(name);
+        std::shared_lock lock(shard.mutex);
+        auto ret = shard.by_name.find(name);
+        if(ret == shard.by_name.end())
+            return nullptr;
+        return ret->second;
     }
-    DataMap::PeerData& DataMap::operator[](const boost::asio::ip::udp::endpoint& endpoint)
+    DataMap::Peer DataMap::find(const boost::asio::ip::udp::endpoint& endpoint)
     {
-        //std::unique_lock lock(obj);
-        return _op_sqbr(endpoint);
+        auto& shard = _shard(endpoint);
+        std::shared_lock lock(shard.mutex);
+        auto ret = shard.by_endpoint.find(endpoint);
+        if(ret == shard.by_endpoint.end())
+            return nullptr;
+        return ret->second;
     }
     bool DataMap::check_user(const std::string& name)
     {
-        std::unique_lock lock(obj);
-        return name_data.find(name) != name_data.end();
+        return find(name) != nullptr;
     }
     bool DataMap::check_user(const boost::asio::ip::udp::endpoint& endpoint)
     {
-        std::unique_lock lock(obj);
-        return endpoint_name.find(endpoint) != endpoint_name.end();
+        return find(endpoint) != nullptr;
     }
     boost::asio::ip::udp::endpoint DataMap::server()
     {
-        std::unique_lock lock(obj);
-        return _op_sqbr(server_name).endpoint;
+        std::unique_lock lock(writers);
+        return (*this)[server_name]->endpoint;
     }
     std::vector<std::pair<std::string,boost::asio::ip::udp::endpoint>> DataMap::get_connected_users()
     {
-        std::unique_lock lock(obj);
         std::vector<std::pair<std::string,boost::asio::ip::udp::endpoint>> ret;
-        for(auto& [endpoint, name]:endpoint_name)
+        ret.reserve(count);
+        for(auto& shard: shards)
         {
-            ret.emplace_back(name,endpoint);
+            std::shared_lock lock(shard.mutex);
+            for(auto& [endpoint, peer]: shard.by_endpoint)
+            {
+                ret.emplace_back(peer->name,endpoint);
+            }
         }
+        std::sort(ret.begin(),ret.end(),[](auto& a, auto& b){ return a.second < b.second; });
         return ret;
     }
 }
\ No newline at end of file
@@ -1,8 +1,13 @@
 #pragma once
-#include <map>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 #include <exception>
+#include <unordered_map>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/asio/ip/udp.hpp>
 #include "../crypto/crypto.hpp"
@@ -14,18 +19,29 @@ namespace network
      * this can be used to store data before it is completely received, for checking
      * if a user is registered and what username corresponds to an endpoint
      * 
+     * peers are indexed by name and by endpoint in SHARDS hash tables, each one with its own
+     * shared_mutex, so lookups only contend with an add/remove touching the same shard.
+     * a lookup returns a Peer handle, which stays valid even if the user is removed meanwhile
+     * 
      */
     class DataMap
     {
     public:
         /**
-         * @brief structure contained in name_data map and is returned from the operator[]
+         * @brief structure pointed by the Peer handles returned from the operator[] and find
          * 
          */
         struct PeerData
         {
+            /**
+             * @brief you must acquire this before using the fields after name and endpoint
+             * 
+             */
+            std::recursive_mutex mutex;
+            // name and endpoint never change after the peer is added
             std::string name;
             boost::asio::ip::udp::endpoint endpoint;
+            // only used by the udp_listener thread, it's not protected by mutex
             std::string tmpData;
             boost::posix_time::ptime ping_sent;
             unsigned short last_ping_id = 0;
@@ -33,30 +49,46 @@ namespace network
             boost::posix_time::time_duration avg_latency;
             unsigned short offline_strikes = 0;
             bool encrypted = false;
+            // true if the peer announced support for the binary framing (see wire.hpp)
+            bool binary = false;
             bool symmetric_key_valid = false;
             std::string asymmetric_key;
             udp::crypto::Key symmetric_key;
+            // created from symmetric_key the first time it's used after the key changes
+            udp::crypto::Cipher cipher;
             boost::posix_time::ptime crypt_requested;
         };
-    private:
         /**
-         * @brief this maps an endpoint to a username
+         * @brief stable handle to a peer, the data is kept alive until the last handle is released
          * 
          */
-        std::map<boost::asio::ip::udp::endpoint,std::string> endpoint_name;
+        using Peer = std::shared_ptr<PeerData>;
+    private:
+        struct EndpointHash
+        {
+            size_t operator()(const boost::asio::ip::udp::endpoint& endpoint) const;
+        };
+        static constexpr size_t SHARDS = 16;
         /**
-         * @brief this maps a username to the data
+         * @brief a part of both indexes, names and endpoints are assigned to a shard by their hash
          * 
          */
-        std::map<std::string,PeerData> name_data; 
-        std::string server_name;
-    public:
+        struct Shard
+        {
+            std::shared_mutex mutex;
+            std::unordered_map<std::string,Peer> by_name;
+            std::unordered_map<boost::asio::ip::udp::endpoint,Peer,EndpointHash> by_endpoint;
+        };
+        std::array<Shard,SHARDS> shards;
         /**
-         * @brief you must acquire this before using the operator[]
+         * @brief serializes add_user and remove_user, so the two indexes always contain the same peers
          * 
          */
-        std::recursive_mutex obj;
-        
+        std::mutex writers;
+        // protected by writers
+        std::string server_name;
+        std::atomic<size_t> count = 0;
+    public:
         /**
          * @brief add a new user
          * 
@@ -99,19 +131,33 @@ namespace network
         };
 
         /**
-         * @brief retrieve the requested PeerData struct, if the search fails throws NotFound
+         * @brief retrieve the requested peer, if the search fails throws NotFound
+         * 
+         * @param name search by name
+         * @return handle to the selected PeerData, lock its mutex before using it
+         */
+        Peer operator[](const std::string& name);
+        /**
+         * @brief retrieve the requested peer, if the search fails throws NotFound
+         * 
+         * @param name search by endpoint
+         * @return handle to the selected PeerData, lock its mutex before using it
+         */
+        Peer operator[](const boost::asio::ip::udp::endpoint& endpoint);
+        /**
+         * @brief retrieve the requested peer
          * 
          * @param name search by name
-         * @return the selected PeerData
+         * @return handle to the selected PeerData or nullptr if the user is not found
          */
-        PeerData& operator[](const std::string& name);
+        Peer find(const std::string& name);
         /**
-         * @brief retrieve the requested PeerData struct, if the search fails throws NotFound
+         * @brief retrieve the requested peer
          * 
          * @param name search by endpoint
-         * @return the selected PeerData
+         * @return handle to the selected PeerData or nullptr if the user is not found
          */
-        PeerData& operator[](const boost::asio::ip::udp::endpoint& endpoint);
+        Peer find(const boost::asio::ip::udp::endpoint& endpoint);
 
         /**
          * @brief check if a user is logged in
@@ -142,11 +188,9 @@ namespace network
          */
         std::vector<std::pair<std::string,boost::asio::ip::udp::endpoint>> get_connected_users();
     private:
-        bool _add_user(const std::string& name,const boost::asio::ip::udp::endpoint& endpoint);
-        bool _remove_user(const std::string& name);
-        bool _remove_user(const boost::asio::ip::udp::endpoint& endpoint);
-
-        PeerData& _op_sqbr(const std::string& name);
-        PeerData& _op_sqbr(const boost::asio::ip::udp::endpoint& endpoint);
+        Shard& _shard(const std::string& name);
+        Shard& _shard(const boost::asio::ip::udp::endpoint& endpoint);
+        // writers must be locked
+        bool _remove_user(const Peer& peer);
     };
 }
\ No newline at end of file
@@ -2,17 +2,17 @@
 #include "../../../defines.hpp"
 #include "../../../ansi_escape.hpp"
 #include "../../../logging/logging.hpp"
-#include "../../../base64/base64.h"
 #include <vector>
+#include <cstring>
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 #include <openssl/ec.h>
 #include <openssl/pem.h>
 #include <openssl/rand.h>
 #include <openssl/kdf.h>
+#include <openssl/crypto.h>
 namespace network::udp::crypto
 {
-    #define AES_IV_SIZE 8
     template <typename A, typename D>
     std::unique_ptr<A,D> make_handle(A* ptr, D deleter)
     {
@@ -124,57 +124,54 @@ namespace network::udp::crypto
             return {nullptr,nullptr};
         }
     }
-    std::tuple<std::string,std::string,std::string> encrypt(const std::string& message, const Key& key)
+    bool Key::operator==(const Key& other) const
     {
-        auto context = make_handle(EVP_CIPHER_CTX_new(),EVP_CIPHER_CTX_free);
-        unsigned char iv[AES_IV_SIZE];
-        unsigned char tag[AES_BLOCK_SIZE];
-        auto ret = RAND_bytes(iv,AES_IV_SIZE);
-        ret = EVP_EncryptInit_ex(context.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr);
-        ret = EVP_CIPHER_CTX_ctrl(context.get(),EVP_CTRL_GCM_SET_IVLEN,AES_IV_SIZE,nullptr);
-        ret = EVP_CIPHER_CTX_set_key_length(context.get(),SHA384_DIGEST_LENGTH);
-        ret = EVP_EncryptInit_ex(context.get(),nullptr,nullptr,key.data,iv);
-        int total_len = 0;
+        return CRYPTO_memcmp(data,other.data,AES256_KEY_SIZE) == 0;
+    }
+    Cipher::Cipher(const Key& key):
+        key(key),
+        encrypt_context(EVP_CIPHER_CTX_new(),EVP_CIPHER_CTX_free),
+        decrypt_context(EVP_CIPHER_CTX_new(),EVP_CIPHER_CTX_free)
+    {
+        if(not encrypt_context or not decrypt_context)
+            throw std::runtime_error{"EVP_CIPHER_CTX_new"};
+        if(RAND_bytes((unsigned char*)&next_iv,sizeof(next_iv)) != 1)
+            throw std::runtime_error{"RAND_bytes"};
+        if(not EVP_EncryptInit_ex(encrypt_context.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr)
+            or not EVP_CIPHER_CTX_ctrl(encrypt_context.get(),EVP_CTRL_GCM_SET_IVLEN,AES_IV_SIZE,nullptr)
+            or not EVP_EncryptInit_ex(encrypt_context.get(),nullptr,nullptr,key.data,nullptr))
+            throw std::runtime_error{"EVP_EncryptInit_ex"};
+        if(not EVP_DecryptInit_ex(decrypt_context.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr)
+            or not EVP_CIPHER_CTX_ctrl(decrypt_context.get(),EVP_CTRL_GCM_SET_IVLEN,AES_IV_SIZE,nullptr)
+            or not EVP_DecryptInit_ex(decrypt_context.get(),nullptr,nullptr,key.data,nullptr))
+            throw std::runtime_error{"EVP_DecryptInit_ex"};
+    }
+    bool Cipher::uses(const Key& key) const
+    {
+        return encrypt_context and this->key == key;
+    }
+    void Cipher::encrypt(std::string_view message, char* out, char* iv, char* tag)
+    {
+        auto counter = next_iv++;
+        memcpy(iv,&counter,AES_IV_SIZE);
+        // the key is kept by the context, only the IV changes
+        EVP_EncryptInit_ex(encrypt_context.get(),nullptr,nullptr,nullptr,(const unsigned char*)iv);
         int outl = 0;
-        std::vector<unsigned char> out(message.size()+AES_BLOCK_SIZE-message.size()%AES_BLOCK_SIZE);
-        ret = EVP_EncryptUpdate(context.get(),out.data(),&outl,(unsigned char*)message.c_str(),(int)message.length());
-        total_len += outl;
-        ret = EVP_EncryptFinal_ex(context.get(),out.data()+outl,&outl);
-        total_len += outl;
-        ret = EVP_CIPHER_CTX_ctrl(context.get(),EVP_CTRL_GCM_GET_TAG,AES_BLOCK_SIZE,tag);
-
-        std::unique_ptr<char> ret_data{new char[b64e_size((unsigned int)total_len)+1]};
-        std::unique_ptr<char> ret_iv{new char[b64e_size(AES_IV_SIZE)+1]};
-        std::unique_ptr<char> ret_tag{new char[b64e_size(AES_BLOCK_SIZE)+1]};
-        b64_encode(out.data(),(unsigned int)total_len,(unsigned char*)ret_data.get());
-        b64_encode(iv,AES_IV_SIZE,(unsigned char*)ret_iv.get());
-        b64_encode(tag,AES_BLOCK_SIZE,(unsigned char*)ret_tag.get());
-        return {ret_data.get(),ret_iv.get(),ret_tag.get()};
+        EVP_EncryptUpdate(encrypt_context.get(),(unsigned char*)out,&outl,(const unsigned char*)message.data(),(int)message.length());
+        EVP_EncryptFinal_ex(encrypt_context.get(),(unsigned char*)out+outl,&outl);
+        EVP_CIPHER_CTX_ctrl(encrypt_context.get(),EVP_CTRL_GCM_GET_TAG,AES_TAG_SIZE,tag);
     }
-    std::string decrypt(const std::string& cryptogram, const Key& key, const std::string& iv, const std::string& tag)
+    bool Cipher::decrypt(std::string_view cryptogram, char* out, std::string_view iv, std::string_view tag)
     {
-        auto context = make_handle(EVP_CIPHER_CTX_new(),EVP_CIPHER_CTX_free);
-        std::unique_ptr<unsigned char> raw_iv{new unsigned char[b64d_size((unsigned int)iv.length())]};
-        std::unique_ptr<unsigned char> raw_tag{new unsigned char[b64d_size((unsigned int)tag.length())]};
-        std::unique_ptr<unsigned char> raw_c{new unsigned char[b64d_size((unsigned int)cryptogram.length())]};
-        auto iv_len = b64_decode((unsigned char*)iv.c_str(),(unsigned int)iv.length(),raw_iv.get());
-        auto tag_len = b64_decode((unsigned char*)tag.c_str(),(unsigned int)tag.length(),raw_tag.get());
-        if(iv_len != AES_IV_SIZE or tag_len != AES_BLOCK_SIZE)
-            return "";
-        auto c_len = b64_decode((unsigned char*)cryptogram.c_str(),(unsigned int)cryptogram.length(),raw_c.get());
-        auto ret = EVP_DecryptInit_ex(context.get(),EVP_aes_256_gcm(),nullptr,nullptr,nullptr);
-        ret = EVP_CIPHER_CTX_ctrl(context.get(),EVP_CTRL_GCM_SET_IVLEN,AES_IV_SIZE,nullptr);
-        ret = EVP_CIPHER_CTX_set_key_length(context.get(),SHA384_DIGEST_LENGTH);
-        ret = EVP_DecryptInit_ex(context.get(),nullptr,nullptr,key.data,raw_iv.get());
-        int total_len = 0;
+        if(iv.length() != AES_IV_SIZE or tag.length() != AES_TAG_SIZE)
+            return false;
+        if(not EVP_DecryptInit_ex(decrypt_context.get(),nullptr,nullptr,nullptr,(const unsigned char*)iv.data()))
+            return false;
         int outl = 0;
-        std::vector<unsigned char> out(c_len+1);
-        ret = EVP_DecryptUpdate(context.get(),out.data(),&outl,raw_c.get(),c_len);
-        total_len += outl;
-        ret = EVP_CIPHER_CTX_ctrl(context.get(),EVP_CTRL_GCM_SET_TAG,AES_BLOCK_SIZE,raw_tag.get());
-        ret = EVP_DecryptFinal_ex(context.get(),out.data()+outl,&outl);
-        total_len += outl;
-        out[total_len] = 0;
-        return (char*)out.data();
+        if(not EVP_DecryptUpdate(decrypt_context.get(),(unsigned char*)out,&outl,(const unsigned char*)cryptogram.data(),(int)cryptogram.length()))
+            return false;
+        if(not EVP_CIPHER_CTX_ctrl(decrypt_context.get(),EVP_CTRL_GCM_SET_TAG,AES_TAG_SIZE,(void*)tag.data()))
+            return false;
+        return EVP_DecryptFinal_ex(decrypt_context.get(),(unsigned char*)out+outl,&outl) == 1;
     }
 }
\ No newline at end of file
@@ -1,16 +1,21 @@
 #pragma once
 #include <tuple>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <stdint.h>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
 #include <openssl/aes.h>
 #define AES256_KEY_SIZE 32
+#define AES_IV_SIZE 8
+#define AES_TAG_SIZE 16
 namespace network::udp::crypto
 {
     struct Key
     {
         unsigned char data[AES256_KEY_SIZE] = {0};
+        bool operator==(const Key& other) const;
     };
     std::string pubkey_to_string(EVP_PKEY* x);
     std::unique_ptr<EVP_PKEY,decltype(&::EVP_PKEY_free)> string_to_pubkey(const std::string& s);
@@ -20,6 +25,47 @@ namespace network::udp::crypto
 
     std::unique_ptr<EVP_PKEY,decltype(&::EVP_PKEY_free)> gen_ecdhe_key();
     Key ecdhe(EVP_PKEY* local_private, EVP_PKEY* remote_public);
-    std::tuple<std::string,std::string,std::string> encrypt(const std::string& message, const Key& key);
-    std::string decrypt(const std::string& cryptogram, const Key& key, const std::string& iv, const std::string& tag);
+    /**
+     * @brief AES256-GCM cipher bound to a key, the EVP contexts are created and keyed
+     * only once so every message needs only the IV to be set.
+     * IVs are a counter starting from a random value, this way they never repeat for the
+     * same key without calling RAND_bytes for every message.
+     * This is not thread safe, for peers it's protected by PeerData::mutex
+     * 
+     */
+    class Cipher
+    {
+    public:
+        Cipher() = default;
+        explicit Cipher(const Key& key);
+        /**
+         * @brief check if the cipher was created with the given key
+         * 
+         */
+        bool uses(const Key& key) const;
+        /**
+         * @brief encrypt a message, the cryptogram has the same length of the message
+         * 
+         * @param message the plain text
+         * @param out where the cryptogram is written, it can be message.data() to encrypt in place
+         * @param iv where the IV is written (AES_IV_SIZE bytes)
+         * @param tag where the authentication tag is written (AES_TAG_SIZE bytes)
+         */
+        void encrypt(std::string_view message, char* out, char* iv, char* tag);
+        /**
+         * @brief decrypt and authenticate a message, the plain text has the same length of the cryptogram
+         * 
+         * @param cryptogram the encrypted message
+         * @param out where the plain text is written, it can be cryptogram.data() to decrypt in place
+         * @param iv the IV (it must be AES_IV_SIZE bytes)
+         * @param tag the authentication tag (it must be AES_TAG_SIZE bytes)
+         * @return false if the sizes are wrong or the message was not authenticated
+         */
+        bool decrypt(std::string_view cryptogram, char* out, std::string_view iv, std::string_view tag);
+    private:
+        Key key;
+        uint64_t next_iv = 0;
+        std::unique_ptr<EVP_CIPHER_CTX,decltype(&::EVP_CIPHER_CTX_free)> encrypt_context{nullptr,EVP_CIPHER_CTX_free};
+        std::unique_ptr<EVP_CIPHER_CTX,decltype(&::EVP_CIPHER_CTX_free)> decrypt_context{nullptr,EVP_CIPHER_CTX_free};
+    };
 }
@@ -1,6 +1,15 @@
 #include "udp.hpp"
 #include "../../defines.hpp"
 #include "../../ansi_escape.hpp"
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <string_view>
+#include <deque>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <memory>
 #include <boost/asio/io_service.hpp>
 #include <boost/date_time.hpp>
 #include <boost/thread.hpp>
@@ -8,6 +17,10 @@
 #include "../../logging/logging.hpp"
 #include "../../parsing/parsing.hpp"
 #include "crypto/crypto.hpp"
+#include "wire/wire.hpp"
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
 namespace network::udp
 {
     DataMap connection_map;
@@ -16,91 +29,413 @@ namespace network::udp
     boost::asio::ip::udp::socket socket(io_service);
     boost::asio::ip::udp::endpoint local_endpoint;
 
-    std::mutex message_queue_association_mutex;
+    constexpr size_t MAX_DATAGRAM_SIZE = 65536;
+    constexpr size_t MAX_RECEIVE_BATCH = 1024;
+    constexpr unsigned int INTERRUPTION_CHECK_EVERY = 100; // ms
+    /**
+     * @brief preallocated buffers where the datagrams are received, they are passed
+     * to handle_message as views and reused for the next batch
+     * 
+     */
+    struct ReceivePool
+    {
+        size_t batch = 0;
+        std::vector<char> data;
+        std::vector<size_t> lengths;
+        std::vector<boost::asio::ip::udp::endpoint> endpoints;
+        #ifdef __linux__
+        std::vector<mmsghdr> headers;
+        std::vector<iovec> iovecs;
+        #endif
+        char* buffer(size_t i)
+        {
+            return data.data() + i*MAX_DATAGRAM_SIZE;
+        }
+        void init(size_t batch)
+        {
+            this->batch = batch;
+            data = std::vector<char>(batch*MAX_DATAGRAM_SIZE);
+            lengths = std::vector<size_t>(batch,0);
+            endpoints = std::vector<boost::asio::ip::udp::endpoint>(batch);
+            #ifdef __linux__
+            headers = std::vector<mmsghdr>(batch);
+            iovecs = std::vector<iovec>(batch);
+            for(size_t i = 0; i < batch; i++)
+            {
+                iovecs[i].iov_base = buffer(i);
+                iovecs[i].iov_len = MAX_DATAGRAM_SIZE;
+                headers[i] = mmsghdr{};
+                headers[i].msg_hdr.msg_name = endpoints[i].data();
+                headers[i].msg_hdr.msg_iov = &iovecs[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+            }
+            #endif
+        }
+    };
+    ReceivePool receive_pool;
+
+    constexpr size_t MAX_SEND_BATCH = 64;
+    /**
+     * @brief datagrams waiting to be sent by udp_sender, one queue for every destination
+     * 
+     */
+    boost::mutex outbound_mutex;
+    boost::condition_variable outbound_ready;
+    std::map<boost::asio::ip::udp::endpoint,std::deque<std::string>> outbound_queues;
+    #ifdef _TEST
+    // link emulation, protected by outbound_mutex
+    double emulated_loss = 0;
+    boost::posix_time::time_duration emulated_delay;
+    struct DelayedDatagram
+    {
+        boost::posix_time::ptime due;
+        boost::asio::ip::udp::endpoint endpoint;
+        std::string datagram;
+    };
+    // the delay is constant so the datagrams are due in order
+    std::deque<DelayedDatagram> delayed_datagrams;
+    std::minstd_rand emulation_random;
+    void emulate_link(double loss, boost::posix_time::time_duration delay)
+    {
+        {
+            boost::unique_lock lock(outbound_mutex);
+            emulated_loss = loss;
+            emulated_delay = delay;
+        }
+        outbound_ready.notify_one();
+    }
+    #endif
+
     struct QueueAssociationEntry
     {
         MessageQueue* queue;
         bool connection_required;
     };
-    std::map<std::string,QueueAssociationEntry> message_queue_association;
+    /**
+     * @brief keyword -> queue table used by handle_message, it's never modified after it's published
+     * so it's read without locking. the slot of a keyword is chosen by a seeded hash and the seed
+     * is searched when the table is built so that every keyword has its own slot, a lookup is
+     * one hash and one comparison
+     * 
+     */
+    class DispatchTable
+    {
+    public:
+        explicit DispatchTable(const std::map<std::string,QueueAssociationEntry,std::less<>>& associations)
+        {
+            size_t size = 8;
+            while(size < associations.size()*2)
+                size *= 2;
+            for(auto& [keyword, entry]: associations)
+                max_length = std::max(max_length,keyword.length());
+            while(true)
+            {
+                for(seed = 0; seed < MAX_SEEDS; seed++)
+                {
+                    slots.assign(size,{});
+                    mask = size - 1;
+                    bool collision = false;
+                    for(auto& [keyword, entry]: associations)
+                    {
+                        auto& slot = slots[_hash(keyword,seed) & mask];
+                        if(slot.entry.queue != nullptr)
+                        {
+                            collision = true;
+                            break;
+                        }
+                        slot = {keyword,entry};
+                    }
+                    if(not collision)
+                        return;
+                }
+                size *= 2;
+            }
+        }
+        // returns nullptr if no queue is registered for the keyword
+        const QueueAssociationEntry* find(std::string_view keyword) const
+        {
+            if(keyword.length() > max_length)
+                return nullptr;
+            auto& slot = slots[_hash(keyword,seed) & mask];
+            if(slot.entry.queue == nullptr or slot.keyword != keyword)
+                return nullptr;
+            return &slot.entry;
+        }
+    private:
+        static constexpr size_t MAX_SEEDS = 256;
+        // FNV-1a
+        static size_t _hash(std::string_view keyword, size_t seed)
+        {
+            uint64_t hash = 14695981039346656037ull ^ (seed * 0x9e3779b97f4a7c15ull);
+            for(auto c: keyword)
+            {
+                hash ^= (uint8_t)c;
+                hash *= 1099511628211ull;
+            }
+            return (size_t)(hash ^ (hash >> 32));
+        }
+        struct Slot
+        {
+            std::string keyword;
+            QueueAssociationEntry entry{nullptr,false};
+        };
+        std::vector<Slot> slots;
+        size_t mask = 0;
+        size_t seed = 0;
+        size_t max_length = 0;
+    };
+    // only used by register_queue
+    std::mutex message_queue_association_mutex;
+    std::map<std::string,QueueAssociationEntry,std::less<>> message_queue_association;
+    // every published table is kept, a table is only built when a queue is registered during the init
+    std::vector<std::unique_ptr<const DispatchTable>> dispatch_tables;
+    std::atomic<const DispatchTable*> dispatch_table = nullptr;
+
+    std::mutex queues_mutex;
+    std::map<std::string,QueueOptions> configured_queue_options;
+    std::vector<std::pair<std::string,MessageQueue*>> queues;
 
     std::mutex requested_clients_mutex;
     std::map<std::string,boost::posix_time::ptime> requested_clients;
 
-    bool send(std::string message, const std::string& name)
+    // queue a datagram for udp_sender
+    void enqueue(std::string&& datagram, const boost::asio::ip::udp::endpoint& endpoint)
     {
-        try{
-            std::unique_lock lock(udp::connection_map.obj);
-            auto& info = connection_map[name];
-            auto endpoint = info.endpoint;
-            if(info.encrypted)
+        {
+            boost::unique_lock lock(outbound_mutex);
+            #ifdef _TEST
+            if(emulated_loss > 0 and std::uniform_real_distribution<double>(0,1)(emulation_random) < emulated_loss)
+                return;
+            if(not emulated_delay.is_special() and emulated_delay > boost::posix_time::time_duration{})
             {
-                auto enc = crypto::encrypt(message,info.symmetric_key);
-                message = parsing::compose_message({"C",std::get<0>(enc),std::get<1>(enc),std::get<2>(enc)});
+                delayed_datagrams.push_back({boost::posix_time::microsec_clock::local_time()+emulated_delay,endpoint,std::move(datagram)});
+                outbound_ready.notify_one();
+                return;
             }
+            #endif
+            outbound_queues[endpoint].emplace_back(std::move(datagram));
+        }
+        outbound_ready.notify_one();
+    }
+    // returns the cipher of a peer, it's created again if the key was changed, info.mutex must be locked
+    crypto::Cipher& _cipher(DataMap::PeerData& info)
+    {
+        if(not info.cipher.uses(info.symmetric_key))
+            info.cipher = crypto::Cipher{info.symmetric_key};
+        return info.cipher;
+    }
+    // encrypt the message if the connection is encrypted, info.mutex must be locked
+    void _seal(std::string& message, DataMap::PeerData& info)
+    {
+        if(not info.encrypted)
+            return;
+        auto& cipher = _cipher(info);
+        if(info.binary)
+        {// the cryptogram is written directly inside the frame
+            std::string frame;
+            frame.reserve(message.length() + AES_IV_SIZE + AES_TAG_SIZE + 16);
+            wire::begin_frame(frame,"C");
+            auto cryptogram = wire::append_field(frame,message.length());
+            char iv[AES_IV_SIZE], tag[AES_TAG_SIZE];
+            cipher.encrypt(message,cryptogram,iv,tag);
+            memcpy(wire::append_field(frame,AES_IV_SIZE),iv,AES_IV_SIZE);
+            memcpy(wire::append_field(frame,AES_TAG_SIZE),tag,AES_TAG_SIZE);
+            message.swap(frame);
+        }
+        else
+        {
+            std::string iv(AES_IV_SIZE,'\0'), tag(AES_TAG_SIZE,'\0');
+            cipher.encrypt(message,message.data(),iv.data(),tag.data());
+            message = wire::compose({"C",message,iv,tag},false);
+        }
+    }
+    bool send(std::string message, const std::string& name)
+    {
+        boost::asio::ip::udp::endpoint endpoint;
+        try{
+            auto peer = connection_map[name];
+            std::unique_lock lock(peer->mutex);
+            endpoint = peer->endpoint;
+            _seal(message,*peer);
             #ifdef LL_DEBUG
             logging::log("DBG","Message to " HIGHLIGHT +name+ RESET " sent: \"" HIGHLIGHT + message + RESET "\"" );
             #endif
-            message+='\n';    
-            socket.send_to(boost::asio::buffer(message,message.length()),endpoint);
-            return true;
         }catch(DataMap::NotFound&){
             return false;
         }
-        
+        message+='\n';
+        enqueue(std::move(message),endpoint);
+        return true;
     }
     void send(std::string message, const boost::asio::ip::udp::endpoint& endpoint)
     {
         try
         {
-            try
+            auto peer = connection_map[endpoint];
+            std::unique_lock lock(peer->mutex);
+            #ifdef LL_DEBUG
+            logging::log("DBG","Message to " HIGHLIGHT +peer->name+ RESET " sent: \"" HIGHLIGHT + message + RESET "\"" );
+            #endif
+            _seal(message,*peer);
+        }
+        catch(DataMap::NotFound&)
+        {}
+        message+='\n';
+        enqueue(std::move(message),endpoint);
+    }
+    bool send(const std::vector<std::string>& fields, const std::string& name)
+    {
+        boost::asio::ip::udp::endpoint endpoint;
+        std::string message;
+        try{
+            auto peer = connection_map[name];
+            std::unique_lock lock(peer->mutex);
+            endpoint = peer->endpoint;
+            message = wire::compose(fields,peer->binary);
+            _seal(message,*peer);
+        }catch(DataMap::NotFound&){
+            return false;
+        }
+        message+='\n';
+        enqueue(std::move(message),endpoint);
+        return true;
+    }
+    void send(const std::vector<std::string>& fields, const boost::asio::ip::udp::endpoint& endpoint)
+    {
+        std::string message;
+        try
+        {
+            auto peer = connection_map[endpoint];
+            std::unique_lock lock(peer->mutex);
+            message = wire::compose(fields,peer->binary);
+            _seal(message,*peer);
+        }
+        catch(DataMap::NotFound&)
+        {
+            message = wire::compose(fields,false);
+        }
+        message+='\n';
+        enqueue(std::move(message),endpoint);
+    }
+    // send up to MAX_SEND_BATCH datagrams with a single syscall, returns how many were sent
+    size_t send_datagrams(const std::vector<std::pair<const boost::asio::ip::udp::endpoint*,std::string*>>& batch, size_t first)
+    {
+        auto count = std::min(MAX_SEND_BATCH,batch.size()-first);
+        #ifdef __linux__
+        mmsghdr headers[MAX_SEND_BATCH];
+        iovec iovecs[MAX_SEND_BATCH];
+        for(size_t i = 0; i < count; i++)
+        {
+            auto& [endpoint, datagram] = batch[first+i];
+            iovecs[i].iov_base = datagram->data();
+            iovecs[i].iov_len = datagram->length();
+            headers[i] = mmsghdr{};
+            headers[i].msg_hdr.msg_name = (void*)endpoint->data();
+            headers[i].msg_hdr.msg_namelen = (socklen_t)endpoint->size();
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+        auto sent = sendmmsg(socket.native_handle(),headers,(unsigned int)count,0);
+        if(sent < 0)
+        {// the first datagram could not be sent, skip it
+            logging::log("ERR",boost::system::error_code(errno,boost::system::system_category()).message());
+            return 1;
+        }
+        return (size_t)sent;
+        #else
+        for(size_t i = 0; i < count; i++)
+        {
+            auto& [endpoint, datagram] = batch[first+i];
+            boost::system::error_code ec;
+            socket.send_to(boost::asio::buffer(*datagram),*endpoint,0,ec);
+            if(ec)
+                logging::log("ERR",ec.message());
+        }
+        return count;
+        #endif
+    }
+    void udp_sender()
+    {
+        std::map<boost::asio::ip::udp::endpoint,std::deque<std::string>> pending;
+        std::vector<std::pair<const boost::asio::ip::udp::endpoint*,std::string*>> batch;
+        while(true)
+        {
             {
-                std::unique_lock lock(connection_map.obj);
-                auto& info = connection_map[endpoint];
-                #ifdef LL_DEBUG
-                logging::log("DBG","Message to " HIGHLIGHT +info.name+ RESET " sent: \"" HIGHLIGHT + message + RESET "\"" );
+                boost::unique_lock lock(outbound_mutex);
+                #ifdef _TEST
+                while(true)
+                {
+                    auto now = boost::posix_time::microsec_clock::local_time();
+                    while(not delayed_datagrams.empty() and delayed_datagrams.front().due <= now)
+                    {
+                        auto& delayed = delayed_datagrams.front();
+                        outbound_queues[delayed.endpoint].emplace_back(std::move(delayed.datagram));
+                        delayed_datagrams.pop_front();
+                    }
+                    if(not outbound_queues.empty())
+                        break;
+                    if(delayed_datagrams.empty())
+                        outbound_ready.wait(lock);
+                    else
+                        outbound_ready.wait_for(lock,boost::chrono::microseconds((delayed_datagrams.front().due-now).total_microseconds()));
+                }
+                #else
+                while(outbound_queues.empty())
+                    outbound_ready.wait(lock);
                 #endif
-                if(info.encrypted)
+                pending.swap(outbound_queues);
+            }
+            // interleave the peers so that a long queue does not delay the others
+            batch.clear();
+            bool found = true;
+            for(size_t depth = 0; found; depth++)
+            {
+                found = false;
+                for(auto& [endpoint, queue]: pending)
                 {
-                    auto enc = crypto::encrypt(message,info.symmetric_key);
-                    message = parsing::compose_message({"C",std::get<0>(enc),std::get<1>(enc),std::get<2>(enc)});
+                    if(depth < queue.size())
+                    {
+                        batch.emplace_back(&endpoint,&queue[depth]);
+                        found = true;
+                    }
                 }
             }
-            catch(DataMap::NotFound&)
-            {}
-            message+='\n';       
-            socket.send_to(boost::asio::buffer(message,message.length()),endpoint);
-        }catch(boost::system::system_error& e)
-        {
-            logging::log("ERR",e.what());
+            for(size_t sent = 0; sent < batch.size();)
+                sent += send_datagrams(batch,sent);
+            pending.clear();
         }
-        
     }
-    void handle_message(const std::string& name,const boost::asio::ip::udp::endpoint& endpoint, std::string msg)
+    // peer is nullptr for anonymous users
+    void handle_message(const DataMap::Peer& peer,const boost::asio::ip::udp::endpoint& endpoint, std::string_view msg)
     {
-        msg.pop_back();//remove '\n'
+        static const std::string anonymous;
+        auto& name = peer != nullptr ? peer->name : anonymous;
+        msg.remove_suffix(1);//remove '\n'
         
-        auto keyword = parsing::get_msg_keyword(msg);
+        // only the listener thread handles messages, so the buffers can be reused
+        static parsing::Tokens args;
+        static std::string decrypted;
+        auto keyword = wire::get_keyword(msg);
         if(keyword == "C")
         {
-            if(name.length() != 0)
+            if(peer != nullptr)
             {
-                try{
-                    std::unique_lock lock(connection_map.obj);
-                    auto& info = connection_map[name];
-                    if(info.encrypted)
+                std::unique_lock lock(peer->mutex);
+                if(peer->encrypted)
+                {
+                    wire::tokenize(msg,args);
+                    if(args.size() != 4)
+                        return;
+                    auto cryptogram = args[1];
+                    decrypted.resize(cryptogram.length());
+                    if(not _cipher(*peer).decrypt(cryptogram,decrypted.data(),args[2],args[3]))
                     {
-                        auto args = parsing::msg_split(msg);
-                        if(args.size() == 4)
-                        {
-                            msg = crypto::decrypt(args[1],info.symmetric_key,args[2],args[3]);
-                            keyword = parsing::get_msg_keyword(msg);
-                        }
-                        else
-                            return;
+                        logging::log("DBG","Dropped encrypted message from " HIGHLIGHT + name + RESET " that was not authenticated");
+                        return;
                     }
-                }catch(DataMap::NotFound&)
-                {}
+                    msg = decrypted;
+                    keyword = wire::get_keyword(msg);
+                }
             }
             else
             {
@@ -109,78 +444,131 @@ namespace network::udp
             }
         }
 
+        auto table = dispatch_table.load(std::memory_order_acquire);
+        auto entry = table != nullptr ? table->find(keyword) : nullptr;
         #ifdef LL_DEBUG
+        if(entry == nullptr)
+        {
+            logging::log("DBG","Message keyword \"" HIGHLIGHT +std::string(keyword)+ RESET "\" not recognized");
+            return;
+        }
         if(name.length() == 0)
-            logging::message_log(endpoint.address().to_string() + ":" + std::to_string(endpoint.port()),msg);
+            logging::message_log(endpoint.address().to_string() + ":" + std::to_string(endpoint.port()),std::string(msg));
         else
-            logging::message_log(name,msg);
+            logging::message_log(name,std::string(msg));
         #endif
-
-        std::unique_lock lock(message_queue_association_mutex);
-        auto queue = message_queue_association.find(keyword);
-        if(queue!=message_queue_association.end())
+        if(entry == nullptr) // dropped before copying anything
+            return;
+        if(peer != nullptr or not entry->connection_required)
+        {// the slot keeps the buffers of an item already handled, assign reuses them
+            // if the queue is full its overflow policy decides, the drop is counted by the queue
+            entry->queue->push_with([&](MessageQueueItem& item){
+                item.src.assign(name);
+                item.src_endpoint = endpoint;
+                item.msg.assign(msg);
+                item.peer = peer;
+            });
+        }else
         {
-            if(name != "" or not queue->second.connection_required)
-            {
-                queue->second.queue->push({name,endpoint,msg});
-            }else
-            {
-                logging::log("DBG","Message \"" HIGHLIGHT + keyword + RESET "\" refused from anonymous user (" HIGHLIGHT + endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(endpoint.port()) + RESET ")");
-            }
+            logging::log("DBG","Message \"" HIGHLIGHT + std::string(keyword) + RESET "\" refused from anonymous user (" HIGHLIGHT + endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(endpoint.port()) + RESET ")");
         }
-        else
+    }
+    void dispatch_datagram(const boost::asio::ip::udp::endpoint& sender_endpoint, std::string_view recv_data)
+    {
+        // the only lookup for this datagram, the handle is passed down to the queues
+        auto peer = connection_map.find(sender_endpoint);
+        if(peer == nullptr)
+        {
+            handle_message(nullptr,sender_endpoint,recv_data);
+            return;
+        }
+        // tmpData is only used by this thread, so the peer is not locked
+        // (if a queue is full handle_message waits, while the handlers may need the lock)
+        auto& peerdata = *peer;
+        if(peerdata.tmpData.length() == 0 and recv_data.back()=='\n')
+        {// complete message, no need to copy it
+            handle_message(peer,sender_endpoint,recv_data);
+            return;
+        }
+        peerdata.tmpData+=recv_data;
+        if(peerdata.tmpData.back()=='\n')
         {
-            logging::log("DBG","Message keyword \"" HIGHLIGHT +keyword+ RESET "\" not recognized");
+            handle_message(peer,sender_endpoint,peerdata.tmpData);
+            peerdata.tmpData="";
         }
     }
-    void udp_listener()
+    // receive every datagram already waiting on the socket (up to receive_pool.batch), returns how many were received
+    size_t receive_datagrams()
     {
-        while(true)
+        #ifdef __linux__
+        for(size_t i = 0; i < receive_pool.batch; i++)
+            receive_pool.headers[i].msg_hdr.msg_namelen = (socklen_t)receive_pool.endpoints[i].capacity();
+        auto count = recvmmsg(socket.native_handle(),receive_pool.headers.data(),(unsigned int)receive_pool.batch,MSG_DONTWAIT,nullptr);
+        if(count <= 0) // if errno is set someone tried to connect to itself... ignore it
+            return 0;
+        for(size_t i = 0; i < (size_t)count; i++)
         {
-            auto len = socket.available();
-            if(len==0)
-            {
-                boost::this_thread::interruption_point();
-                boost::this_thread::yield(); // not wasting time now
-                continue;
-            }
-            auto data = new char[len+1];
-            boost::asio::ip::udp::endpoint sender_endpoint;
-            try{
-                auto recv_len = socket.receive_from(boost::asio::buffer(data,len),sender_endpoint);
-                assert(recv_len<=len);
-                data[recv_len] = '\0';
-            }catch(boost::system::system_error&)
-            { // someone tried to connect to itself... ingnore it
-                delete[] data;
-                continue;
-            }
-            
-            std::string recv_data = data;
-            delete[] data;
-            try
+            receive_pool.endpoints[i].resize(receive_pool.headers[i].msg_hdr.msg_namelen);
+            receive_pool.lengths[i] = receive_pool.headers[i].msg_len;
+        }
+        return (size_t)count;
+        #else
+        size_t count = 0;
+        for(size_t tries = 0; tries < receive_pool.batch and count < receive_pool.batch and socket.available() > 0; tries++)
+        {
+            boost::system::error_code ec;
+            receive_pool.lengths[count] = socket.receive_from(boost::asio::buffer(receive_pool.buffer(count),MAX_DATAGRAM_SIZE),receive_pool.endpoints[count],0,ec);
+            if(not ec) // if ec is set someone tried to connect to itself... ignore it
+                count++;
+        }
+        return count;
+        #endif
+    }
+    void start_receive()
+    {
+        socket.async_wait(boost::asio::ip::udp::socket::wait_read,
+            [](const boost::system::error_code& ec)
             {
-                std::unique_lock lock(udp::connection_map.obj);
-                auto& peerdata = connection_map[sender_endpoint];
-                peerdata.tmpData+=recv_data;
-                if(peerdata.tmpData.back()=='\n')
+                if(not ec)
                 {
-                    handle_message(peerdata.name,sender_endpoint,peerdata.tmpData);
-                    peerdata.tmpData="";
+                    size_t count = 0;
+                    do
+                    {
+                        count = receive_datagrams();
+                        for(size_t i = 0; i < count; i++)
+                        {
+                            if(receive_pool.lengths[i] > 0)
+                                dispatch_datagram(receive_pool.endpoints[i],std::string_view(receive_pool.buffer(i),receive_pool.lengths[i]));
+                        }
+                    }while(count == receive_pool.batch); // there may be more datagrams waiting
                 }
-            }catch(DataMap::NotFound&)
-            {
-                handle_message("",sender_endpoint,recv_data);
-            }
+                start_receive();
+            });
+    }
+    void udp_listener()
+    {
+        start_receive();
+        while(true)
+        {// the thread sleeps inside the io_service until a datagram arrives or it's time to check for interruptions
+            io_service.run_one_for(std::chrono::milliseconds(INTERRUPTION_CHECK_EVERY));
+            if(io_service.stopped())
+                io_service.restart();
+            boost::this_thread::interruption_point();
         }
     }
-    void init(uint16_t port)
+    void init(uint16_t port, size_t receive_batch, const std::map<std::string,QueueOptions>& queue_options)
     {
+        {
+            std::unique_lock lock(queues_mutex);
+            configured_queue_options = queue_options;
+        }
+        receive_pool.init(std::clamp<size_t>(receive_batch,1,MAX_RECEIVE_BATCH));
         local_endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("0.0.0.0"),port);
         socket.open(IP_VERSION);
         socket.bind(local_endpoint);
 
         multithreading::add_service("udp_listener",udp_listener); 
+        multithreading::add_service("udp_sender",udp_sender);
         auto localhost = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"),port);
 
         if(DEBUG)
@@ -190,6 +578,25 @@ namespace network::udp
     {
         std::unique_lock lock(message_queue_association_mutex);
         message_queue_association[keyword] = {&queue,connection_required};
+        dispatch_tables.emplace_back(std::make_unique<DispatchTable>(message_queue_association));
+        dispatch_table.store(dispatch_tables.back().get(),std::memory_order_release);
+    }
+    void setup_queue(const std::string& name, MessageQueue& queue, QueueOptions defaults)
+    {
+        std::unique_lock lock(queues_mutex);
+        auto options = configured_queue_options.find(name);
+        if(options != configured_queue_options.end())
+            defaults = options->second;
+        queue.configure(defaults.capacity,defaults.policy);
+        queues.emplace_back(name,&queue);
+    }
+    std::vector<QueueStats> queue_stats()
+    {
+        std::unique_lock lock(queues_mutex);
+        std::vector<QueueStats> ret;
+        for(auto& [name, queue]: queues)
+            ret.push_back({name,queue->size(),queue->capacity(),queue->dropped()});
+        return ret;
     }
     const char* LookupError::what()
     {
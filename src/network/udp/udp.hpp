@@ -1,7 +1,9 @@
 #pragma once
 #include <stdint.h>
 #include "DataMap/DataMap.hpp"
+#include <map>
 #include <string>
+#include <vector>
 #include <exception>
 #include <boost/asio/ip/udp.hpp>
 #include "../MessageQueue/MessageQueue.hpp"
@@ -23,12 +25,35 @@ namespace network::udp
      * 
      */
     extern DataMap connection_map;
+    /**
+     * @brief capacity and overflow policy of a MessageQueue
+     * 
+     */
+    struct QueueOptions
+    {
+        size_t capacity;
+        OverflowPolicy policy;
+    };
+    /**
+     * @brief state of a queue set up with setup_queue
+     * 
+     */
+    struct QueueStats
+    {
+        std::string name;
+        size_t depth;
+        size_t capacity;
+        size_t dropped;
+    };
     /**
      * @brief initialize the module
      * 
      * @param port the port on which we will listen (UDP)
+     * @param receive_batch how many datagrams can be received with a single syscall,
+     * this is also the number of receive buffers preallocated
+     * @param queue_options options from the config for the queues set up with setup_queue, by name
      */
-    void init(uint16_t port);
+    void init(uint16_t port, size_t receive_batch, const std::map<std::string,QueueOptions>& queue_options = {});
     /**
      * @brief send a message to a connected user, the name is searched inside connection_map
      * 
@@ -45,6 +70,24 @@ namespace network::udp
      * @param endpoint the destination
      */
     void send(std::string message, const boost::asio::ip::udp::endpoint& endpoint);
+    /**
+     * @brief compose a message with wire::compose and send it to a connected user,
+     * the message will be a binary frame if the user supports it
+     * 
+     * @param fields the fields of the message, payload fields must be raw bytes
+     * @param name the destination
+     * @return true if the user was found inside connection_map
+     * @return false if the user is not connected
+     */
+    bool send(const std::vector<std::string>& fields, const std::string& name);
+    /**
+     * @brief compose a message with wire::compose and send it to an endpoint,
+     * the message will be a binary frame if the endpoint is a connected user that supports it
+     * 
+     * @param fields the fields of the message, payload fields must be raw bytes
+     * @param endpoint the destination
+     */
+    void send(const std::vector<std::string>& fields, const boost::asio::ip::udp::endpoint& endpoint);
     /**
      * @brief register a MessageQueue linking it to a specific keyword, when a message with that keyword\
      * is recived, it will be added to the queue, you can require the source endpoint to be registered, if you do so
@@ -55,6 +98,21 @@ namespace network::udp
      * @param connection_required true if you want to exclude messages from an endpoint that is not registered
      */
     void register_queue(std::string keyword, MessageQueue& queue, bool connection_required);
+    /**
+     * @brief configure a queue before registering it, the options passed to init override the defaults,
+     * the queue will be listed by queue_stats
+     * 
+     * @param name name of the queue in the config and in queue_stats
+     * @param queue the queue, it must not be registered yet
+     * @param defaults capacity and policy used if the config doesn't specify them
+     */
+    void setup_queue(const std::string& name, MessageQueue& queue, QueueOptions defaults);
+    /**
+     * @brief get depth and drops of every queue set up with setup_queue
+     * 
+     * @return a vector with the state of each queue
+     */
+    std::vector<QueueStats> queue_stats();
     /**
      * @brief exception thrown by dns_lookup if no valid IP was found
      * 
@@ -95,4 +153,13 @@ namespace network::udp
      * @param name name of the user not found
      */
     void server_request_fail(const std::string& name);
+    #ifdef _TEST
+    /**
+     * @brief emulate a lossy link with a delay for every datagram sent, only available in tests
+     * 
+     * @param loss probability of dropping a datagram, from 0 to 1
+     * @param delay time a datagram is held before being sent
+     */
+    void emulate_link(double loss, boost::posix_time::time_duration delay);
+    #endif
 }
\ No newline at end of file
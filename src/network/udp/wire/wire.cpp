@@ -0,0 +1,176 @@
+#include "wire.hpp"
+#include "../../../defines.hpp"
+#include <array>
+#include <stdint.h>
+#include "../../../parsing/parsing.hpp"
+#include "../../../base64/base64.h"
+namespace network::udp::wire
+{
+    /**
+     * @brief a keyword that can be sent in a binary frame
+     * 
+     */
+    struct BinaryKeyword
+    {
+        uint8_t id;
+        std::string_view keyword;
+        // every field with the bit set is a payload field
+        uint32_t payload_mask;
+    };
+    constexpr std::array<BinaryKeyword,5> binary_keywords = {{
+        {1,"FILE",1u<<3},
+        {2,"FILEACK",1u<<3},
+        {3,"AUDIO",1u<<3},
+        {4,"C",(1u<<1)|(1u<<2)|(1u<<3)},
+        {5,"AUDIOFWD",1u<<4},
+    }};
+    const BinaryKeyword* find_keyword(std::string_view keyword)
+    {
+        for(auto& k: binary_keywords)
+        {
+            if(k.keyword == keyword)
+                return &k;
+        }
+        return nullptr;
+    }
+    const BinaryKeyword* find_keyword(uint8_t id)
+    {
+        for(auto& k: binary_keywords)
+        {
+            if(k.id == id)
+                return &k;
+        }
+        return nullptr;
+    }
+    bool is_binary(std::string_view msg)
+    {
+        return msg.length() >= 2 and msg[0] == BINARY_MARKER;
+    }
+    bool is_payload(std::string_view keyword, size_t index)
+    {
+        auto k = find_keyword(keyword);
+        return k != nullptr and index < 32 and (k->payload_mask & (1u<<index)) != 0;
+    }
+    std::string_view get_keyword(std::string_view msg)
+    {
+        if(is_binary(msg))
+        {
+            auto k = find_keyword((uint8_t)msg[1]);
+            return k != nullptr ? k->keyword : "";
+        }
+        return parsing::get_msg_keyword(msg);
+    }
+    void append_varint(std::string& out, size_t value)
+    {
+        do
+        {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            if(value != 0)
+                byte |= 0x80;
+            out += (char)byte;
+        }while(value != 0);
+    }
+    // returns false if the varint is truncated or too long
+    bool read_varint(std::string_view msg, size_t& pos, size_t& value)
+    {
+        value = 0;
+        for(unsigned int shift = 0; pos < msg.length() and shift < 64; shift += 7)
+        {
+            uint8_t byte = (uint8_t)msg[pos++];
+            value |= size_t(byte & 0x7f) << shift;
+            if((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+    std::string base64_encode(const std::string& raw)
+    {
+        auto encoded_size = b64e_size((unsigned int)raw.length());
+        std::string ret(encoded_size+1,'\0');
+        b64_encode((const unsigned char*)raw.data(),(unsigned int)raw.length(),(unsigned char*)ret.data());
+        ret.resize(encoded_size);
+        return ret;
+    }
+    bool begin_frame(std::string& frame, std::string_view keyword)
+    {
+        auto k = find_keyword(keyword);
+        if(k == nullptr)
+            return false;
+        frame.clear();
+        frame += BINARY_MARKER;
+        frame += (char)k->id;
+        return true;
+    }
+    char* append_field(std::string& frame, size_t length)
+    {
+        append_varint(frame,length);
+        frame.resize(frame.length()+length);
+        return frame.data()+frame.length()-length;
+    }
+    std::string compose(const std::vector<std::string>& fields, bool binary)
+    {
+        if(fields.empty())
+            return "";
+        auto k = find_keyword(fields[0]);
+        if(binary and k != nullptr)
+        {
+            size_t total = 2;
+            for(size_t i = 1; i < fields.size(); i++)
+                total += fields[i].length() + 10;
+            std::string ret;
+            ret.reserve(total);
+            begin_frame(ret,k->keyword);
+            for(size_t i = 1; i < fields.size(); i++)
+                fields[i].copy(append_field(ret,fields[i].length()),fields[i].length());
+            return ret;
+        }
+        else if(k != nullptr and k->payload_mask != 0)
+        {
+            auto text_fields = fields;
+            for(size_t i = 1; i < text_fields.size(); i++)
+            {
+                if(is_payload(fields[0],i))
+                    text_fields[i] = base64_encode(fields[i]);
+            }
+            return parsing::compose_message(text_fields);
+        }
+        else
+            return parsing::compose_message(fields);
+    }
+    void tokenize(std::string_view msg, parsing::Tokens& tokens)
+    {
+        if(is_binary(msg))
+        {
+            tokens.clear(0);
+            auto k = find_keyword((uint8_t)msg[1]);
+            if(k == nullptr)
+                return;
+            tokens.push_back(k->keyword);
+            size_t pos = 2;
+            while(pos < msg.length())
+            {
+                size_t length = 0;
+                if(not read_varint(msg,pos,length) or length > msg.length() - pos)
+                {
+                    tokens.clear(0);
+                    return;
+                }
+                tokens.push_back(msg.substr(pos,length));
+                pos += length;
+            }
+        }
+        else
+        {
+            parsing::tokenize(msg,tokens);
+            auto k = find_keyword(tokens[0]);
+            if(k == nullptr)
+                return;
+            for(size_t i = 1; i < tokens.size() and i < 32; i++)
+            {
+                if(k->payload_mask & (1u<<i))
+                    tokens.add_flags(i,parsing::Tokens::BASE64);
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <string_view>
+#include "../../../parsing/parsing.hpp"
+
+namespace network::udp::wire
+{
+    /**
+     * @brief version of the binary framing, peers announce it with "BINARY <version>"
+     * after the connection is established
+     * 
+     */
+    constexpr unsigned int VERSION = 3;
+    /**
+     * @brief first byte of every binary frame, a text message can't start with it
+     * 
+     */
+    constexpr char BINARY_MARKER = '\0';
+    /**
+     * @brief check if a message is a binary frame
+     * 
+     * @param msg the message without the final '\n'
+     * @return true if the message is a binary frame
+     * @return false if the message uses the text protocol
+     */
+    bool is_binary(std::string_view msg);
+    /**
+     * @brief check if a field is a payload field, payload fields are sent raw in binary frames
+     * and encoded base64 in text messages
+     * 
+     * @param keyword the keyword of the message
+     * @param index the index of the field (the keyword is the field 0)
+     * @return true if the field is a payload field
+     */
+    bool is_payload(std::string_view keyword, size_t index);
+    /**
+     * @brief returns the keyword of a message, both text and binary
+     * 
+     * @param msg the message without the final '\n'
+     * @return the keyword (a view inside msg or a static string), "" if the binary frame is not valid
+     */
+    std::string_view get_keyword(std::string_view msg);
+    /**
+     * @brief compose a message from its fields, payload fields must be raw bytes,
+     * if binary is true and the keyword can be sent in a binary frame the message
+     * will be a binary frame, otherwise payload fields are encoded base64 and the
+     * message is composed with parsing::compose_message
+     * 
+     * @param fields the fields of the message, the first one is the keyword
+     * @param binary true if the destination supports binary frames
+     * @return the composed message (without the final '\n')
+     */
+    std::string compose(const std::vector<std::string>& fields, bool binary);
+    /**
+     * @brief start a binary frame, used to build a frame in place instead of using compose
+     * 
+     * @param frame where the frame is written, the previous content is discarded
+     * @param keyword the keyword of the frame
+     * @return false if the keyword can't be sent in a binary frame
+     */
+    bool begin_frame(std::string& frame, std::string_view keyword);
+    /**
+     * @brief append a field of the given length to a binary frame
+     * 
+     * @param frame a frame started with begin_frame
+     * @param length the length of the field
+     * @return where the field must be written, valid until frame is modified again
+     */
+    char* append_field(std::string& frame, size_t length);
+    /**
+     * @brief split a message in its fields without copying them, this is the reverse of compose
+     * and payload fields are always returned as raw bytes (text payloads are decoded lazily by tokens)
+     * 
+     * @param msg the message without the final '\n', it must outlive tokens
+     * @param tokens where the fields are stored, empty if the binary frame is not valid
+     */
+    void tokenize(std::string_view msg, parsing::Tokens& tokens);
+}
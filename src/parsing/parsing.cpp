@@ -3,7 +3,9 @@
 #include "../network/udp/udp.hpp"
 #include "curses_ansi_lookup.hpp"
 #include "../network/authentication/authentication.hpp"
+#include "../base64/base64.h"
 #include <algorithm>
+#include <charconv>
 #ifndef MSG_SPLITTING_CHAR
     #define MSG_SPLITTING_CHAR ' '
 #endif
@@ -12,20 +14,107 @@
 #endif
 namespace parsing
 {
-    std::string get_msg_keyword(const std::string& msg)
+    std::string_view get_msg_keyword(std::string_view msg)
     {
-        std::string ret;
-        ret.reserve(msg.length());
-        for(const auto& c : msg)
+        return msg.substr(0,msg.find(MSG_SPLITTING_CHAR));
+    }
+    void Tokens::clear(size_t msg_length)
+    {
+        count = 0;
+        buffer.clear();
+        // every token can be unescaped (at most msg_length bytes in total) and then decoded
+        auto needed = msg_length*2 + MAX_MSG_TOKENS*4;
+        if(buffer.capacity() < needed)
+            buffer.reserve(needed);
+    }
+    void Tokens::push_back(std::string_view token, uint8_t flags)
+    {
+        if(count < MAX_MSG_TOKENS)
+            tokens[count] = {token,flags};
+        count++;
+    }
+    void Tokens::add_flags(size_t index, uint8_t flags)
+    {
+        if(index < count and index < MAX_MSG_TOKENS)
+            tokens[index].flags |= flags;
+    }
+    std::string_view Tokens::operator[](size_t index) const
+    {
+        if(index >= count or index >= MAX_MSG_TOKENS)
+            return {};
+        auto& token = tokens[index];
+        if(token.flags & ESCAPED)
+        {
+            auto start = buffer.length();
+            bool escape = false;
+            for(const auto& c: token.view)
+            {
+                if(c == ESCAPE_CHAR and not escape)
+                    escape = true;
+                else
+                {
+                    buffer += c;
+                    escape = false;
+                }
+            }
+            token.view = std::string_view(buffer).substr(start);
+            token.flags &= ~ESCAPED;
+        }
+        if(token.flags & BASE64)
+        {
+            auto start = buffer.length();
+            buffer.resize(start + b64d_size((unsigned int)token.view.length()));
+            auto decoded_size = b64_decode((const unsigned char*)token.view.data(),(unsigned int)token.view.length(),(unsigned char*)buffer.data()+start);
+            buffer.resize(start + decoded_size);
+            token.view = std::string_view(buffer).substr(start);
+            token.flags &= ~BASE64;
+        }
+        return token.view;
+    }
+    size_t Tokens::size() const
+    {
+        return count;
+    }
+    bool Tokens::empty() const
+    {
+        return count == 0;
+    }
+    void tokenize(std::string_view msg, Tokens& tokens)
+    {
+        tokens.clear(msg.length());
+        // find uses memchr, so long tokens (like base64 payloads) are skipped quickly
+        size_t start = 0;
+        uint8_t flags = 0;
+        auto next_split = msg.find(MSG_SPLITTING_CHAR);
+        auto next_escape = msg.find(ESCAPE_CHAR);
+        while(true)
         {
-            if(c == MSG_SPLITTING_CHAR)
+            if(next_escape < next_split)
+            {// the char after the escape is part of the token whatever it is
+                flags |= Tokens::ESCAPED;
+                auto after = next_escape + 2;
+                next_escape = msg.find(ESCAPE_CHAR,after);
+                if(next_split < after)
+                    next_split = msg.find(MSG_SPLITTING_CHAR,after);
+                continue;
+            }
+            if(next_split == msg.npos)
                 break;
-            else
-                ret+=c;
+            if(next_split > start)
+                tokens.push_back(msg.substr(start,next_split-start),flags);
+            start = next_split+1;
+            flags = 0;
+            next_split = msg.find(MSG_SPLITTING_CHAR,start);
         }
-            return ret;
+        if(msg.length() > start)
+            tokens.push_back(msg.substr(start),flags);
+    }
+    bool to_number(std::string_view token, unsigned long long& value)
+    {
+        auto [end, ec] = std::from_chars(token.data(),token.data()+token.length(),value);
+        return ec == std::errc{} and end == token.data()+token.length();
     }
-    std::vector<std::string> split(const std::string& str,char split_on=MSG_SPLITTING_CHAR, char escape_on=ESCAPE_CHAR)
+    std::vector<std::string> split(std::string_view str,char split_on=MSG_SPLITTING_CHAR, char escape_on=ESCAPE_CHAR)
     {
         std::vector<std::string> ret;
         std::string current;
@@ -57,7 +146,7 @@ namespace parsing
         }
         return ret;
     }
-    std::vector<std::string> msg_split(const std::string& msg)
+    std::vector<std::string> msg_split(std::string_view msg)
     {
         return split(msg,MSG_SPLITTING_CHAR,ESCAPE_CHAR);
     }
@@ -2,6 +2,9 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <string_view>
+#include <array>
+#include <stdint.h>
 #include <boost/asio/ip/udp.hpp>
 
 namespace parsing
@@ -10,9 +13,89 @@ namespace parsing
      * @brief returns the keyword from a message string received from udp socket
      * 
      * @param msg the content of the string
-     * @return the keyword
+     * @return the keyword, it's a view inside msg
      */
-    std::string get_msg_keyword(const std::string& msg);
+    std::string_view get_msg_keyword(std::string_view msg);
+    /**
+     * @brief max number of tokens stored by Tokens, messages with more tokens
+     * are still counted correctly but the exceeding tokens are not accessible
+     * 
+     */
+    constexpr size_t MAX_MSG_TOKENS = 16;
+    /**
+     * @brief the tokens of a message, every token is a view inside the message (that must outlive
+     * this object) or inside an internal buffer, a token is unescaped or decoded in the buffer only
+     * the first time it's accessed and only if needed.
+     * Reusing the same object for every message avoids any allocation once the buffer is big enough
+     * 
+     */
+    class Tokens
+    {
+    public:
+        // the token contains escape chars
+        static constexpr uint8_t ESCAPED = 1;
+        // the token is encoded base64
+        static constexpr uint8_t BASE64 = 2;
+        /**
+         * @brief remove every token and prepare the buffer for a message
+         * 
+         * @param msg_length the length of the message that will be tokenized
+         */
+        void clear(size_t msg_length);
+        /**
+         * @brief add a token, if there are already MAX_MSG_TOKENS tokens it's only counted
+         * 
+         * @param token view of the raw token
+         * @param flags ESCAPED and/or BASE64
+         */
+        void push_back(std::string_view token, uint8_t flags = 0);
+        /**
+         * @brief add flags to a token that was already added
+         * 
+         * @param index index of the token
+         * @param flags ESCAPED and/or BASE64
+         */
+        void add_flags(size_t index, uint8_t flags);
+        /**
+         * @brief get a token, unescaping and decoding it if needed
+         * 
+         * @param index index of the token
+         * @return the token, "" if index is out of range
+         */
+        std::string_view operator[](size_t index) const;
+        /**
+         * @brief number of tokens in the message, it can be greater than MAX_MSG_TOKENS
+         * 
+         */
+        size_t size() const;
+        bool empty() const;
+    private:
+        struct Token
+        {
+            std::string_view view;
+            uint8_t flags = 0;
+        };
+        mutable std::array<Token,MAX_MSG_TOKENS> tokens;
+        size_t count = 0;
+        // reserved in clear so that decoded tokens never cause a reallocation
+        mutable std::string buffer;
+    };
+    /**
+     * @brief split a message in the various tokens it's made of without copying them,
+     * the result is the same of msg_split
+     * 
+     * @param msg message to split, it must outlive tokens
+     * @param tokens where the tokens are stored, the previous content is discarded
+     */
+    void tokenize(std::string_view msg, Tokens& tokens);
+    /**
+     * @brief convert a token to an unsigned number without allocating
+     * 
+     * @param token the token to convert
+     * @param value where the number is stored
+     * @return true if the whole token is a valid number
+     */
+    bool to_number(std::string_view token, unsigned long long& value);
     /**
      * @brief split a message in the various tokens it's made of, the split
      * is made on 
@@ -20,7 +103,7 @@ namespace parsing
      * @param msg message to split
      * @return vector of every token included the keyword
      */
-    std::vector<std::string> msg_split(const std::string& msg);
+    std::vector<std::string> msg_split(std::string_view msg);
     /**
      * @brief split a command in the various tokens it's made of 
      * the inner workings are the same of msg_split
@@ -97,6 +97,32 @@ namespace terminal::commands
                 return false;
             }
         }
+        else if(args[1] == "join")
+        {
+            return network::audio::join_forwarder(args.size() == 3 ? args[2] : "");
+        }
+        else if(args[1] == "forward")
+        {
+            if(args.size() == 2)
+            {
+                return network::audio::start_forwarding();
+            }else
+            {
+                logging::log("ERR","Too many arguments, use \"help voice\" for more info");
+                return false;
+            }
+        }
+        else if(args[1] == "host")
+        {
+            if(args.size() == 2)
+            {
+                return network::audio::start_conference();
+            }else
+            {
+                logging::log("ERR","Too many arguments, use \"help voice\" for more info");
+                return false;
+            }
+        }
         else if(args[1] == "stop")
         {
             if(args.size() == 2)
@@ -109,7 +135,7 @@ namespace terminal::commands
             }
         }else
         {
-            logging::log("ERR","The second argument must be start or stop, use \"help voice\" for more info");
+            logging::log("ERR","The second argument must be start, host, forward, join or stop, use \"help voice\" for more info");
             return false;
         }
     }
@@ -151,8 +177,9 @@ namespace terminal::commands
             if(args.size() == 3)
             {
                 try{
-                    std::unique_lock lock(network::udp::connection_map.obj);
-                    auto& user_info = network::udp::connection_map[args[2]];
+                    auto peer = network::udp::connection_map[args[2]];
+                    std::unique_lock lock(peer->mutex);
+                    auto& user_info = *peer;
                     logging::log("MSG",HIGHLIGHT + user_info.name + RESET);
                     logging::log("MSG","    Encryption: " HIGHLIGHT + std::string(user_info.encrypted?"on":"off") + RESET);
                     logging::log("MSG","    Address: " HIGHLIGHT + user_info.endpoint.address().to_string() + RESET ":" HIGHLIGHT + std::to_string(user_info.endpoint.port()) + RESET);
@@ -277,19 +304,27 @@ namespace terminal::commands
             }
             else
             {
-                std::unique_lock lock(network::file::file_transfers_mutex);
-                unsigned int i = 0;
-                for(auto& [hash, info]: network::file::file_transfers)
+                // the transfers are locked one at a time without holding file_transfers_mutex
+                std::vector<std::shared_ptr<network::file::FileTransfer>> transfers;
                 {
-                    
+                    std::unique_lock lock(network::file::file_transfers_mutex);
+                    for(auto map: {&network::file::uploads,&network::file::downloads})
+                        for(auto& [hash, transfer]: *map)
+                            transfers.emplace_back(transfer);
+                }
+                for(size_t i = 0; i < transfers.size(); i++)
+                {
+                    std::unique_lock lock(transfers[i]->mutex);
+                    auto& info = transfers[i]->info;
                     logging::log("MSG","- " HIGHLIGHT + info.file_name + RESET);
                     logging::log("MSG","    " + std::string(info.direction == network::file::FileTransferDirection::download? "DOWNLOAD":"UPLOAD"));
-                    logging::log("MSG","    ACKed " + std::to_string(info.last_acked_number) + "/" + std::to_string(info.data.size()) + " " + std::to_string(float(info.last_acked_number)/info.data.size()*100)+"%");
-                    logging::log("MSG","    "+ std::string(info.direction == network::file::FileTransferDirection::download? "Received":"Sent") + " " + std::to_string(info.next_sequence_number) + "/" + std::to_string(info.data.size()) + " " + std::to_string(float(info.next_sequence_number)/info.data.size()*100)+"%");
+                    logging::log("MSG","    ACKed " + std::to_string(info.last_acked_number) + "/" + std::to_string(info.file_size) + " " + std::to_string(float(info.last_acked_number)/info.file_size*100)+"%");
+                    logging::log("MSG","    "+ std::string(info.direction == network::file::FileTransferDirection::download? "Received":"Sent") + " " + std::to_string(info.next_sequence_number) + "/" + std::to_string(info.file_size) + " " + std::to_string(float(info.next_sequence_number)/info.file_size*100)+"%");
                     logging::log("MSG","    Throughput " + std::to_string(info.average_throughput/1024*8) + "Kbps");
-                    if(i!=network::file::file_transfers.size()-1)
+                    if(info.direction == network::file::FileTransferDirection::upload)
+                        logging::log("MSG","    Window " + std::to_string(info.congestion.window()) + " chunks, RTT " + std::to_string(info.congestion.rtt().total_microseconds()/1000.0) + "ms");
+                    if(i!=transfers.size()-1)
                         logging::log("MSG","");
-                    i++;
                 }
                 return true;
             }
@@ -396,9 +431,38 @@ namespace terminal::commands
                 }
             }
         }
+        else if(args[1] == "import" or args[1] == "export")
+        {
+            if(args.size() != 3)
+            {
+                logging::log("ERR","You must provide only the path of the toml file, use \"help key\" for more info");
+                return false;
+            }
+            else if(args[1] == "import")
+            {
+                auto imported = network::authentication::known_users.import_toml(args[2]);
+                if(not imported)
+                {
+                    logging::log("ERR","Error parsing \"" HIGHLIGHT +args[2]+ RESET "\"");
+                    return false;
+                }
+                logging::log("MSG","Imported " HIGHLIGHT + std::to_string(*imported) + RESET " known users from \"" HIGHLIGHT +args[2]+ RESET "\"");
+                return true;
+            }
+            else
+            {
+                if(not network::authentication::known_users.export_toml(args[2]))
+                {
+                    logging::log("ERR","Error writing \"" HIGHLIGHT +args[2]+ RESET "\"");
+                    return false;
+                }
+                logging::log("MSG","Known users exported to \"" HIGHLIGHT +args[2]+ RESET "\"");
+                return true;
+            }
+        }
         else
         {
-            logging::log("ERR","The second argument must be add, delete, show or list, use \"help key\" for more info");
+            logging::log("ERR","The second argument must be add, delete, show, list, import or export, use \"help key\" for more info");
             return false;
         }
     }
@@ -407,8 +471,9 @@ namespace terminal::commands
         if(args[1] == "start")
         {
             try{
-                std::unique_lock lock(network::udp::connection_map.obj);
-                auto& info = network::udp::connection_map[args[2]];
+                auto peer = network::udp::connection_map[args[2]];
+                std::unique_lock lock(peer->mutex);
+                auto& info = *peer;
                 if(info.encrypted)
                 {
                     logging::log("ERR","Connection with " HIGHLIGHT +args[2]+ RESET " is already encrypted");
@@ -427,8 +492,9 @@ namespace terminal::commands
         else if(args[1] == "stop")
         {
             try{
-                std::unique_lock lock(network::udp::connection_map.obj);
-                auto& info = network::udp::connection_map[args[2]];
+                auto peer = network::udp::connection_map[args[2]];
+                std::unique_lock lock(peer->mutex);
+                auto& info = *peer;
                 if(not info.encrypted)
                 {
                     logging::log("ERR","Connection with " HIGHLIGHT +args[2]+ RESET " is not encrypted");
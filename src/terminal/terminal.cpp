@@ -165,35 +165,39 @@ namespace terminal
                     auto line = ui::getline();
                     if(line.size() > 0)
                     {
-                        bool run_command = false;
+                        std::function<void(const std::string&)> callback;
                         {
                             std::unique_lock queue_lock(input_queue_mutex);
                             if(not input_queue.empty())
                             {
-                                auto callback = input_queue.front();
+                                callback = input_queue.front().second;
                                 input_queue.pop();
-                                callback.second(line);
-                                if(not input_queue.empty())
-                                {
-                                    auto prompt = input_queue.front().first;
-                                    logging::log("PRM",prompt);
-                                }
                             }
-                            else
+                        }
+                        if(callback)
+                        {// called without input_queue_mutex, the callbacks take the locks of their modules, which can call input while holding them
+                            callback(line);
+                            std::unique_lock queue_lock(input_queue_mutex);
+                            if(not input_queue.empty())
                             {
-                                run_command = true;
+                                auto prompt = input_queue.front().first;
+                                logging::log("PRM",prompt);
                             }
                         }
-                        if(run_command)
+                        else
                             last_ret = process_command(line);
                     }
                 }catch(ui::KeyboardInterrupt&)
                 {
-                    std::unique_lock queue_lock(input_queue_mutex);
-                    while(not input_queue.empty())
+                    decltype(input_queue) pending;
+                    {
+                        std::unique_lock queue_lock(input_queue_mutex);
+                        std::swap(pending,input_queue);
+                    }
+                    while(not pending.empty())
                     {
-                        input_queue.front().second("");
-                        input_queue.pop();
+                        pending.front().second("");
+                        pending.pop();
                     }
                     last_ret = process_command("exit");
                 }
@@ -223,8 +227,8 @@ namespace terminal
             3,0});
         add_command(CommandFunction{
             "voice",
-            "(start <username>)|(stop)",
-            "Start a voice call with a user or stop one previously started",
+            "(start <username>)|(host)|(forward)|(join [<username>])|(stop)",
+            "Start a voice call with a user, host a voice conference that other users can join calling you (mixed by you with host, only forwarded with forward), join a forwarded conference (by default the one of your server), or stop the call or the conference",
             commands::voice,
             2,3});
         add_command(CommandFunction{
@@ -247,8 +251,8 @@ namespace terminal
             2,4}); 
         add_command(CommandFunction{
             "key",
-            "(add <username> <public key>)|(delete <username>)|(show <username>)|(list)",
-            "Add, remove or show one or a list of the public keys stored associated with every known user, if you add a new key in the PEM format without the first and last line",
+            "(add <username> <public key>)|(delete <username>)|(show <username>)|(list)|(import <toml file>)|(export <toml file>)",
+            "Add, remove or show one or a list of the public keys stored associated with every known user, if you add a new key in the PEM format without the first and last line, or import and export the known users from and to a file in the format of known_users.toml (the import replaces the keys of the users already known)",
             commands::key,
             2,4});
         add_command(CommandFunction{
@@ -0,0 +1,379 @@
+#include <toml.hpp>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <boost/thread.hpp>
+#include <boost/thread/sync_bounded_queue.hpp>
+#include "logging/logging.hpp"
+#include "network/udp/udp.hpp"
+#include "network/audio/JitterBuffer/JitterBuffer.hpp"
+#include "network/audio/FrameRing/FrameRing.hpp"
+#include "network/audio/VoiceDetector/VoiceDetector.hpp"
+#include "network/audio/kernels/kernels.hpp"
+#include "network/audio/Mixer/Mixer.hpp"
+#include "network/audio/Forwarder/Forwarder.hpp"
+#include "defines.hpp"
+
+toml::table test_config = toml::table{
+    {"network", toml::table{
+        { "username", "mokaccino"}
+        }}
+};
+
+// a voice stream through the jitter buffer over an emulated link, in simulated time
+void jitter_buffer_benchmark()
+{
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr unsigned int FRAME_SAMPLES = 120;
+    constexpr size_t FRAMES = 8000;
+    constexpr double FRAME_MS = 1000.0 * FRAME_SAMPLES / SAMPLE_RATE;
+    struct Scenario
+    {
+        const char* name;
+        double base_ms;
+        // mean of the exponentially distributed queueing delay
+        double jitter_ms;
+        double loss;
+    };
+    for(auto scenario: {Scenario{"LAN",1,0.3,0},Scenario{"Wi-Fi",5,15,0.02}})
+    {
+        std::mt19937 random(42);
+        std::exponential_distribution<double> queueing(1/scenario.jitter_ms);
+        std::bernoulli_distribution lost(scenario.loss);
+        std::vector<std::pair<double,size_t>> arrivals;
+        for(size_t i = 0; i < FRAMES; i++)
+            if(not lost(random))
+                arrivals.push_back({i*FRAME_MS + scenario.base_ms + queueing(random),i});
+        std::sort(arrivals.begin(),arrivals.end());
+
+        network::audio::JitterBuffer buffer{FRAME_SAMPLES,SAMPLE_RATE};
+        auto epoch = boost::posix_time::ptime(boost::gregorian::date(2000,1,1));
+        std::string data;
+        size_t next_arrival = 0;
+        size_t played = 0;
+        size_t gaps = 0;
+        double total_delay = 0;
+        auto start = std::chrono::steady_clock::now();
+        // the output asks for a frame every period, starting when the first frame arrives
+        for(double now = arrivals[0].first; next_arrival < arrivals.size() or played == 0; now += FRAME_MS)
+        {
+            for(; next_arrival < arrivals.size() and arrivals[next_arrival].first <= now; next_arrival++)
+            {
+                auto [arrival, i] = arrivals[next_arrival];
+                auto frame = std::to_string(i);
+                buffer.push((uint16_t)i,(uint32_t)(i*FRAME_SAMPLES),frame,epoch + boost::posix_time::microseconds((int64_t)(arrival*1000)));
+            }
+            switch(buffer.pop(data))
+            {
+            case network::audio::JitterBuffer::Action::play:
+                total_delay += now - std::stoull(data)*FRAME_MS;
+                played++;
+                break;
+            default:
+                if(played > 0)
+                    gaps++;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        auto statistics = buffer.statistics();
+        if(played == 0)
+            throw std::runtime_error("the jitter buffer did not play anything");
+        logging::log("MSG","jitter buffer on " + std::string(scenario.name) + ": mouth to ear delay " + std::to_string(total_delay/played) + "ms, jitter " + std::to_string(statistics.jitter_ms) + "ms, "
+            + std::to_string(played) + " played, " + std::to_string(gaps) + " gaps (" + std::to_string(statistics.concealed) + " concealed), " + std::to_string(statistics.late) + " late, " + std::to_string(statistics.discarded) + " discarded, "
+            + std::to_string(FRAMES/seconds) + " frames/s");
+    }
+    // losses on a clean link must only cost the lost frames: a burst in a talkspurt and the first frame of a talkspurt after a silence
+    struct Talkspurt
+    {
+        size_t first_sequence;
+        size_t frames;
+        size_t first_lost;
+        size_t lost;
+    };
+    for(auto talkspurts: {std::vector<Talkspurt>{{0,200,100,6}},std::vector<Talkspurt>{{0,50,0,0},{50,100,50,1}}})
+    {
+        network::audio::JitterBuffer buffer{FRAME_SAMPLES,SAMPLE_RATE};
+        auto epoch = boost::posix_time::ptime(boost::gregorian::date(2000,1,1));
+        std::string data;
+        size_t played = 0, sent = 0, period = 0;
+        for(auto& talkspurt: talkspurts)
+        {
+            // every talkspurt starts after 100 periods of silence (the timestamps keep growing, the sequence doesn't)
+            period += 100;
+            for(size_t i = 0; i < talkspurt.frames + 20; i++, period++)
+            {
+                auto sequence = talkspurt.first_sequence + i;
+                if(i < talkspurt.frames and (sequence < talkspurt.first_lost or sequence >= talkspurt.first_lost + talkspurt.lost))
+                {
+                    buffer.push((uint16_t)sequence,(uint32_t)(period*FRAME_SAMPLES),"x",epoch + boost::posix_time::microseconds((int64_t)(period*FRAME_MS*1000)));
+                    sent++;
+                }
+                played += buffer.pop(data) == network::audio::JitterBuffer::Action::play;
+            }
+        }
+        if(played != sent)
+            throw std::runtime_error("the jitter buffer played " + std::to_string(played) + " of " + std::to_string(sent) + " frames after a loss");
+    }
+}
+
+// what an audio callback pays to hand a frame to another thread: a string in a locked queue vs a slot of a wait-free ring
+void audio_frame_handoff_benchmark()
+{
+    constexpr size_t FRAMES = 20000;
+    constexpr size_t FRAME_SAMPLES = 120;
+    struct Frame
+    {
+        uint32_t timestamp;
+        int16_t samples[FRAME_SAMPLES];
+    };
+    int16_t input[FRAME_SAMPLES] = {};
+    auto run = [&](auto&& produce, auto&& consume){
+        std::atomic<bool> done = false;
+        boost::thread consumer([&](){
+            while(not done.load())
+                if(not consume())
+                    boost::this_thread::yield();
+            while(consume());
+        });
+        double worst = 0;
+        double total = 0;
+        for(size_t i = 0; i < FRAMES; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            produce((uint32_t)i);
+            double elapsed = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count();
+            worst = std::max(worst,elapsed);
+            total += elapsed;
+            if(i % 8 == 0)
+                boost::this_thread::yield();
+        }
+        done = true;
+        consumer.join();
+        return std::pair{total/FRAMES,worst};
+    };
+    boost::sync_bounded_queue<std::string> queue{256};
+    auto [queue_average, queue_worst] = run([&](uint32_t){
+        if(not queue.full())
+            queue.push(std::string((const char*)input,sizeof(input)));
+    },[&](){
+        std::string frame;
+        return queue.try_pull(frame);
+    });
+    network::audio::FrameRing<Frame,32> ring;
+    auto [ring_average, ring_worst] = run([&](uint32_t timestamp){
+        auto frame = ring.write_slot();
+        if(frame == nullptr)
+            return;
+        frame->timestamp = timestamp;
+        memcpy(frame->samples,input,sizeof(input));
+        ring.commit_write();
+    },[&](){
+        if(ring.read_slot() == nullptr)
+            return false;
+        ring.commit_read();
+        return true;
+    });
+    logging::log("MSG","audio frame handoff: sync_bounded_queue " + std::to_string(queue_average) + "us average " + std::to_string(queue_worst) + "us worst, frame ring " + std::to_string(ring_average) + "us average " + std::to_string(ring_worst) + "us worst");
+}
+
+// speech-like bursts (a tone, then a quiet hiss like an "s") over background noise, frames sent and speech frames cut
+void voice_detector_benchmark()
+{
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr unsigned int FRAME_SAMPLES = 480;
+    constexpr size_t FRAMES = 3000;
+    std::mt19937 random(7);
+    std::normal_distribution<double> background(0,60);
+    std::uniform_real_distribution<double> hiss(-250,250);
+    std::vector<int16_t> samples(FRAME_SAMPLES);
+    network::audio::VoiceDetector detector{FRAME_SAMPLES,SAMPLE_RATE,40};
+    size_t sent = 0;
+    size_t speech = 0;
+    size_t cut = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < FRAMES; i++)
+    {
+        // 1s of talk every 3s: 0.8s of vowel and 0.2s of fricative
+        size_t position = i % 300;
+        bool vowel = position < 80;
+        bool fricative = position >= 80 and position < 100;
+        for(size_t j = 0; j < FRAME_SAMPLES; j++)
+        {
+            double value = background(random);
+            if(vowel)
+                value += 3000 * std::sin(2 * 3.14159265 * 220 * double(i * FRAME_SAMPLES + j) / SAMPLE_RATE);
+            if(fricative)
+                value += hiss(random);
+            samples[j] = (int16_t)value;
+        }
+        bool detected = detector.detect(samples.data(),FRAME_SAMPLES);
+        sent += detected;
+        speech += vowel or fricative;
+        cut += (vowel or fricative) and not detected;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    if(cut * 100 > speech)
+        throw std::runtime_error("the voice detector cut more than 1% of the speech");
+    logging::log("MSG","voice detector: " + std::to_string(sent*100/FRAMES) + "% of the frames sent (" + std::to_string(speech*100/FRAMES) + "% are speech), " + std::to_string(cut) + " speech frames cut, noise level " + std::to_string(detector.noise_level())
+        + ", " + std::to_string(FRAMES/seconds) + " frames/s");
+}
+
+// every implementation of the audio kernels on 10ms frames, checked against the scalar one
+void audio_kernels_benchmark()
+{
+    constexpr size_t FRAME_SAMPLES = 480;
+    constexpr size_t ROUNDS = 20000;
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> sample(INT16_MIN,INT16_MAX);
+    // odd length, so the scalar tail of the vector kernels runs too
+    std::vector<int16_t> frame(FRAME_SAMPLES + 7), other(FRAME_SAMPLES + 7);
+    for(size_t i = 0; i < frame.size(); i++)
+    {
+        frame[i] = (int16_t)sample(random);
+        other[i] = (int16_t)sample(random);
+    }
+    frame[3] = INT16_MIN;
+    auto& reference = *network::audio::kernels::supported().front();
+    auto reference_gain = frame, reference_mix = frame, reference_minus = frame;
+    reference.gain(reference_gain.data(),frame.size(),300);
+    reference.mix(reference_mix.data(),other.data(),frame.size());
+    std::vector<int32_t> reference_total(frame.size(),INT16_MAX);
+    reference.accumulate(reference_total.data(),frame.data(),frame.size());
+    reference.accumulate(reference_total.data(),other.data(),frame.size());
+    reference.mix_minus(reference_minus.data(),reference_total.data(),other.data(),frame.size());
+    for(auto kernels: network::audio::kernels::supported())
+    {
+        auto gained = frame, mixed = frame, minus = frame;
+        kernels->gain(gained.data(),frame.size(),300);
+        kernels->mix(mixed.data(),other.data(),frame.size());
+        std::vector<int32_t> total(frame.size(),INT16_MAX);
+        kernels->accumulate(total.data(),frame.data(),frame.size());
+        kernels->accumulate(total.data(),other.data(),frame.size());
+        kernels->mix_minus(minus.data(),total.data(),other.data(),frame.size());
+        if(kernels->abs_sum(frame.data(),frame.size()) != reference.abs_sum(frame.data(),frame.size())
+            or kernels->square_sum(frame.data(),frame.size()) != reference.square_sum(frame.data(),frame.size())
+            or kernels->peak(frame.data(),frame.size()) != reference.peak(frame.data(),frame.size())
+            or gained != reference_gain or mixed != reference_mix or total != reference_total or minus != reference_minus)
+            throw std::runtime_error(std::string("the ") + kernels->name + " audio kernels give different results");
+        auto measure = [&](auto&& kernel){
+            volatile uint64_t sink = 0;
+            auto start = std::chrono::steady_clock::now();
+            for(size_t i = 0; i < ROUNDS; i++)
+                sink = sink + kernel();
+            return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count() / ROUNDS;
+        };
+        auto buffer = frame;
+        auto abs_sum = measure([&](){ return kernels->abs_sum(frame.data(),FRAME_SAMPLES); });
+        auto square_sum = measure([&](){ return kernels->square_sum(frame.data(),FRAME_SAMPLES); });
+        auto peak = measure([&](){ return kernels->peak(frame.data(),FRAME_SAMPLES); });
+        auto gain = measure([&](){ kernels->gain(buffer.data(),FRAME_SAMPLES,255); return buffer[0]; });
+        auto mix = measure([&](){ kernels->mix(buffer.data(),other.data(),FRAME_SAMPLES); return buffer[0]; });
+        logging::log("MSG",std::string("audio kernels (") + kernels->name + (kernels == &network::audio::kernels::best() ? ", selected" : "") + ") per frame of " + std::to_string(FRAME_SAMPLES) + " samples: abs_sum " + std::to_string(abs_sum) + "ns, square_sum " + std::to_string(square_sum) + "ns, peak " + std::to_string(peak) + "ns, gain " + std::to_string(gain) + "ns, mix " + std::to_string(mix) + "ns");
+    }
+}
+
+// cost of a frame period of a conference (decode every participant, mix, encode for every participant) on one thread
+void mixer_benchmark()
+{
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr unsigned int FRAME_SAMPLES = 480;
+    constexpr double FRAME_US = 1e6 * FRAME_SAMPLES / SAMPLE_RATE;
+    constexpr size_t ROUNDS = 50;
+    // a different tone for every participant, encoded like a participant would
+    std::vector<int16_t> tone(FRAME_SAMPLES);
+    std::vector<std::string> packets;
+    int error = 0;
+    auto encoder = opus_encoder_create(SAMPLE_RATE,1,OPUS_APPLICATION_VOIP,&error);
+    if(error != OPUS_OK)
+        throw std::runtime_error("opus_encoder_create failed");
+    opus_encoder_ctl(encoder,OPUS_SET_BITRATE(32000));
+    unsigned char packet[4000];
+    for(size_t p = 0; p < network::audio::Mixer::MAX_PARTICIPANTS; p++)
+    {
+        for(size_t i = 0; i < FRAME_SAMPLES; i++)
+            tone[i] = (int16_t)(4000 * std::sin(2 * 3.14159265 * (200 + 50 * p) * i / SAMPLE_RATE));
+        auto size = opus_encode(encoder,tone.data(),FRAME_SAMPLES,packet,sizeof(packet));
+        packets.emplace_back((char*)packet,std::max(size,1));
+    }
+    opus_encoder_destroy(encoder);
+
+    std::vector<int16_t> capture(tone), playback(FRAME_SAMPLES);
+    auto epoch = boost::posix_time::ptime(boost::gregorian::date(2000,1,1));
+    for(size_t participants: {2,5,10,20})
+    {
+        network::audio::Mixer mixer{FRAME_SAMPLES,SAMPLE_RATE,0};
+        for(size_t p = 0; p < participants; p++)
+            mixer.add("participant" + std::to_string(p),boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(),(uint16_t)(20000 + p)),{32000,10,false,true});
+        size_t sent = 0;
+        auto send = [&](const boost::asio::ip::udp::endpoint&, const std::vector<std::string>& fields){ sent += fields.back().size(); };
+        double elapsed = 0;
+        for(size_t round = 0; round < ROUNDS; round++)
+        {
+            for(size_t p = 0; p < participants; p++)
+                mixer.push("participant" + std::to_string(p),(uint16_t)round,(uint32_t)(round * FRAME_SAMPLES),packets[p],epoch + boost::posix_time::microseconds((int64_t)(round * FRAME_US)));
+            auto start = std::chrono::steady_clock::now();
+            mixer.mix(capture.data(),true,playback.data(),send);
+            elapsed += std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count();
+        }
+        double per_frame = elapsed / ROUNDS;
+        logging::log("MSG","mixer with " + std::to_string(participants) + " participants: " + std::to_string(per_frame) + "us per " + std::to_string((int)(FRAME_US/1000)) + "ms frame ("
+            + std::to_string(per_frame / participants) + "us per participant, a core carries about " + std::to_string((size_t)(FRAME_US * participants / per_frame)) + " participants), " + std::to_string(sent / ROUNDS) + "B sent per frame");
+    }
+}
+
+// streams sent by a forwarder for a conference where a few participants speak together, and the cost of routing a frame
+void forwarder_benchmark()
+{
+    constexpr size_t PARTICIPANTS = network::audio::Forwarder::MAX_PARTICIPANTS;
+    constexpr size_t FRAMES = 2000;
+    constexpr int64_t FRAME_US = 10000;
+    // participants that speak, with their mean levels, every other one is silent and sends nothing
+    constexpr std::array<uint16_t,5> levels = {3000,2000,1200,800,500};
+    network::audio::Forwarder forwarder;
+    for(size_t p = 0; p < PARTICIPANTS; p++)
+        forwarder.add("participant" + std::to_string(p),boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4::loopback(),(uint16_t)(20000 + p)));
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<double> variation(0.5,1.5);
+    std::vector<boost::asio::ip::udp::endpoint> targets;
+    uint16_t sequence;
+    std::vector<uint16_t> next_sequence(levels.size(),0);
+    auto epoch = boost::posix_time::ptime(boost::gregorian::date(2000,1,1));
+    size_t received = 0, forwarded = 0, switches = 0;
+    std::vector<bool> was_forwarded(levels.size(),false);
+    double elapsed = 0;
+    for(size_t frame = 0; frame < FRAMES; frame++)
+    {
+        auto arrival = epoch + boost::posix_time::microseconds((int64_t)frame * FRAME_US);
+        for(size_t s = 0; s < levels.size(); s++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            forwarder.route("participant" + std::to_string(s),(uint16_t)(levels[s] * variation(rng)),arrival,targets,sequence);
+            elapsed += std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+            received++;
+            forwarded += targets.size();
+            switches += was_forwarded[s] != !targets.empty();
+            if(not targets.empty() and sequence != next_sequence[s]++)
+                throw std::runtime_error("the forwarded frames of a speaker are not numbered without gaps");
+            was_forwarded[s] = !targets.empty();
+        }
+    }
+    logging::log("MSG","forwarder with " + std::to_string(PARTICIPANTS) + " participants and " + std::to_string(levels.size()) + " speakers: "
+        + std::to_string((double)forwarded / FRAMES / (PARTICIPANTS - 1)) + " streams received per participant per frame (mixer 1, mesh " + std::to_string(levels.size()) + "), "
+        + std::to_string((double)forwarded / FRAMES) + " streams sent per frame, streams sent per speaker 1 (mesh " + std::to_string(PARTICIPANTS - 1) + "), "
+        + std::to_string(switches) + " speaker switches in " + std::to_string(FRAMES) + " frames, route " + std::to_string(elapsed / received) + "ns per frame");
+}
+
+int test()
+{
+    jitter_buffer_benchmark();
+    audio_frame_handoff_benchmark();
+    voice_detector_benchmark();
+    audio_kernels_benchmark();
+    mixer_benchmark();
+    forwarder_benchmark();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <toml.hpp>
+#include <chrono>
+#include <mutex>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <filesystem>
+#include <boost/thread.hpp>
+#include "logging/logging.hpp"
+#include "network/udp/udp.hpp"
+#include "network/file/file.hpp"
+#include "defines.hpp"
+
+toml::table test_config = toml::table{
+    {"network", toml::table{
+        { "username", "mokaccino"}
+        }}
+};
+
+// file sent to ourselves over an emulated link (loss, delay), goodput measured from the ACKs received,
+// the downloaded copy must be the same as the file sent
+void file_transfer_benchmark()
+{
+    struct Scenario
+    {
+        double loss;
+        unsigned int delay_ms;
+        size_t file_size;
+        unsigned int max_ms;
+    };
+    const std::string file_name = "mokaccino_benchmark.bin";
+    auto path = (std::filesystem::temp_directory_path() / file_name).string();
+    unsigned int scenario_number = 0;
+    for(auto scenario: {Scenario{0,0,2*1024*1024,2000},Scenario{0.01,10,2*1024*1024,2000},Scenario{0.05,20,512*1024,4000}})
+    {
+        const size_t FILE_SIZE = scenario.file_size;
+        {// a different file for every scenario, so a late FILESTOP can't stop the next one
+            std::ofstream file(path,std::ios::binary|std::ios::trunc);
+            std::string block(1024,'\0');
+            for(size_t i = 0; i < FILE_SIZE; i += block.size())
+            {
+                for(size_t j = 0; j < block.size(); j++)
+                    block[j] = (char)(i/block.size() + j*7 + scenario_number);
+                file.write(block.data(),block.size());
+            }
+        }
+        scenario_number++;
+        network::file::init_file_upload("loopback",path);
+        std::string file_hash;
+        {
+            std::unique_lock lock(network::file::file_transfers_mutex);
+            file_hash = network::file::uploads.begin()->first;
+        }
+        network::udp::emulate_link(scenario.loss,boost::posix_time::milliseconds(scenario.delay_ms));
+        auto start = std::chrono::steady_clock::now();
+        if(not network::file::init_file_download("loopback",file_hash,FILE_SIZE,file_name))
+            throw std::runtime_error("the download could not start");
+        size_t acked = 0;
+        size_t window = 0;
+        bool finished = false;
+        while(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(scenario.max_ms))
+        {
+            std::shared_ptr<network::file::FileTransfer> upload;
+            {
+                std::unique_lock lock(network::file::file_transfers_mutex);
+                auto it = network::file::uploads.find(file_hash);
+                if(it != network::file::uploads.end())
+                    upload = it->second;
+            }
+            if(upload == nullptr)
+            {
+                finished = true;
+                break;
+            }
+            {
+                std::unique_lock lock(upload->mutex);
+                acked = upload->info.last_acked_number;
+                window = upload->info.congestion.window();
+            }
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        }
+        auto end = std::chrono::steady_clock::now();
+        network::udp::emulate_link(0,{});
+        // the receiver saves the file right after the last ACK
+        for(unsigned int i = 0; i < 50 and finished and network::file::ongoing_transfers_count() != 0; i++)
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        network::file::stop_file_transfer(file_hash,network::file::FileTransferDirection::upload);
+        network::file::stop_file_transfer(file_hash,network::file::FileTransferDirection::download);
+        // the upload is removed by a FILESTOP or an error too, only the downloaded copy shows that the file was sent
+        {
+            std::ifstream sent(path,std::ios::binary);
+            std::ifstream received(DOWNLOAD_PATH+file_name,std::ios::binary);
+            if(not finished or not received or not std::equal(std::istreambuf_iterator<char>(sent),{},std::istreambuf_iterator<char>(received),{}))
+                throw std::runtime_error("file transfer with " + std::to_string(scenario.loss*100) + "% loss did not deliver the file");
+        }
+        acked = FILE_SIZE;
+        double seconds = std::chrono::duration<double>(end-start).count();
+        logging::log("MSG","file transfer with " + std::to_string(scenario.loss*100) + "% loss, " + std::to_string(scenario.delay_ms) + "ms delay: " + std::to_string(acked/seconds/1e6) + "MB/s, " + std::to_string(acked*100/FILE_SIZE) + "% sent, window " + std::to_string(window) + " chunks");
+        std::filesystem::remove(DOWNLOAD_PATH+file_name);
+    }
+    std::filesystem::remove(path);
+}
+
+int test()
+{
+    file_transfer_benchmark();
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <toml.hpp>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <fstream>
+#include <filesystem>
+#include "logging/logging.hpp"
+#include "network/udp/udp.hpp"
+#include "network/udp/crypto/crypto.hpp"
+#include "network/authentication/authentication.hpp"
+#include "base64/base64.h"
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include "defines.hpp"
+
+toml::table test_config = toml::table{
+    {"network", toml::table{
+        { "username", "mokaccino"}
+        }}
+};
+
+#ifdef USE_EC_AUTHENTICATION
+// signature verifications of a known user per second, parsing the key for every message (as before) and with the cached key
+void verify_benchmark()
+{
+    constexpr double SECONDS = 0.3;
+    // not loaded from a file, so nothing is written to disk
+    network::authentication::KnownUsers known_users;
+    auto make_key = [](){
+        std::unique_ptr<EVP_PKEY_CTX,decltype(&::EVP_PKEY_CTX_free)> context{EVP_PKEY_CTX_new_id(EVP_PKEY_EC,nullptr),EVP_PKEY_CTX_free};
+        EVP_PKEY* key = nullptr;
+        if(EVP_PKEY_keygen_init(context.get()) != 1 or EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context.get(),NID_secp521r1) != 1 or EVP_PKEY_keygen(context.get(),&key) != 1)
+            throw std::runtime_error("key generation failed");
+        return std::unique_ptr<EVP_PKEY,decltype(&::EVP_PKEY_free)>{key,EVP_PKEY_free};
+    };
+    auto key = make_key();
+    known_users.replace_key("signer",network::udp::crypto::pubkey_to_string(key.get()));
+    // a HANDSHAKE-sized message signed like authentication::sign does
+    std::string data = "HANDSHAKE signer " + std::string(44,'n') + " " + std::string(44,'m');
+    std::unique_ptr<EVP_MD_CTX,decltype(&::EVP_MD_CTX_free)> sign_context{EVP_MD_CTX_new(),EVP_MD_CTX_free};
+    size_t signature_size = 0;
+    EVP_DigestSignInit(sign_context.get(),nullptr,EVP_sha384(),nullptr,key.get());
+    EVP_DigestSignUpdate(sign_context.get(),data.c_str(),data.length());
+    EVP_DigestSignFinal(sign_context.get(),nullptr,&signature_size);
+    std::vector<unsigned char> signature(signature_size);
+    EVP_DigestSignFinal(sign_context.get(),signature.data(),&signature_size);
+    std::string signed_data(b64e_size((unsigned int)signature_size)+1,'\0');
+    b64_encode(signature.data(),(unsigned int)signature_size,(unsigned char*)signed_data.data());
+    signed_data.resize(signed_data.find('\0'));
+
+    auto uncached_verify = [&](){
+        auto pubkey = network::udp::crypto::string_to_pubkey(known_users.get_key("signer"));
+        std::vector<unsigned char> decoded(b64d_size((unsigned int)signed_data.length()));
+        auto decoded_size = b64_decode((unsigned char*)signed_data.c_str(),(unsigned int)signed_data.length(),decoded.data());
+        std::unique_ptr<EVP_MD_CTX,decltype(&::EVP_MD_CTX_free)> context{EVP_MD_CTX_new(),EVP_MD_CTX_free};
+        EVP_DigestVerifyInit(context.get(),nullptr,EVP_sha384(),nullptr,pubkey.get());
+        EVP_DigestVerifyUpdate(context.get(),data.c_str(),data.length());
+        return 1 == EVP_DigestVerifyFinal(context.get(),decoded.data(),decoded_size);
+    };
+    auto cached_verify = [&](){ return network::authentication::verify(data,signed_data,"signer",known_users); };
+    auto rate = [&](auto verify){
+        size_t verified = 0;
+        auto start = std::chrono::steady_clock::now();
+        while(std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count() < SECONDS)
+        {
+            if(not verify())
+                throw std::runtime_error("verification failed");
+            verified++;
+        }
+        return verified / std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    };
+    auto uncached_rate = rate(uncached_verify);
+    auto cached_rate = rate(cached_verify);
+    // a replaced key must not verify with the cached one anymore
+    known_users.replace_key("signer",network::udp::crypto::pubkey_to_string(make_key().get()));
+    if(cached_verify())
+        throw std::runtime_error("the cached key was not invalidated");
+    known_users.delete_key("signer");
+    if(cached_verify())
+        throw std::runtime_error("a deleted user was verified");
+    logging::log("MSG","signature verify (ECDSA P-521): " + std::to_string(uncached_rate) + "/s parsing the key every time, " + std::to_string(cached_rate) + "/s with the cached key and context");
+}
+#endif
+
+// a burst of new peers with thousands of known users: rewriting the whole file for every update (as before)
+// against the in-memory update plus the periodic journal append, then the recovery from the journal
+void known_users_persistence_benchmark()
+{
+    constexpr size_t USERS = 5000;
+    constexpr size_t REWRITES = 10;
+    constexpr size_t BURST = 1000;
+    auto path = (std::filesystem::temp_directory_path() / "mokaccino_benchmark_persistence.toml").string();
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".journal");
+    auto key_of = [](size_t i){ return std::string(150,'A') + std::to_string(i) + "=="; };
+    network::authentication::KnownUsers users;
+    users.load(path);
+    for(size_t i = 0; i < USERS; i++)
+        users.add_key("user" + std::to_string(i),key_of(i));
+    users.save();
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < REWRITES; i++)
+    {
+        users.add_key("rewrite" + std::to_string(i),key_of(i));
+        users.save();
+    }
+    double rewrite_us = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count() / REWRITES;
+    start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < BURST; i++)
+        users.add_key("peer" + std::to_string(i),key_of(i));
+    for(size_t i = 0; i < BURST; i++)// the same peers again, only the last update of each one is written
+        users.replace_key("peer" + std::to_string(i),key_of(i + 1));
+    users.delete_key("user0");
+    double update_us = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count() / (2 * BURST + 1);
+    start = std::chrono::steady_clock::now();
+    users.flush();
+    double flush_us = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count();
+    auto journal_size = std::filesystem::file_size(path + ".journal");
+    // a crash in the middle of an append
+    std::ofstream(path + ".journal",std::ios::app) << "[[update]]\nname = 'peer0'\nkey = 'trunc";
+    start = std::chrono::steady_clock::now();
+    network::authentication::KnownUsers recovered;
+    recovered.load(path);
+    double load_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    if(recovered.get_all().size() != USERS + REWRITES + BURST - 1 or recovered.get_key("peer0") != key_of(1) or recovered.get_key("peer999") != key_of(1000))
+        throw std::runtime_error("known users not recovered from the journal");
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".journal");
+    logging::log("MSG","known users with " + std::to_string(USERS) + " users: " + std::to_string(rewrite_us) + "us per update rewriting the file, "
+        + std::to_string(update_us) + "us per update with the journal, " + std::to_string(flush_us) + "us to flush a burst of " + std::to_string(2 * BURST + 1) + " updates ("
+        + std::to_string(journal_size) + "B appended), load and recovery " + std::to_string(load_ms) + "ms");
+}
+
+// startup and lookups of a large set of known users, stored in the toml file and in the binary index
+void known_users_store_benchmark()
+{
+    constexpr size_t USERS = 20000;
+    constexpr size_t LOOKUPS = 100000;
+    using Format = network::authentication::KnownUsers::Format;
+    auto directory = std::filesystem::temp_directory_path();
+    auto toml_path = (directory / "mokaccino_benchmark_store.toml").string();
+    auto index_path = (directory / "mokaccino_benchmark_store.idx").string();
+    for(auto& path: {toml_path,index_path})
+    {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".journal");
+    }
+    auto key_of = [](size_t i){ return std::string(150,'A') + std::to_string(i) + "=="; };
+    std::vector<std::string> names;
+    for(size_t i = 0; i < USERS; i++)
+        names.push_back("user" + std::to_string(i));
+    std::sort(names.begin(),names.end());
+    {
+        network::authentication::KnownUsers users;
+        users.load(toml_path);
+        for(size_t i = 0; i < USERS; i++)
+            users.add_key("user" + std::to_string(i),key_of(i));
+        users.save();
+    }
+    auto start = std::chrono::steady_clock::now();
+    {
+        network::authentication::KnownUsers users;
+        users.load(index_path,Format::INDEX);
+        users.import_toml(toml_path);
+        users.save();
+    }
+    double import_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    for(auto format: {Format::TOML,Format::INDEX})
+    {
+        auto& path = format == Format::TOML ? toml_path : index_path;
+        start = std::chrono::steady_clock::now();
+        network::authentication::KnownUsers users;
+        users.load(path,format);
+        double load_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+        start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for(size_t i = 0; i < LOOKUPS; i++)
+        {
+            try
+            {
+                // one lookup in ten is for an unknown user
+                auto user = (i * 7919) % (USERS + USERS / 10);
+                found += users.get_key("user" + std::to_string(user)).length() != 0;
+            }catch(network::authentication::KnownUsers::KeyNotFound&){}
+        }
+        double lookup_rate = LOOKUPS / std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        if(users.get_all() != names or users.get_key("user123") != key_of(123) or found < LOOKUPS * 8 / 10)
+            throw std::runtime_error("known users store lost users");
+        logging::log("MSG",std::string("known users store (") + (format == Format::TOML ? "toml" : "index") + ") with " + std::to_string(USERS) + " users: "
+            + std::to_string(std::filesystem::file_size(path)) + "B on disk, load " + std::to_string(load_ms) + "ms, " + std::to_string(lookup_rate) + " lookups/s"
+            + (format == Format::INDEX ? ", import from toml " + std::to_string(import_ms) + "ms" : ""));
+    }
+    {// updates on top of the index survive a compaction and a reload
+        network::authentication::KnownUsers users;
+        users.load(index_path,Format::INDEX);
+        users.replace_key("user5",key_of(6));
+        users.delete_key("user7");
+        users.add_key("new",key_of(0));
+        users.flush();
+        network::authentication::KnownUsers journaled;
+        journaled.load(index_path,Format::INDEX);
+        users.save();
+        network::authentication::KnownUsers compacted;
+        compacted.load(index_path,Format::INDEX);
+        names.erase(std::find(names.begin(),names.end(),"user7"));
+        names.insert(std::upper_bound(names.begin(),names.end(),"new"),"new");
+        for(auto* reloaded: {&users,&journaled,&compacted})
+        {
+            if(reloaded->get_key("user5") != key_of(6) or reloaded->get_key("new") != key_of(0) or reloaded->get_all() != names)
+                throw std::runtime_error("known users index updates lost");
+            try
+            {
+                reloaded->get_key("user7");
+                throw std::runtime_error("known users index deleted user found");
+            }catch(network::authentication::KnownUsers::KeyNotFound&){}
+        }
+    }
+    for(auto& path: {toml_path,index_path})
+    {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".journal");
+    }
+}
+
+int test()
+{
+    #ifdef USE_EC_AUTHENTICATION
+    verify_benchmark();
+    #endif
+    known_users_persistence_benchmark();
+    known_users_store_benchmark();
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <toml.hpp>
+#include <ctime>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/thread.hpp>
+#include <boost/thread/sync_queue.hpp>
+#include "logging/logging.hpp"
+#include "network/MessageQueue/MessageQueue.hpp"
+#include "network/udp/udp.hpp"
+#include "defines.hpp"
+#include "parsing/parsing.hpp"
+
+toml::table test_config = toml::table{
+    {"network", toml::table{
+        { "username", "mokaccino"}
+        }}
+};
+
+// cpu time used by the whole process while every service is idle
+void idle_cpu_benchmark()
+{
+    constexpr unsigned int IDLE_MS = 1000;
+    auto cpu_start = std::clock();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(IDLE_MS));
+    auto cpu_end = std::clock();
+    double cpu_ms = double(cpu_end - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+    logging::log("MSG","idle cpu usage: " + std::to_string(cpu_ms / IDLE_MS * 100.0) + "%");
+}
+
+// time from udp::send to the message being pulled from the registered queue
+void packet_to_queue_latency_benchmark()
+{
+    constexpr size_t PACKETS = 1000;
+    // a queue can't be unregistered, it must outlive the listener
+    static network::MessageQueue bench_queue;
+    network::udp::register_queue("BENCH",bench_queue,false);
+    auto loopback = network::udp::connection_map["loopback"]->endpoint;
+    std::vector<double> samples;
+    samples.reserve(PACKETS);
+    for(size_t i = 0; i < PACKETS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        network::udp::send(parsing::compose_message({"BENCH",std::to_string(i)}),loopback);
+        bench_queue.pull();
+        auto end = std::chrono::steady_clock::now();
+        samples.emplace_back(std::chrono::duration<double,std::micro>(end-start).count());
+    }
+    std::sort(samples.begin(),samples.end());
+    double sum = 0;
+    for(auto& s: samples)
+        sum += s;
+    logging::log("MSG","packet to queue latency: avg " + std::to_string(sum/PACKETS) + "us, p50 " + std::to_string(samples[PACKETS/2]) + "us, p99 " + std::to_string(samples[PACKETS*99/100]) + "us");
+}
+
+// items moved from a producer thread to a consumer thread, boost::sync_queue (the previous MessageQueue)
+// against the ring queue with buffers reused through the slots
+void message_queue_throughput_benchmark()
+{
+    constexpr size_t ITEMS = 200000;
+    const std::string message(200,'x');
+    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::address_v4::loopback(),1234);
+    auto measure = [&](auto produce, auto consume)
+    {
+        auto start = std::chrono::steady_clock::now();
+        boost::thread producer([&](){
+            for(size_t i = 0; i < ITEMS; i++)
+                produce();
+        });
+        size_t bytes = 0;
+        for(size_t i = 0; i < ITEMS; i++)
+            bytes += consume();
+        producer.join();
+        if(bytes != ITEMS*message.length())
+            throw std::runtime_error("the queue lost some items");
+        return ITEMS/std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    };
+    boost::sync_queue<network::MessageQueueItem> sync_queue;
+    auto sync_rate = measure([&](){
+        sync_queue.push({"peer",endpoint,message,nullptr});
+    },[&](){
+        return sync_queue.pull().msg.length();
+    });
+    network::MessageQueue ring_queue;
+    network::MessageQueueItem item;
+    auto ring_rate = measure([&](){
+        ring_queue.push_with([&](network::MessageQueueItem& slot){
+            slot.src.assign("peer");
+            slot.src_endpoint = endpoint;
+            slot.msg.assign(message);
+            slot.peer = nullptr;
+        });
+    },[&](){
+        ring_queue.pull(item);
+        return item.msg.length();
+    });
+    logging::log("MSG","message queue: boost::sync_queue " + std::to_string(sync_rate) + " items/s, ring queue " + std::to_string(ring_rate) + " items/s");
+}
+
+// a producer flooding a small queue faster than the consumer handles the items, with every overflow policy
+void queue_overflow_benchmark()
+{
+    constexpr size_t ITEMS = 50000;
+    constexpr size_t CAPACITY = 256;
+    constexpr size_t END = ~(size_t)0;
+    for(auto [policy, policy_name]: {std::pair{network::OverflowPolicy::drop_newest,"drop_newest"},{network::OverflowPolicy::drop_oldest,"drop_oldest"},{network::OverflowPolicy::block,"block"}})
+    {
+        network::RingQueue<size_t> queue{CAPACITY,policy};
+        size_t delivered = 0;
+        auto start = std::chrono::steady_clock::now();
+        boost::thread consumer([&](){
+            size_t item;
+            for(queue.pull(item); item != END; queue.pull(item))
+            {
+                delivered++;
+                for(int i = 0; i < 100; i++)// some work for every item, the fence keeps the loop from being optimized out
+                    std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+        });
+        for(size_t i = 0; i < ITEMS; i++)
+            queue.push(i);
+        while(not queue.try_push_with([&](size_t& item){ item = END; }))
+            boost::this_thread::yield();
+        consumer.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        if(delivered + queue.dropped() != ITEMS)
+            throw std::runtime_error("the queue lost some items without counting them");
+        logging::log("MSG","queue overflow with " + std::string(policy_name) + ": " + std::to_string(delivered) + " delivered, " + std::to_string(queue.dropped()) + " dropped in " + std::to_string(seconds*1000) + "ms");
+    }
+}
+
+// lookups by endpoint of 1k simulated peers from several threads while another one adds and removes peers,
+// the sharded DataMap against the previous layout (two std::map behind a single recursive_mutex)
+void connection_table_benchmark()
+{
+    constexpr size_t PEERS = 1000;
+    constexpr size_t READERS = 4;
+    constexpr size_t LOOKUPS = 100000;
+    constexpr size_t CHURN = 50;
+    std::vector<boost::asio::ip::udp::endpoint> endpoints;
+    for(size_t i = 0; i < PEERS; i++)
+        endpoints.emplace_back(boost::asio::ip::address_v4(0x0a000000 + (unsigned int)i),(unsigned short)(10000 + i));
+    struct SingleLock
+    {
+        std::recursive_mutex obj;
+        std::map<boost::asio::ip::udp::endpoint,std::string> endpoint_name;
+        std::map<std::string,unsigned short> name_data;
+    } single_lock;
+    network::DataMap sharded;
+    for(size_t i = 0; i < PEERS; i++)
+    {
+        single_lock.endpoint_name[endpoints[i]] = "peer" + std::to_string(i);
+        single_lock.name_data["peer" + std::to_string(i)] = 0;
+        sharded.add_user("peer" + std::to_string(i),endpoints[i]);
+    }
+    auto run = [&](auto lookup, auto churn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        boost::thread_group readers;
+        for(size_t t = 0; t < READERS; t++)
+            readers.create_thread([&,t](){
+                for(size_t i = 0; i < LOOKUPS; i++)
+                    lookup(endpoints[(i*7919 + t*131) % PEERS]);
+            });
+        for(size_t i = 0; i < CHURN; i++)
+            churn(i);
+        readers.join_all();
+        return READERS*LOOKUPS/std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    };
+    auto single_rate = run([&](const boost::asio::ip::udp::endpoint& endpoint){
+        std::unique_lock lock(single_lock.obj);
+        auto it = single_lock.endpoint_name.find(endpoint);
+        if(it != single_lock.endpoint_name.end())
+            single_lock.name_data[it->second]++;
+    },[&](size_t i){
+        std::unique_lock lock(single_lock.obj);
+        single_lock.endpoint_name.erase(endpoints[i]);
+        single_lock.endpoint_name[endpoints[i]] = "peer" + std::to_string(i);
+    });
+    auto sharded_rate = run([&](const boost::asio::ip::udp::endpoint& endpoint){
+        auto peer = sharded.find(endpoint);
+        if(peer != nullptr)
+        {
+            std::unique_lock lock(peer->mutex);
+            peer->last_ping_id++;
+        }
+    },[&](size_t i){
+        sharded.remove_user(endpoints[i]);
+        sharded.add_user("peer" + std::to_string(i),endpoints[i]);
+    });
+    if(sharded.size() != PEERS)
+        throw std::runtime_error("the connection table lost some peers");
+    logging::log("MSG","connection table with " + std::to_string(PEERS) + " peers and " + std::to_string(READERS) + " readers: single lock " + std::to_string(single_rate) + " lookups/s, sharded " + std::to_string(sharded_rate) + " lookups/s");
+}
+
+int test()
+{
+    idle_cpu_benchmark();
+    packet_to_queue_latency_benchmark();
+    message_queue_throughput_benchmark();
+    queue_overflow_benchmark();
+    connection_table_benchmark();
+    return 0;
+}
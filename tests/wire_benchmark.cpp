@@ -0,0 +1,107 @@
+#include <toml.hpp>
+#include <chrono>
+#include <stdexcept>
+#include "logging/logging.hpp"
+#include "network/udp/udp.hpp"
+#include "network/udp/wire/wire.hpp"
+#include "network/udp/crypto/crypto.hpp"
+#include "base64/base64.h"
+#include "defines.hpp"
+#include "parsing/parsing.hpp"
+
+toml::table test_config = toml::table{
+    {"network", toml::table{
+        { "username", "mokaccino"}
+        }}
+};
+
+// compose + split of FILE packets with a full chunk, text (base64) vs binary frames
+void wire_throughput_benchmark()
+{
+    constexpr size_t PACKETS = 20000;
+    constexpr size_t PAYLOAD_SIZE = 1024;
+    std::string payload(PAYLOAD_SIZE,'\0');
+    for(size_t i = 0; i < PAYLOAD_SIZE; i++)
+        payload[i] = (char)(i*31);
+    parsing::Tokens fields;
+    for(bool binary: {false,true})
+    {
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < PACKETS; i++)
+        {
+            auto message = network::udp::wire::compose({"FILE","aGFzaA==",std::to_string(i*PAYLOAD_SIZE),payload},binary);
+            bytes += message.length() + 1;
+            network::udp::wire::tokenize(message,fields);
+            if(fields.size() != 4 or fields[3] != payload)
+                throw std::runtime_error("wire round trip failed");
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end-start).count();
+        logging::log("MSG",std::string(binary?"binary":"text") + " wire format: " + std::to_string(bytes/PACKETS) + "B/packet, " + std::to_string(PACKETS/seconds) + " packets/s, " + std::to_string(PACKETS*PAYLOAD_SIZE/seconds/1e6) + "MB/s of payload");
+    }
+}
+
+// tokenization of a text FILE packet with msg_split (a string per token) and tokenize (views)
+void tokenizer_benchmark()
+{
+    constexpr size_t MESSAGES = 20000;
+    auto message = network::udp::wire::compose({"FILE","aGFzaA==","1024",std::string(1024,'x')},false) + " escaped\\ token";
+    auto reference = parsing::msg_split(message);
+    parsing::Tokens tokens;
+    parsing::tokenize(message,tokens);
+    if(tokens.size() != reference.size())
+        throw std::runtime_error("tokenize returned a different number of tokens");
+    for(size_t i = 0; i < reference.size(); i++)
+        if(tokens[i] != reference[i])
+            throw std::runtime_error("tokenize returned a different token");
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < MESSAGES; i++)
+        total += parsing::msg_split(message).size();
+    auto middle = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < MESSAGES; i++)
+    {
+        parsing::tokenize(message,tokens);
+        total += tokens.size() + tokens[4].length();
+    }
+    auto end = std::chrono::steady_clock::now();
+    logging::log("MSG","tokenizer: msg_split " + std::to_string(std::chrono::duration<double,std::nano>(middle-start).count()/MESSAGES) + "ns/message, tokenize " + std::to_string(std::chrono::duration<double,std::nano>(end-middle).count()/MESSAGES) + "ns/message (" + std::to_string(total) + ")");
+}
+
+// encrypt+decrypt of 1KiB payloads on a single core, with a cached cipher and with a new one for every packet
+void cipher_benchmark()
+{
+    constexpr size_t PACKETS = 50000;
+    constexpr size_t PAYLOAD_SIZE = 1024;
+    network::udp::crypto::Key key;
+    for(size_t i = 0; i < AES256_KEY_SIZE; i++)
+        key.data[i] = (unsigned char)i;
+    std::string payload(PAYLOAD_SIZE,'x'), buffer(PAYLOAD_SIZE,'\0');
+    char iv[AES_IV_SIZE], tag[AES_TAG_SIZE];
+    for(bool cached: {false,true})
+    {
+        network::udp::crypto::Cipher cipher{key};
+        size_t packets = cached ? PACKETS : PACKETS/10;
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < packets; i++)
+        {
+            if(not cached)
+                cipher = network::udp::crypto::Cipher{key};
+            cipher.encrypt(payload,buffer.data(),iv,tag);
+            if(not cipher.decrypt(buffer,buffer.data(),std::string_view(iv,AES_IV_SIZE),std::string_view(tag,AES_TAG_SIZE)) or buffer != payload)
+                throw std::runtime_error("decryption failed");
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end-start).count();
+        logging::log("MSG",std::string(cached?"cached":"new") + " cipher: " + std::to_string(packets/seconds) + " encrypt+decrypt/s of " + std::to_string(PAYLOAD_SIZE) + "B");
+    }
+}
+
+int test()
+{
+    wire_throughput_benchmark();
+    tokenizer_benchmark();
+    cipher_benchmark();
+    return 0;
+}